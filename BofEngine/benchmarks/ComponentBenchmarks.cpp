@@ -0,0 +1,1576 @@
+#include "ComponentBenchmarks.h"
+
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+//
+#include "utils/BofAsserts.h"
+#include "utils/Utils.h"
+#include "utils/Timer.h"
+#include "utils/BofLog.h"
+#include "components/GoodComponents.h"
+#include "components/ArchetypeStorage.h"
+#include "components/SoAComponentVector.h"
+#include "components/SystemScheduler.h"
+#include "components/GridCommandBuffer.h"
+#include "components/GridReorder.h"
+#include "components/SpatialIndex.h"
+#include "components/TransformHierarchy.h"
+#include "components/Simulation.h"
+#include "utils/Morton.h"
+
+
+namespace
+{
+    class BenchPositionComp : public GoodSerializable
+    {
+    public:
+        float m_x = 0.0f;
+        float m_y = 0.0f;
+        float m_z = 0.0f;
+
+        GOOD_SERIALIZABLE(BenchPositionComp, GOOD_VERSION(1)
+            , GOOD(m_x)
+            , GOOD(m_y)
+            , GOOD(m_z)
+        );
+    };
+
+    class BenchVelocityComp : public GoodSerializable
+    {
+    public:
+        float m_x = 1.0f;
+        float m_y = 0.0f;
+        float m_z = 0.0f;
+
+        GOOD_SERIALIZABLE(BenchVelocityComp, GOOD_VERSION(1)
+            , GOOD(m_x)
+            , GOOD(m_y)
+            , GOOD(m_z)
+        );
+    };
+
+    class BenchMassComp : public GoodSerializable
+    {
+    public:
+        float m_mass = 2.0f;
+
+        GOOD_SERIALIZABLE(BenchMassComp, GOOD_VERSION(1)
+            , GOOD(m_mass)
+        );
+    };
+
+    // a particle that also carries a lot of stuff the position update doesn't care about
+    class BenchParticleComp : public GoodSerializable
+    {
+    public:
+        float m_x = 0.0f;
+        float m_y = 0.0f;
+        float m_z = 0.0f;
+        float m_vx = 1.0f;
+        float m_vy = 0.5f;
+        float m_vz = 0.0f;
+        std::array<float, 16> m_transform = {};
+        std::array<float, 4> m_color = { 1.0f, 1.0f, 1.0f, 1.0f };
+        double m_spawnTime = 0.0;
+
+        GOOD_SERIALIZABLE(BenchParticleComp, GOOD_VERSION(1)
+            , GOOD(m_x)
+            , GOOD(m_y)
+            , GOOD(m_z)
+            , GOOD(m_vx)
+            , GOOD(m_vy)
+            , GOOD(m_vz)
+            , GOOD(m_transform)
+            , GOOD(m_color)
+            , GOOD(m_spawnTime)
+        );
+    };
+
+    // every entity has a position, half have a velocity, a third have a mass
+    template <class Grid>
+    void PrepareBenchGrid(Grid& grid, size_t entityCount)
+    {
+        grid.template AddCompVector<BenchPositionComp>();
+        grid.template AddCompVector<BenchVelocityComp>();
+        grid.template AddCompVector<BenchMassComp>();
+
+        GoodId entityIdGenerator = 10000;
+        for (size_t i = 0; i < entityCount; i++)
+        {
+            const GoodId entityId = entityIdGenerator++;
+            grid.template AddComp<BenchPositionComp>(entityId);
+            if (i % 2 == 0)
+            {
+                grid.template AddComp<BenchVelocityComp>(entityId);
+            }
+            if (i % 3 == 0)
+            {
+                grid.template AddComp<BenchMassComp>(entityId);
+            }
+        }
+    }
+
+    // std::allocator that counts, to see what a container allocates
+    inline size_t g_countedAllocations = 0;
+    template <class T>
+    struct CountingAllocator
+    {
+        using value_type = T;
+        CountingAllocator() = default;
+        template <class U>
+        CountingAllocator(const CountingAllocator<U>&) {}
+        T* allocate(size_t n)
+        {
+            g_countedAllocations++;
+            return std::allocator<T>().allocate(n);
+        }
+        void deallocate(T* p, size_t n) { std::allocator<T>().deallocate(p, n); }
+        template <class U>
+        bool operator==(const CountingAllocator<U>&) const { return true; }
+    };
+
+    // every operator new of the program, from any thread, see the replacements below
+    std::atomic<size_t> g_globalAllocations = 0;
+
+    // shuffled existing ids, followed by the same amount of ids that are not there
+    vector<GoodId> MakeLookupIds(const vector<GoodId>& entities)
+    {
+        vector<GoodId> lookupIds = entities;
+        for (GoodId entityId : entities)
+        {
+            lookupIds.push_back(entityId + entities.size());
+        }
+        std::mt19937_64 rng(1234);
+        std::shuffle(lookupIds.begin(), lookupIds.end(), rng);
+        return lookupIds;
+    }
+}
+
+
+// replaced for the whole program, to check that code allocates nothing (g_globalAllocations).
+// the array and nothrow forms forward to these ones.
+void* operator new(size_t size)
+{
+    g_globalAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    g_globalAllocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = (size_t)alignment;
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+#endif
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+
+
+void ComponentBenchmarks::RunAll()
+{
+    for (size_t entityCount : { 1000, 10000, 100000 })
+    {
+        EntityIndexLookups(entityCount);
+    }
+    for (size_t entityCount : { 10000, 100000 })
+    {
+        ViewJoin(entityCount);
+        ArchetypeJoin(entityCount);
+        SoAColumns(entityCount);
+        ParallelSystems(entityCount);
+        ChangedSince(entityCount);
+        Snapshots(entityCount);
+        Deltas(entityCount);
+        CommandBuffer(entityCount);
+        Reorder(entityCount);
+        TagQueries(entityCount);
+        PagePoolGrowth(entityCount);
+        CompTypeLookups(entityCount);
+    }
+    Spawn(50000);
+    for (size_t entityCount : { 10000, 100000, 1000000 })
+    {
+        Prefabs(entityCount);
+    }
+    for (size_t entityCount : { 10000, 100000 })
+    {
+        TransformPropagation(entityCount);
+    }
+    SpatialQueries(100000);
+    for (size_t entityCount : { 10000, 100000 })
+    {
+        Rollback(entityCount);
+    }
+    PlayerInputStorage(64);
+    ParallelForEachScaling(200000);
+}
+
+
+void ComponentBenchmarks::EntityIndexLookups(size_t entityCount)
+{
+    // registry ids, so that EntitySlotMap gets them straight in its table. The others don't care.
+    EntityRegistry registry;
+    vector<GoodId> entities;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        entities.push_back(registry.CreateEntity());
+    }
+    const vector<GoodId> lookupIds = MakeLookupIds(entities);
+    constexpr int repeatCount = 10;
+
+    map<GoodId, size_t> oldMap;
+    EntityIndexMap indexMap;
+    EntitySlotMap slotMap;
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        oldMap[entities[i]] = i;
+        indexMap.Set(entities[i], (uint32_t)i);
+        slotMap.Set(entities[i], (uint32_t)i);
+    }
+
+    size_t checksumMap = 0;
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (GoodId entityId : lookupIds)
+        {
+            auto it = oldMap.find(entityId);
+            checksumMap += it != oldMap.end() ? it->second : 1;
+        }
+    }
+    const double mapNanosPerLookup = clock.GetTimeNano() / double(repeatCount * lookupIds.size());
+
+    size_t checksumIndexMap = 0;
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (GoodId entityId : lookupIds)
+        {
+            const uint32_t index = indexMap.Find(entityId);
+            checksumIndexMap += index != EntityIndexMap::m_invalidIndex ? index : 1;
+        }
+    }
+    const double indexMapNanosPerLookup = clock.GetTimeNano() / double(repeatCount * lookupIds.size());
+
+    size_t checksumSlotMap = 0;
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (GoodId entityId : lookupIds)
+        {
+            const uint32_t index = slotMap.Find(entityId);
+            checksumSlotMap += index != EntitySlotMap::m_invalidIndex ? index : 1;
+        }
+    }
+    const double slotMapNanosPerLookup = clock.GetTimeNano() / double(repeatCount * lookupIds.size());
+
+    BOF_ASSERT(checksumMap == checksumIndexMap);
+    BOF_ASSERT(checksumMap == checksumSlotMap);
+
+    BOF_INFO("EntityIndexLookups {:>7} entities: map {:>7.2f}ns, EntityIndexMap {:>7.2f}ns ({:.1f}x), EntitySlotMap {:>7.2f}ns ({:.1f}x) per lookup [{}]",
+        entityCount, mapNanosPerLookup, indexMapNanosPerLookup, mapNanosPerLookup / indexMapNanosPerLookup,
+        slotMapNanosPerLookup, mapNanosPerLookup / slotMapNanosPerLookup, checksumSlotMap);
+}
+
+
+void ComponentBenchmarks::ViewJoin(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    constexpr int repeatCount = 20;
+
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        ComponentVector<BenchPositionComp>* positions = grid.GetComps<BenchPositionComp>();
+        ComponentVector<BenchVelocityComp>* velocities = grid.GetComps<BenchVelocityComp>();
+        ComponentVector<BenchMassComp>* masses = grid.GetComps<BenchMassComp>();
+        for (size_t i = 0; i < positions->Size(); i++)
+        {
+            const GoodId entityId = positions->GetEntityAtIndex(i);
+            BenchVelocityComp* velocity = velocities->GetCompIfExists(entityId);
+            BenchMassComp* mass = masses->GetCompIfExists(entityId);
+            if (velocity != nullptr && mass != nullptr)
+            {
+                positions->GetCompAtIndex(i).m_x += velocity->m_x / mass->m_mass;
+            }
+        }
+    }
+    const double loopMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        grid.View<BenchPositionComp, BenchVelocityComp, BenchMassComp>().ForEach(
+            [](GoodId, BenchPositionComp& position, BenchVelocityComp& velocity, BenchMassComp& mass)
+            {
+                position.m_x += velocity.m_x / mass.m_mass;
+            });
+    }
+    const double viewMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    BOF_INFO("ViewJoin {:>7} entities: GetCompIfExists loop {:>7.3f}ms, View {:>7.3f}ms ({:.1f}x)",
+        entityCount, loopMillis, viewMillis, loopMillis / viewMillis);
+}
+
+
+void ComponentBenchmarks::ArchetypeJoin(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    ArchetypeGrid archetypeGrid;
+    PrepareBenchGrid(archetypeGrid, entityCount);
+    constexpr int repeatCount = 20;
+
+    auto update = [](GoodId, BenchPositionComp& position, BenchVelocityComp& velocity, BenchMassComp& mass)
+    {
+        position.m_x += velocity.m_x / mass.m_mass;
+    };
+
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        grid.View<BenchPositionComp, BenchVelocityComp, BenchMassComp>().ForEach(update);
+    }
+    const double gridMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        archetypeGrid.View<BenchPositionComp, BenchVelocityComp, BenchMassComp>().ForEach(update);
+    }
+    const double archetypeMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    BOF_INFO("ArchetypeJoin {:>7} entities: ComponentGrid {:>7.3f}ms, ArchetypeGrid {:>7.3f}ms ({:.1f}x, {} archetypes)",
+        entityCount, gridMillis, archetypeMillis, gridMillis / archetypeMillis, archetypeGrid.GetArchetypeCount());
+}
+
+
+void ComponentBenchmarks::SoAColumns(size_t entityCount)
+{
+    ComponentVector<BenchParticleComp> particles;
+    SoAComponentVector<BenchParticleComp> soaParticles;
+    GoodId entityIdGenerator = 10000;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        const GoodId entityId = entityIdGenerator++;
+        particles.AddEntityId(entityId);
+        soaParticles.AddEntityId(entityId);
+    }
+    constexpr int repeatCount = 20;
+    constexpr float dt = 1.0f / 60.0f;
+
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = 0; i < particles.Size(); i++)
+        {
+            BenchParticleComp& particle = particles.GetCompAtIndex(i);
+            particle.m_x += particle.m_vx * dt;
+            particle.m_y += particle.m_vy * dt;
+            particle.m_z += particle.m_vz * dt;
+        }
+    }
+    const double aosMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        float* xs = soaParticles.GetColumn(&BenchParticleComp::m_x);
+        float* ys = soaParticles.GetColumn(&BenchParticleComp::m_y);
+        float* zs = soaParticles.GetColumn(&BenchParticleComp::m_z);
+        const float* vxs = soaParticles.GetColumn(&BenchParticleComp::m_vx);
+        const float* vys = soaParticles.GetColumn(&BenchParticleComp::m_vy);
+        const float* vzs = soaParticles.GetColumn(&BenchParticleComp::m_vz);
+        const size_t count = soaParticles.Size();
+        for (size_t i = 0; i < count; i++)
+        {
+            xs[i] += vxs[i] * dt;
+            ys[i] += vys[i] * dt;
+            zs[i] += vzs[i] * dt;
+        }
+    }
+    const double soaMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    BOF_ASSERT(particles.GetCompAtIndex(entityCount - 1).m_x == soaParticles.GetCompAtIndex(entityCount - 1).Get(&BenchParticleComp::m_x));
+
+    BOF_INFO("SoAColumns {:>7} entities: ComponentVector {:>7.3f}ms, SoAComponentVector {:>7.3f}ms ({:.1f}x)",
+        entityCount, aosMillis, soaMillis, aosMillis / soaMillis);
+}
+
+
+void ComponentBenchmarks::ParallelSystems(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    grid.AddCompVector<BenchParticleComp>();
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        grid.AddComp<BenchParticleComp>(grid.GetComps<BenchPositionComp>()->GetEntityAtIndex(i));
+    }
+    constexpr int repeatCount = 20;
+
+    auto addSystems = [](SystemScheduler& scheduler)
+    {
+        scheduler.AddSystem("MovePositions", SystemReads<>(), SystemWrites<BenchPositionComp>(), [](ComponentGrid& grid)
+        {
+            grid.View<BenchPositionComp>().ForEach([](GoodId, BenchPositionComp& position) { position.m_x = sqrtf(position.m_x * position.m_x + 1.0f); });
+        });
+        scheduler.AddSystem("DampVelocities", SystemReads<>(), SystemWrites<BenchVelocityComp>(), [](ComponentGrid& grid)
+        {
+            grid.View<BenchVelocityComp>().ForEach([](GoodId, BenchVelocityComp& velocity) { velocity.m_x = sqrtf(velocity.m_x * 0.99f + 1.0f); });
+        });
+        scheduler.AddSystem("DecayMasses", SystemReads<>(), SystemWrites<BenchMassComp>(), [](ComponentGrid& grid)
+        {
+            grid.View<BenchMassComp>().ForEach([](GoodId, BenchMassComp& mass) { mass.m_mass = sqrtf(mass.m_mass * 0.99f + 1.0f); });
+        });
+        scheduler.AddSystem("MoveParticles", SystemReads<>(), SystemWrites<BenchParticleComp>(), [](ComponentGrid& grid)
+        {
+            grid.View<BenchParticleComp>().ForEach([](GoodId, BenchParticleComp& particle) { particle.m_x = sqrtf(particle.m_x + particle.m_vx); });
+        });
+    };
+
+    Bof::JobSystem singleThread(0);
+    SystemScheduler singleThreadScheduler(singleThread);
+    addSystems(singleThreadScheduler);
+    Bof::JobSystem allCores;
+    SystemScheduler allCoresScheduler(allCores);
+    addSystems(allCoresScheduler);
+
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        singleThreadScheduler.Run(grid);
+    }
+    const double singleThreadMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        allCoresScheduler.Run(grid);
+    }
+    const double allCoresMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+    BOF_INFO("ParallelSystems {:>7} entities: 1 thread {:>7.3f}ms, {} threads {:>7.3f}ms ({:.1f}x, {} batch)",
+        entityCount, singleThreadMillis, allCores.GetThreadCount(), allCoresMillis,
+        singleThreadMillis / allCoresMillis, allCoresScheduler.GetBatchCount());
+}
+
+
+void ComponentBenchmarks::ParallelForEachScaling(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    constexpr int repeatCount = 20;
+
+    auto heavyUpdate = [](GoodId, BenchPositionComp& position)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            position.m_x = sqrtf(position.m_x * position.m_x + 1.0f);
+        }
+    };
+
+    double oneThreadVectorMillis = 0.0;
+    double oneThreadViewMillis = 0.0;
+    const size_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threadCount = 1; threadCount <= coreCount; threadCount *= 2)
+    {
+        Bof::JobSystem jobSystem(threadCount - 1);
+
+        Bof::SimpleClock clock;
+        for (int repeat = 0; repeat < repeatCount; repeat++)
+        {
+            grid.GetComps<BenchPositionComp>()->ParallelForEach(heavyUpdate, ComponentVector<BenchPositionComp>::m_defaultGrainSize, jobSystem);
+        }
+        const double vectorMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+        clock.Reset();
+        for (int repeat = 0; repeat < repeatCount; repeat++)
+        {
+            grid.View<BenchPositionComp, BenchVelocityComp>().ParallelForEach(
+                [&](GoodId entityId, BenchPositionComp& position, BenchVelocityComp&) { heavyUpdate(entityId, position); },
+                ComponentView<BenchPositionComp, BenchVelocityComp>::m_defaultGrainSize, jobSystem);
+        }
+        const double viewMillis = clock.GetTimeMicro() / (1000.0 * repeatCount);
+
+        if (threadCount == 1)
+        {
+            oneThreadVectorMillis = vectorMillis;
+            oneThreadViewMillis = viewMillis;
+        }
+        BOF_INFO("ParallelForEach {:>7} entities, {:>2} threads: ComponentVector {:>7.3f}ms ({:.1f}x), View {:>7.3f}ms ({:.1f}x)",
+            entityCount, threadCount, vectorMillis, oneThreadVectorMillis / vectorMillis, viewMillis, oneThreadViewMillis / viewMillis);
+    }
+}
+
+
+void ComponentBenchmarks::ChangedSince(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    ComponentVector<BenchPositionComp>* positions = grid.GetComps<BenchPositionComp>();
+    vector<BenchPositionComp> renderCopy(entityCount);
+    constexpr int repeatCount = 20;
+    const size_t movingStep = 50;
+
+    double fullSyncMicros = 0.0;
+    double changedSyncMicros = 0.0;
+    size_t syncedCount = 0;
+    uint32_t lastSyncTick = grid.AdvanceChangeTick();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = repeat % movingStep; i < positions->Size(); i += movingStep)
+        {
+            positions->GetCompAtIndex(i).m_x += 1.0f;
+        }
+
+        Bof::SimpleClock clock;
+        for (size_t i = 0; i < positions->Size(); i++)
+        {
+            const BenchPositionComp& position = std::as_const(*positions).GetCompAtIndex(i);
+            renderCopy[i].m_x = position.m_x;
+        }
+        fullSyncMicros += clock.GetTimeNano() / 1000.0;
+
+        clock.Reset();
+        const uint32_t syncTick = grid.AdvanceChangeTick();
+        for (size_t i = 0; i < positions->Size(); i++)
+        {
+            if (positions->HasChangedSince(i, lastSyncTick))
+            {
+                renderCopy[i].m_x = std::as_const(*positions).GetCompAtIndex(i).m_x;
+                syncedCount++;
+            }
+        }
+        lastSyncTick = syncTick;
+        changedSyncMicros += clock.GetTimeNano() / 1000.0;
+    }
+
+    BOF_INFO("ChangedSince {:>7} entities: sync all {:>8.1f}us, sync changed {:>8.1f}us ({:.1f}x, {} per tick)",
+        entityCount, fullSyncMicros / repeatCount, changedSyncMicros / repeatCount,
+        fullSyncMicros / changedSyncMicros, syncedCount / repeatCount);
+}
+
+
+void ComponentBenchmarks::Snapshots(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    ComponentVector<BenchPositionComp>* positions = grid.GetComps<BenchPositionComp>();
+    // tags are in the snapshots too, with their slot bitsets
+    TagVector& tagged = grid.GetTags(1);
+    for (size_t i = 0; i < positions->Size(); i += 3)
+    {
+        tagged.AddEntityId(positions->GetEntityAtIndex(i));
+    }
+    constexpr int repeatCount = 20;
+    const size_t movingStep = 50;
+
+    double binaryCopyMicros = 0.0;
+    double snapshotMicros = 0.0;
+    size_t clonedPageCount = 0;
+    vector<std::unique_ptr<ComponentGrid>> snapshots;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = repeat % movingStep; i < positions->Size(); i += movingStep)
+        {
+            positions->GetCompAtIndex(i).m_x += 1.0f;
+        }
+        clonedPageCount += positions->m_comps.GetUniquePageCount();
+
+        // the way to copy a grid before snapshots
+        Bof::SimpleClock clock;
+        {
+            pods::ResizableOutputBuffer out;
+            pods::BinarySerializer<decltype(out)> serializer(out);
+            serializer.save(grid);
+            ComponentGrid copy;
+            copy.AddCompVector<BenchPositionComp>();
+            copy.AddCompVector<BenchVelocityComp>();
+            copy.AddCompVector<BenchMassComp>();
+            pods::InputBuffer in(out.data(), out.size());
+            pods::BinaryDeserializer<decltype(in)> deserializer(in);
+            deserializer.load(copy);
+        }
+        binaryCopyMicros += clock.GetTimeNano() / 1000.0;
+
+        // kept alive like a rollback buffer would, so that the next tick pays the page clones
+        clock.Reset();
+        snapshots.push_back(grid.Snapshot());
+        snapshotMicros += clock.GetTimeNano() / 1000.0;
+    }
+
+    BOF_INFO("Snapshots    {:>7} entities: binary copy {:>8.1f}us, Snapshot {:>8.1f}us ({:.1f}x, {} of {} position pages cloned per tick)",
+        entityCount, binaryCopyMicros / repeatCount, snapshotMicros / repeatCount,
+        binaryCopyMicros / snapshotMicros, clonedPageCount / repeatCount, positions->m_comps.GetPageCount());
+}
+
+
+void ComponentBenchmarks::Deltas(size_t entityCount)
+{
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    ComponentVector<BenchPositionComp>* positions = grid.GetComps<BenchPositionComp>();
+    ComponentGrid replica;
+    PrepareBenchGrid(replica, entityCount);
+    constexpr int repeatCount = 20;
+    const size_t movingStep = 50;
+
+    double fullEncodeMicros = 0.0;
+    double fullDecodeMicros = 0.0;
+    size_t fullBytes = 0;
+    double deltaEncodeMicros = 0.0;
+    double deltaDecodeMicros = 0.0;
+    size_t deltaBytes = 0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        std::unique_ptr<ComponentGrid> previousTick = grid.Snapshot();
+        for (size_t i = repeat % movingStep; i < positions->Size(); i += movingStep)
+        {
+            positions->GetCompAtIndex(i).m_x += 1.0f;
+        }
+
+        Bof::SimpleClock clock;
+        pods::ResizableOutputBuffer fullOut;
+        {
+            pods::BinarySerializer<decltype(fullOut)> serializer(fullOut);
+            serializer.save(grid);
+        }
+        fullEncodeMicros += clock.GetTimeNano() / 1000.0;
+        fullBytes += fullOut.size();
+
+        clock.Reset();
+        {
+            ComponentGrid copy;
+            copy.AddCompVector<BenchPositionComp>();
+            copy.AddCompVector<BenchVelocityComp>();
+            copy.AddCompVector<BenchMassComp>();
+            pods::InputBuffer in(fullOut.data(), fullOut.size());
+            pods::BinaryDeserializer<decltype(in)> deserializer(in);
+            deserializer.load(copy);
+        }
+        fullDecodeMicros += clock.GetTimeNano() / 1000.0;
+
+        clock.Reset();
+        pods::ResizableOutputBuffer deltaOut;
+        GoodHelpers::WriteDelta(*previousTick, grid, deltaOut);
+        deltaEncodeMicros += clock.GetTimeNano() / 1000.0;
+        deltaBytes += deltaOut.size();
+
+        clock.Reset();
+        pods::InputBuffer in(deltaOut.data(), deltaOut.size());
+        const pods::Error error = GoodHelpers::ApplyDelta(replica, in);
+        deltaDecodeMicros += clock.GetTimeNano() / 1000.0;
+        BOF_ASSERT(error == pods::Error::NoError);
+    }
+    BOF_ASSERT(GoodHelpers::AreEqual(grid, replica));
+
+    BOF_INFO("Deltas       {:>7} entities: full {:>8}B {:>8.1f}us encode {:>8.1f}us decode, delta {:>8}B {:>8.1f}us encode {:>8.1f}us decode",
+        entityCount, fullBytes / repeatCount, fullEncodeMicros / repeatCount, fullDecodeMicros / repeatCount,
+        deltaBytes / repeatCount, deltaEncodeMicros / repeatCount, deltaDecodeMicros / repeatCount);
+}
+
+
+void ComponentBenchmarks::Spawn(size_t entityCount)
+{
+    constexpr int repeatCount = 10;
+    BenchVelocityComp velocityPrototype;
+    velocityPrototype.m_y = 2.0f;
+
+    double oneByOneMicros = 0.0;
+    double bulkMicros = 0.0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        {
+            ComponentGrid grid;
+            grid.AddCompVector<BenchPositionComp>();
+            grid.AddCompVector<BenchVelocityComp>();
+            Bof::SimpleClock clock;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                const GoodId entityId = grid.CreateEntity();
+                grid.AddComp<BenchPositionComp>(entityId);
+                *grid.AddComp<BenchVelocityComp>(entityId) = velocityPrototype;
+            }
+            oneByOneMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            ComponentGrid grid;
+            grid.AddCompVector<BenchPositionComp>();
+            grid.AddCompVector<BenchVelocityComp>();
+            Bof::SimpleClock clock;
+            const vector<GoodId> entityIds = grid.CreateEntities(entityCount, BenchPositionComp(), velocityPrototype);
+            bulkMicros += clock.GetTimeNano() / 1000.0;
+            BOF_ASSERT(entityIds.size() == entityCount && grid.GetComps<BenchVelocityComp>()->Size() == entityCount);
+        }
+    }
+
+    BOF_INFO("Spawn        {:>7} entities: one by one {:>8.1f}us, CreateEntities {:>8.1f}us",
+        entityCount, oneByOneMicros / repeatCount, bulkMicros / repeatCount);
+}
+
+
+void ComponentBenchmarks::CommandBuffer(size_t entityCount)
+{
+    constexpr int repeatCount = 20;
+    constexpr size_t dyingStep = 20;
+    Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault();
+
+    auto prepareGrid = [entityCount](ComponentGrid& grid)
+    {
+        grid.AddCompVector<BenchPositionComp>();
+        grid.AddCompVector<BenchVelocityComp>();
+        grid.CreateEntities(entityCount, BenchPositionComp(), BenchVelocityComp());
+    };
+
+    double lockedRecordMicros = 0.0;
+    double lockedApplyMicros = 0.0;
+    {
+        ComponentGrid grid;
+        prepareGrid(grid);
+        std::mutex mutex;
+        vector<std::pair<GoodId, BenchPositionComp>> deaths;
+        for (int repeat = 0; repeat < repeatCount; repeat++)
+        {
+            deaths.clear();
+            Bof::SimpleClock clock;
+            grid.GetComps<BenchPositionComp>()->ParallelForEach([&](GoodId entityId, BenchPositionComp& position)
+            {
+                if (EntityRegistry::GetSlot(entityId) % dyingStep == repeat % dyingStep)
+                {
+                    std::lock_guard lock(mutex);
+                    deaths.push_back({ entityId, position });
+                }
+            }, ComponentVector<BenchPositionComp>::m_defaultGrainSize, jobSystem);
+            lockedRecordMicros += clock.GetTimeNano() / 1000.0;
+
+            clock.Reset();
+            for (const auto& [entityId, position] : deaths)
+            {
+                const GoodId newEntityId = grid.CreateEntity();
+                *grid.AddComp<BenchPositionComp>(newEntityId) = position;
+                grid.AddComp<BenchVelocityComp>(newEntityId);
+                grid.DestroyEntity(entityId);
+            }
+            lockedApplyMicros += clock.GetTimeNano() / 1000.0;
+        }
+    }
+
+    double bufferRecordMicros = 0.0;
+    double bufferApplyMicros = 0.0;
+    {
+        ComponentGrid grid;
+        prepareGrid(grid);
+        GridCommandBuffer commands(jobSystem);
+        for (int repeat = 0; repeat < repeatCount; repeat++)
+        {
+            Bof::SimpleClock clock;
+            grid.GetComps<BenchPositionComp>()->ParallelForEach([&](GoodId entityId, BenchPositionComp& position)
+            {
+                if (EntityRegistry::GetSlot(entityId) % dyingStep == repeat % dyingStep)
+                {
+                    const GoodId newEntityId = commands.CreateEntity();
+                    commands.AddComp<BenchPositionComp>(newEntityId, position);
+                    commands.AddComp<BenchVelocityComp>(newEntityId);
+                    commands.DestroyEntity(entityId);
+                }
+            }, ComponentVector<BenchPositionComp>::m_defaultGrainSize, jobSystem);
+            bufferRecordMicros += clock.GetTimeNano() / 1000.0;
+
+            clock.Reset();
+            commands.Playback(grid);
+            bufferApplyMicros += clock.GetTimeNano() / 1000.0;
+        }
+        BOF_ASSERT(grid.GetComps<BenchVelocityComp>()->Size() == entityCount);
+    }
+
+    BOF_INFO("CommandBuffer {:>6} entities: mutex {:>8.1f}us record {:>8.1f}us apply, GridCommandBuffer {:>8.1f}us record {:>8.1f}us playback",
+        entityCount, lockedRecordMicros / repeatCount, lockedApplyMicros / repeatCount,
+        bufferRecordMicros / repeatCount, bufferApplyMicros / repeatCount);
+}
+
+
+void ComponentBenchmarks::Reorder(size_t entityCount)
+{
+    constexpr int repeatCount = 20;
+
+    // entities made in random places, velocities and masses added in orders that have nothing to do with it
+    auto prepareScatteredGrid = [entityCount](ComponentGrid& grid)
+    {
+        grid.AddCompVector<BenchPositionComp>();
+        grid.AddCompVector<BenchVelocityComp>();
+        grid.AddCompVector<BenchMassComp>();
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> coordinate(0.0f, 1000.0f);
+        vector<GoodId> entityIds = grid.CreateEntities<BenchPositionComp>(entityCount);
+        ComponentVector<BenchPositionComp>* positions = grid.GetComps<BenchPositionComp>();
+        for (size_t i = 0; i < positions->Size(); i++)
+        {
+            BenchPositionComp& position = positions->GetCompAtIndex(i);
+            position.m_x = coordinate(rng);
+            position.m_y = coordinate(rng);
+            position.m_z = coordinate(rng);
+        }
+        std::shuffle(entityIds.begin(), entityIds.end(), rng);
+        for (GoodId entityId : entityIds)
+        {
+            grid.AddComp<BenchVelocityComp>(entityId);
+        }
+        std::shuffle(entityIds.begin(), entityIds.end(), rng);
+        for (size_t i = 0; i < entityIds.size(); i += 3)
+        {
+            grid.AddComp<BenchMassComp>(entityIds[i]);
+        }
+    };
+    auto mortonKey = [](const BenchPositionComp& position)
+    {
+        return Bof::MortonCode(glm::vec3(position.m_x, position.m_y, position.m_z), glm::vec3(0.0f), 1.0f);
+    };
+    auto timeView = [](ComponentGrid& grid)
+    {
+        Bof::SimpleClock clock;
+        for (int repeat = 0; repeat < repeatCount; repeat++)
+        {
+            grid.View<BenchPositionComp, const BenchVelocityComp, const BenchMassComp>().ForEach(
+                [](GoodId, BenchPositionComp& position, const BenchVelocityComp& velocity, const BenchMassComp& mass)
+                {
+                    position.m_x += velocity.m_x / mass.m_mass;
+                });
+        }
+        return clock.GetTimeNano() / (1000.0 * repeatCount);
+    };
+
+    ComponentGrid grid;
+    prepareScatteredGrid(grid);
+    const double scatteredMicros = timeView(grid);
+    Bof::SimpleClock clock;
+    grid.SortBy<BenchPositionComp>(mortonKey);
+    const double sortMicros = clock.GetTimeNano() / 1000.0;
+    const double sortedMicros = timeView(grid);
+
+    ComponentGrid incrementalGrid;
+    prepareScatteredGrid(incrementalGrid);
+    GridReorder reorder;
+    clock.Reset();
+    reorder.StartSortBy<BenchPositionComp>(incrementalGrid, mortonKey);
+    const double startMicros = clock.GetTimeNano() / 1000.0;
+    const size_t entitiesPerStep = std::max<size_t>(entityCount / 10, 1);
+    double maxStepMicros = 0.0;
+    size_t stepCount = 0;
+    bool isDone = false;
+    while (!isDone)
+    {
+        clock.Reset();
+        isDone = reorder.Step(incrementalGrid, entitiesPerStep);
+        maxStepMicros = std::max(maxStepMicros, clock.GetTimeNano() / 1000.0);
+        stepCount++;
+    }
+    const double incrementalMicros = timeView(incrementalGrid);
+
+    BOF_INFO("Reorder     {:>7} entities: View scattered {:>8.1f}us, SortBy {:>8.1f}us then View {:>8.1f}us ({:.1f}x), "
+        "GridReorder start {:>8.1f}us + {} steps of max {:>8.1f}us then View {:>8.1f}us",
+        entityCount, scatteredMicros, sortMicros, sortedMicros, scatteredMicros / sortedMicros,
+        startMicros, stepCount, maxStepMicros, incrementalMicros);
+}
+
+
+void ComponentBenchmarks::TagQueries(size_t entityCount)
+{
+    constexpr int repeatCount = 20;
+    constexpr GoodId tagA = 1;
+    constexpr GoodId tagB = 2;
+    constexpr GoodId tagC = 3;
+
+    ComponentGrid grid;
+    const vector<GoodId> entityIds = grid.CreateEntities(entityCount);
+    std::mt19937 rng(1234);
+    for (GoodId entityId : entityIds)
+    {
+        if (rng() % 2 == 0)
+        {
+            grid.GetTags(tagA).AddEntityId(entityId);
+        }
+        if (rng() % 3 == 0)
+        {
+            grid.GetTags(tagB).AddEntityId(entityId);
+        }
+        if (rng() % 10 == 0)
+        {
+            grid.GetTags(tagC).AddEntityId(entityId);
+        }
+    }
+    const TagVector& a = grid.GetTags(tagA);
+    const TagVector& b = grid.GetTags(tagB);
+    const TagVector& c = grid.GetTags(tagC);
+
+    size_t lookupCount = 0;
+    GoodId lookupSum = 0;
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = 0; i < a.Size(); i++)
+        {
+            const GoodId entityId = a[i];
+            if (b.HasCompForEntity(entityId) && !c.HasCompForEntity(entityId))
+            {
+                lookupCount++;
+                lookupSum += entityId;
+            }
+        }
+    }
+    const double lookupMicros = clock.GetTimeNano() / (1000.0 * repeatCount);
+
+    const TagQuery query = TagQuery(a).And(b).AndNot(c);
+    size_t queryCount = 0;
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        queryCount += query.Count();
+    }
+    const double countMicros = clock.GetTimeNano() / (1000.0 * repeatCount);
+
+    GoodId querySum = 0;
+    clock.Reset();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        query.ForEach([&querySum](GoodId entityId) { querySum += entityId; });
+    }
+    const double forEachMicros = clock.GetTimeNano() / (1000.0 * repeatCount);
+    BOF_ASSERT(lookupCount == queryCount && lookupSum == querySum);
+
+    BOF_INFO("TagQueries  {:>7} entities: a & b & ~c HasCompForEntity loop {:>8.1f}us, TagQuery Count {:>8.1f}us, ForEach {:>8.1f}us",
+        entityCount, lookupMicros, countMicros, forEachMicros);
+}
+
+
+void ComponentBenchmarks::PagePoolGrowth(size_t entityCount)
+{
+    constexpr int repeatCount = 10;
+    constexpr int churnCount = 5;
+
+    double vectorMicros = 0.0;
+    double heapPagedMicros = 0.0;
+    double poolPagedMicros = 0.0;
+    size_t vectorCopyCount = 0;
+    std::shared_ptr<PagePool> pagePool = std::make_shared<PagePool>();
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        {
+            Bof::SimpleClock clock;
+            vector<BenchPositionComp> comps;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                vectorCopyCount += comps.size() == comps.capacity() ? comps.size() : 0;
+                comps.emplace_back();
+            }
+            vectorMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            Bof::SimpleClock clock;
+            PagedVector<BenchPositionComp> comps;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                comps.emplace_back();
+            }
+            heapPagedMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            // the pool keeps the pages of the previous repeat, like a grid where entities come and go
+            Bof::SimpleClock clock;
+            PagedVector<BenchPositionComp> comps;
+            comps.SetPagePool(pagePool);
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                comps.emplace_back();
+            }
+            poolPagedMicros += clock.GetTimeNano() / 1000.0;
+        }
+    }
+
+    ComponentGrid grid;
+    grid.AddCompVector<BenchPositionComp>();
+    grid.AddCompVector<BenchVelocityComp>();
+    vector<GoodId> entityIds = grid.CreateEntities(entityCount, BenchPositionComp(), BenchVelocityComp());
+    const size_t reservedBytes = grid.GetMemoryStats().m_pagePool.m_reservedBytes;
+    for (int churn = 0; churn < churnCount; churn++)
+    {
+        grid.DestroyEntities(entityIds);
+        entityIds = grid.CreateEntities(entityCount, BenchPositionComp(), BenchVelocityComp());
+    }
+    const GridMemoryStats stats = grid.GetMemoryStats();
+    BOF_ASSERT(stats.m_pagePool.m_reservedBytes == reservedBytes);
+
+    BOF_INFO("PagePool    {:>7} entities: std::vector growth {:>8.1f}us ({} comps copied), PagedVector heap {:>8.1f}us, pool {:>8.1f}us",
+        entityCount, vectorMicros / repeatCount, vectorCopyCount / repeatCount, heapPagedMicros / repeatCount, poolPagedMicros / repeatCount);
+    BOF_INFO("PagePool    {:>7} entities: grid pool {} KB reserved, {} KB after {} death and respawn waves, position comps {:.1f}% fragmentation",
+        entityCount, reservedBytes / 1024, stats.m_pagePool.m_reservedBytes / 1024, churnCount, stats.m_comps[0].GetFragmentation() * 100.0f);
+}
+
+
+void ComponentBenchmarks::CompTypeLookups(size_t entityCount)
+{
+    constexpr int repeatCount = 10;
+
+    ComponentGrid grid;
+    PrepareBenchGrid(grid, entityCount);
+    vector<GoodId> entities;
+    grid.GetComps<BenchPositionComp>()->GetEntitiesVirtual(entities);
+
+    // the old GetComps
+    auto getCompsByClassId = [&grid]<class T>(const T*)
+    {
+        return static_cast<ComponentVector<T>*>(grid.m_compVectorMap.find(T::GetClassId())->second);
+    };
+
+    // the signal fences keep the compiler from taking the lookups out of the loops
+    double mapGetCompsMicros = 0.0;
+    double indexGetCompsMicros = 0.0;
+    size_t mapSum = 0;
+    size_t indexSum = 0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        {
+            Bof::SimpleClock clock;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                mapSum += getCompsByClassId((const BenchVelocityComp*)nullptr)->Size();
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+            mapGetCompsMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            Bof::SimpleClock clock;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                indexSum += grid.GetComps<BenchVelocityComp>()->Size();
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+            indexGetCompsMicros += clock.GetTimeNano() / 1000.0;
+        }
+    }
+    BOF_ASSERT(mapSum == indexSum);
+
+    double mapPerEntityMicros = 0.0;
+    double indexPerEntityMicros = 0.0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        {
+            Bof::SimpleClock clock;
+            for (GoodId entityId : entities)
+            {
+                BenchPositionComp* position = getCompsByClassId((const BenchPositionComp*)nullptr)->GetCompIfExists(entityId);
+                const BenchVelocityComp* velocity = getCompsByClassId((const BenchVelocityComp*)nullptr)->GetCompIfExists(entityId);
+                const BenchMassComp* mass = getCompsByClassId((const BenchMassComp*)nullptr)->GetCompIfExists(entityId);
+                if (velocity != nullptr && mass != nullptr)
+                {
+                    position->m_x += velocity->m_x * mass->m_mass;
+                }
+            }
+            mapPerEntityMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            Bof::SimpleClock clock;
+            for (GoodId entityId : entities)
+            {
+                BenchPositionComp* position = grid.GetCompIfExists<BenchPositionComp>(entityId);
+                const BenchVelocityComp* velocity = grid.GetCompIfExists<BenchVelocityComp>(entityId);
+                const BenchMassComp* mass = grid.GetCompIfExists<BenchMassComp>(entityId);
+                if (velocity != nullptr && mass != nullptr)
+                {
+                    position->m_x += velocity->m_x * mass->m_mass;
+                }
+            }
+            indexPerEntityMicros += clock.GetTimeNano() / 1000.0;
+        }
+    }
+
+    BOF_INFO("CompTypes   {:>7} entities: GetComps x{} class id map {:>8.1f}us ({:.2f}ns each), type index {:>8.1f}us ({:.2f}ns each)",
+        entityCount, entityCount, mapGetCompsMicros / repeatCount, mapGetCompsMicros * 1000.0 / (repeatCount * entityCount),
+        indexGetCompsMicros / repeatCount, indexGetCompsMicros * 1000.0 / (repeatCount * entityCount));
+    BOF_INFO("CompTypes   {:>7} entities: 3 GetCompIfExists per entity, class id map {:>8.1f}us, type index {:>8.1f}us",
+        entityCount, mapPerEntityMicros / repeatCount, indexPerEntityMicros / repeatCount);
+}
+
+
+void ComponentBenchmarks::Prefabs(size_t entityCount)
+{
+    constexpr int repeatCount = 3;
+    constexpr GoodId rockTag = 7;
+
+    // a prefab file, like the ones in data/prefabs
+    {
+        Prefab rock;
+        rock.AddComp<BenchPositionComp>()->m_y = 1.0f;
+        rock.AddComp<BenchVelocityComp>()->m_z = 2.0f;
+        rock.AddComp<BenchMassComp>()->m_mass = 50.0f;
+        rock.AddTag(rockTag);
+        BOF_ASSERT(rock.WriteToFile("bench_rock_prefab") == pods::Error::NoError);
+    }
+    Prefab rock;
+    rock.AddCompVectors<BenchPositionComp, BenchVelocityComp, BenchMassComp>();
+    BOF_ASSERT(rock.ReadFromFile("bench_rock_prefab") == pods::Error::NoError);
+    std::remove("bench_rock_prefab.bin");
+
+    auto prepareGrid = [](ComponentGrid& grid)
+    {
+        grid.AddCompVector<BenchPositionComp>();
+        grid.AddCompVector<BenchVelocityComp>();
+        grid.AddCompVector<BenchMassComp>();
+    };
+
+    double oneByOneMicros = 0.0;
+    double instantiateMicros = 0.0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        {
+            ComponentGrid grid;
+            prepareGrid(grid);
+            const BenchPositionComp& position = *rock.GetGrid().GetConstComps<BenchPositionComp>()->GetCompIfExists(rock.GetEntityId());
+            const BenchVelocityComp& velocity = *rock.GetGrid().GetConstComps<BenchVelocityComp>()->GetCompIfExists(rock.GetEntityId());
+            const BenchMassComp& mass = *rock.GetGrid().GetConstComps<BenchMassComp>()->GetCompIfExists(rock.GetEntityId());
+            Bof::SimpleClock clock;
+            for (size_t i = 0; i < entityCount; i++)
+            {
+                const GoodId entityId = grid.CreateEntity();
+                *grid.AddComp<BenchPositionComp>(entityId) = position;
+                *grid.AddComp<BenchVelocityComp>(entityId) = velocity;
+                *grid.AddComp<BenchMassComp>(entityId) = mass;
+                grid.GetTags(rockTag).AddEntityId(entityId);
+            }
+            oneByOneMicros += clock.GetTimeNano() / 1000.0;
+        }
+        {
+            ComponentGrid grid;
+            prepareGrid(grid);
+            vector<GoodId> rockIds;
+            Bof::SimpleClock clock;
+            grid.Instantiate(rock, entityCount, rockIds);
+            instantiateMicros += clock.GetTimeNano() / 1000.0;
+            BOF_ASSERT(rockIds.size() == entityCount && grid.GetTags(rockTag).Size() == entityCount);
+            BOF_ASSERT(grid.GetCompIfExists<BenchMassComp>(rockIds.back())->m_mass == 50.0f);
+        }
+    }
+
+    BOF_INFO("Prefabs    {:>8} entities: AddComp and copy {:>9.1f}us, Instantiate {:>9.1f}us",
+        entityCount, oneByOneMicros / repeatCount, instantiateMicros / repeatCount);
+}
+
+
+void ComponentBenchmarks::TransformPropagation(size_t entityCount)
+{
+    constexpr size_t childCount = 3;
+    constexpr size_t depth = 4;
+    constexpr int repeatCount = 10;
+    const size_t movingStep = 50;
+
+    ComponentGrid grid;
+    grid.AddCompVector<LocalTransformComp>();
+    grid.AddCompVector<WorldTransformComp>();
+    grid.AddCompVector<ParentComp>();
+    ComponentVector<LocalTransformComp>* locals = grid.GetComps<LocalTransformComp>();
+    ComponentVector<ParentComp>* parents = grid.GetComps<ParentComp>();
+
+    // trees of 1 + 3 + 9 + 27 entities, a level at a time
+    vector<GoodId> roots;
+    vector<GoodId> level;
+    vector<GoodId> nextLevel;
+    while (locals->Size() < entityCount)
+    {
+        const GoodId root = grid.CreateEntity();
+        locals->AddEntityId(root)->m_translation = glm::vec3((float)roots.size(), 0.0f, 0.0f);
+        roots.push_back(root);
+        level = { root };
+        for (size_t d = 1; d < depth; d++)
+        {
+            nextLevel.clear();
+            for (GoodId parentId : level)
+            {
+                for (size_t c = 0; c < childCount; c++)
+                {
+                    const GoodId entityId = grid.CreateEntity();
+                    LocalTransformComp* local = locals->AddEntityId(entityId);
+                    local->m_translation = glm::vec3(1.0f, (float)c, 0.0f);
+                    local->m_rotation = glm::angleAxis(0.3f * (float)c, glm::vec3(0.0f, 1.0f, 0.0f));
+                    parents->AddEntityId(entityId)->m_parentId = parentId;
+                    nextLevel.push_back(entityId);
+                }
+            }
+            std::swap(level, nextLevel);
+        }
+    }
+
+    // the parent chain of each entity, one lookup and one multiply per ancestor
+    float checksumChain = 0.0f;
+    Bof::SimpleClock clock;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = 0; i < locals->Size(); i++)
+        {
+            glm::mat4 matrix = std::as_const(*locals).GetCompAtIndex(i).GetMatrix();
+            const ParentComp* parent = std::as_const(*parents).GetCompIfExists(std::as_const(locals->m_entities)[i]);
+            while (parent != nullptr)
+            {
+                matrix = std::as_const(*locals).GetCompIfExists(parent->m_parentId)->GetMatrix() * matrix;
+                parent = std::as_const(*parents).GetCompIfExists(parent->m_parentId);
+            }
+            checksumChain += matrix[3].x;
+        }
+    }
+    const double chainMicros = clock.GetTimeNano() / 1000.0 / repeatCount;
+
+    // the first one adds the WorldTransformComps
+    TransformHierarchy hierarchy;
+    hierarchy.Update(grid);
+
+    // everything dirty: the order rebuilt and every matrix recomputed
+    double fullMicros = 0.0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        hierarchy.Invalidate();
+        clock.Reset();
+        hierarchy.Update(grid);
+        fullMicros += clock.GetTimeNano() / 1000.0;
+    }
+    fullMicros /= repeatCount;
+
+    float checksumHierarchy = 0.0f;
+    const ComponentVector<WorldTransformComp>& worlds = *grid.GetConstComps<WorldTransformComp>();
+    for (size_t i = 0; i < locals->Size(); i++)
+    {
+        checksumHierarchy += worlds.GetCompIfExists(std::as_const(locals->m_entities)[i])->m_matrix[3].x;
+    }
+    BOF_ASSERT(std::abs(checksumChain / repeatCount - checksumHierarchy) <= 1e-3f * std::abs(checksumHierarchy));
+
+    double dirtyMicros = 0.0;
+    size_t updatedCount = 0;
+    for (int repeat = 0; repeat < repeatCount; repeat++)
+    {
+        for (size_t i = repeat % movingStep; i < roots.size(); i += movingStep)
+        {
+            grid.GetCompIfExists<LocalTransformComp>(roots[i])->m_translation.y += 1.0f;
+        }
+        clock.Reset();
+        hierarchy.Update(grid);
+        dirtyMicros += clock.GetTimeNano() / 1000.0;
+        updatedCount += hierarchy.GetLastUpdatedCount();
+    }
+    dirtyMicros /= repeatCount;
+
+    BOF_INFO("TransformPropagation {:>7} entities: parent chains {:>8.1f}us, rebuild + linear pass {:>8.1f}us ({:.1f}x), 2% of the roots moving {:>8.1f}us ({:.1f}x, {} updated)",
+        locals->Size(), chainMicros, fullMicros, chainMicros / fullMicros, dirtyMicros, chainMicros / dirtyMicros, updatedCount / repeatCount);
+}
+
+
+void ComponentBenchmarks::SpatialQueries(size_t entityCount)
+{
+    constexpr float worldSize = 1000.0f;
+    constexpr float queryRadius = 20.0f;
+    constexpr int tickCount = 10;
+    constexpr size_t queryCount = 10000;
+    constexpr size_t scannedQueryCount = 100;
+
+    ComponentGrid grid;
+    grid.AddCompVector<AABBComp>();
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(0.0f, worldSize);
+    std::uniform_real_distribution<float> speed(-0.2f, 0.2f);
+    vector<glm::vec3> velocities;
+    for (size_t i = 0; i < entityCount; i++)
+    {
+        const glm::vec3 min(position(rng), position(rng), position(rng));
+        grid.AddComp<AABBComp>(grid.CreateEntity())->m_box.set(min, min + glm::vec3(2.0f));
+        velocities.push_back(glm::vec3(speed(rng), speed(rng), speed(rng)));
+    }
+    ComponentVector<AABBComp>* boxes = grid.GetComps<AABBComp>();
+
+    Bof::SimpleClock clock;
+    grid.UpdateSpatialIndex();
+    const double buildMicros = clock.GetTimeNano() / 1000.0;
+
+    double updateMicros = 0.0;
+    size_t reinsertedCount = 0;
+    for (int tick = 0; tick < tickCount; tick++)
+    {
+        for (size_t i = 0; i < boxes->Size(); i++)
+        {
+            boxes->GetCompAtIndex(i).m_box.translate(velocities[i]);
+        }
+        clock.Reset();
+        grid.UpdateSpatialIndex();
+        updateMicros += clock.GetTimeNano() / 1000.0;
+        reinsertedCount += grid.GetSpatialIndex().GetLastReinsertedCount();
+    }
+    updateMicros /= tickCount;
+
+    vector<glm::vec4> spheres;
+    for (size_t i = 0; i < queryCount; i++)
+    {
+        spheres.push_back(glm::vec4(position(rng), position(rng), position(rng), queryRadius));
+    }
+
+    // what every proximity query was without an index
+    size_t scannedHitCount = 0;
+    clock.Reset();
+    for (size_t q = 0; q < scannedQueryCount; q++)
+    {
+        const glm::vec3 center(spheres[q]);
+        for (size_t i = 0; i < boxes->Size(); i++)
+        {
+            const AABB& box = std::as_const(*boxes).GetCompAtIndex(i).m_box;
+            const glm::vec3 delta = center - glm::clamp(center, box.m_min, box.m_max);
+            scannedHitCount += glm::dot(delta, delta) <= queryRadius * queryRadius ? 1 : 0;
+        }
+    }
+    const double scanMicrosPerQuery = clock.GetTimeNano() / 1000.0 / scannedQueryCount;
+
+    const SpatialIndex& index = grid.GetSpatialIndex();
+    size_t treeHitCount = 0;
+    size_t treeHitCountOfScanned = 0;
+    vector<GoodId> hits;
+    clock.Reset();
+    for (size_t q = 0; q < queryCount; q++)
+    {
+        index.QuerySphere(glm::vec3(spheres[q]), queryRadius, hits);
+        treeHitCount += hits.size();
+        treeHitCountOfScanned += q < scannedQueryCount ? hits.size() : 0;
+    }
+    const double treeMicrosPerQuery = clock.GetTimeNano() / 1000.0 / queryCount;
+    BOF_ASSERT(treeHitCountOfScanned == scannedHitCount);
+
+    vector<vector<GoodId>> batchHits;
+    index.QuerySpheres(spheres, batchHits); // warm up, the result vectors get their memory
+    clock.Reset();
+    index.QuerySpheres(spheres, batchHits);
+    const double batchMicrosPerQuery = clock.GetTimeNano() / 1000.0 / queryCount;
+
+    BOF_INFO("SpatialQueries {:>7} entities: build {:>8.1f}us, update (all moving) {:>8.1f}us ({} reinserted), tree height {}",
+        entityCount, buildMicros, updateMicros, reinsertedCount / tickCount, index.GetHeight());
+    BOF_INFO("SpatialQueries {:>7} entities: sphere query scan {:>8.2f}us, tree {:>6.2f}us ({:.0f}x), batch on {} threads {:>6.2f}us, {:.1f} hits per query",
+        entityCount, scanMicrosPerQuery, treeMicrosPerQuery, scanMicrosPerQuery / treeMicrosPerQuery,
+        Bof::JobSystem::GetDefault().GetThreadCount(), batchMicrosPerQuery, treeHitCount / double(queryCount));
+}
+
+
+void ComponentBenchmarks::Rollback(size_t entityCount)
+{
+    constexpr int playerCount = 16;
+    constexpr int frameCount = 300;
+    constexpr int maxDelay = 6;
+
+    auto tick = [](SimulationState& state, const PlayerInputs& inputs, int /*frameIndex*/)
+    {
+        ComponentGrid& grid = state.m_state;
+        grid.View<BenchPositionComp, BenchVelocityComp>().ForEach([](GoodId, BenchPositionComp& position, BenchVelocityComp& velocity)
+        {
+            position.m_x += velocity.m_x;
+            position.m_y += velocity.m_y;
+        });
+        inputs.ForEach([&](int, const PlayerInput& input)
+        {
+            BenchPositionComp* position = grid.GetCompIfExists<BenchPositionComp>(input.m_playerEntityId);
+            position->m_x += input.m_someInput;
+            position->m_z += input.m_someOtherInput ? 1.0f : 0.0f;
+        });
+    };
+    auto addPlayers = [](Simulation& simulation)
+    {
+        for (int player = 0; player < playerCount; player++)
+        {
+            simulation.AddPlayer(10000 + player);
+        }
+    };
+
+    // the inputs of each frame, and the frame at which each of them arrives
+    std::mt19937 rng(1234);
+    vector<vector<PlayerInput>> inputsArrivingAt(frameCount + maxDelay + 1);
+    vector<PlayerInput> onTimeInputs;
+    for (int frame = 1; frame <= frameCount; frame++)
+    {
+        for (int player = 0; player < playerCount; player++)
+        {
+            PlayerInput input;
+            input.m_playerEntityId = 10000 + player;
+            input.m_frameIndex = frame;
+            input.m_someInput = rng() % 3;
+            input.m_someOtherInput = rng() % 2 == 0;
+            // the local player is never late
+            const int delay = player == 0 ? 0 : rng() % (maxDelay + 1);
+            inputsArrivingAt[frame + delay].push_back(input);
+            onTimeInputs.push_back(input);
+        }
+    }
+
+    // ticked by hand, no snapshots
+    double handMicros = 0.0;
+    {
+        auto simulation = std::make_unique<Simulation>(); // 200KB of inputs, not on the stack
+        addPlayers(*simulation);
+        PrepareBenchGrid(simulation->GetState().m_state, entityCount);
+        Bof::SimpleClock clock;
+        for (int frame = 1; frame <= frameCount; frame++)
+        {
+            for (int player = 0; player < playerCount; player++)
+            {
+                simulation->ReceivePlayerInput(onTimeInputs[(frame - 1) * playerCount + player]);
+            }
+            simulation->Update();
+            tick(simulation->GetState(), simulation->GetCurrentPlayerInputs(), frame);
+        }
+        handMicros = clock.GetTimeNano() / 1000.0 / frameCount;
+    }
+
+    double onTimeMicros = 0.0;
+    {
+        auto simulation = std::make_unique<Simulation>();
+        simulation->SetTickFunction(tick);
+        addPlayers(*simulation);
+        PrepareBenchGrid(simulation->GetState().m_state, entityCount);
+        Bof::SimpleClock clock;
+        for (int frame = 1; frame <= frameCount; frame++)
+        {
+            for (int player = 0; player < playerCount; player++)
+            {
+                simulation->ReceivePlayerInput(onTimeInputs[(frame - 1) * playerCount + player]);
+            }
+            simulation->Update();
+        }
+        onTimeMicros = clock.GetTimeNano() / 1000.0 / frameCount;
+        BOF_ASSERT(simulation->GetRollbackStats().m_rollbackCount == 0);
+    }
+
+    double lateMicros = 0.0;
+    auto simulation = std::make_unique<Simulation>();
+    simulation->SetTickFunction(tick);
+    addPlayers(*simulation);
+    PrepareBenchGrid(simulation->GetState().m_state, entityCount);
+    Bof::SimpleClock clock;
+    for (int frame = 1; frame <= frameCount; frame++)
+    {
+        for (const PlayerInput& input : inputsArrivingAt[frame])
+        {
+            simulation->ReceivePlayerInput(input);
+        }
+        simulation->Update();
+    }
+    lateMicros = clock.GetTimeNano() / 1000.0 / frameCount;
+
+    const RollbackStats& stats = simulation->GetRollbackStats();
+    BOF_INFO("Rollback {:>7} entities: tick by hand {:>8.1f}us, with snapshots {:>8.1f}us, with late inputs {:>8.1f}us per frame",
+        entityCount, handMicros, onTimeMicros, lateMicros);
+    BOF_INFO("Rollback {:>7} entities: {} rollbacks in {} frames, depth {:.1f} on average ({} max), resimulation {:>8.1f}us on average ({}us max), {} over the frame budget, {} inputs dropped, {} frames would fit in the budget",
+        entityCount, stats.m_rollbackCount, frameCount, stats.m_resimulatedFrameCount / double(std::max<uint64_t>(stats.m_rollbackCount, 1)),
+        stats.m_maxRollbackDepth, stats.m_totalResimulationMicros / double(std::max<uint64_t>(stats.m_rollbackCount, 1)),
+        stats.m_maxResimulationMicros, stats.m_overBudgetCount, stats.m_droppedInputCount, simulation->GetBudgetRollbackFrames());
+}
+
+
+void ComponentBenchmarks::PlayerInputStorage(size_t playerCount)
+{
+    constexpr int frameCount = 60 * 60;
+    BOF_ASSERT(playerCount <= m_maxPlayerCount);
+
+    vector<PlayerInput> inputs(playerCount);
+    for (size_t player = 0; player < playerCount; player++)
+    {
+        inputs[player].m_playerEntityId = 10000 + player;
+        inputs[player].m_someInput = (int)player;
+        inputs[player].m_someOtherInput = player % 2 == 0;
+    }
+
+    // what Simulation had: a hash map per frame in the ring
+    using InputMap = unordered_map<GoodId, PlayerInput, std::hash<GoodId>, std::equal_to<GoodId>, CountingAllocator<std::pair<const GoodId, PlayerInput>>>;
+    auto mapRing = std::make_unique<RingBuffer<InputMap, m_ringBufferSize>>();
+    int64_t mapSum = 0;
+    g_countedAllocations = 0;
+    Bof::SimpleClock clock;
+    for (int frame = 1; frame <= frameCount; frame++)
+    {
+        while (mapRing->GetCurrentIndex() < frame)
+        {
+            mapRing->Push().clear();
+        }
+        InputMap& frameInputs = mapRing->Get(frame);
+        for (PlayerInput& input : inputs)
+        {
+            input.m_frameIndex = frame;
+            frameInputs[input.m_playerEntityId] = input;
+        }
+        for (const auto& p : std::as_const(*mapRing).Get(frame))
+        {
+            mapSum += p.second.m_someInput;
+        }
+    }
+    const double mapMicros = clock.GetTimeNano() / 1000.0 / frameCount;
+    const double mapAllocationsPerFrame = g_countedAllocations / double(frameCount);
+
+    auto simulation = std::make_unique<Simulation>();
+    for (const PlayerInput& input : inputs)
+    {
+        simulation->AddPlayer(input.m_playerEntityId);
+    }
+    int64_t flatSum = 0;
+    const size_t allocationsBefore = g_globalAllocations;
+    clock.Reset();
+    for (int frame = 1; frame <= frameCount; frame++)
+    {
+        for (PlayerInput& input : inputs)
+        {
+            input.m_frameIndex = frame;
+            simulation->ReceivePlayerInput(input);
+        }
+        simulation->Update();
+        simulation->GetCurrentPlayerInputs().ForEach([&](int, const PlayerInput& input) { flatSum += input.m_someInput; });
+    }
+    const double flatMicros = clock.GetTimeNano() / 1000.0 / frameCount;
+    const size_t flatAllocations = g_globalAllocations - allocationsBefore;
+    BOF_ASSERT(flatSum == mapSum);
+    BOF_ASSERT_MSG(flatAllocations == 0, "%d allocations in the Simulation loop", (int)flatAllocations);
+
+    BOF_INFO("PlayerInputStorage {} players, {} frames at 60Hz: hash map per frame {:>6.2f}us and {:.1f} allocations per frame, PlayerInputs {:>6.2f}us ({:.1f}x) and {} allocations",
+        playerCount, frameCount, mapMicros, mapAllocationsPerFrame, flatMicros, mapMicros / flatMicros, flatAllocations);
+}
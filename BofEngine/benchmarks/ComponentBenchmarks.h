@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+
+// Micro benchmarks for the component storage. Results go to the log.
+// Run them with BofGame2.exe --bench (use the Release build, asserts cost a lot here).
+class ComponentBenchmarks
+{
+public:
+    static void RunAll();
+
+    // random order lookups of existing and missing entities: the std::map we used before, EntityIndexMap (hash)
+    // and EntitySlotMap (by registry slot)
+    static void EntityIndexLookups(size_t entityCount);
+
+    // 3 comp join, grid.View against looping on one ComponentVector and calling GetCompIfExists on the others
+    static void ViewJoin(size_t entityCount);
+
+    // the same 3 comp join, ComponentGrid::View against ArchetypeGrid::View
+    static void ArchetypeJoin(size_t entityCount);
+
+    // integrate the position of a fat comp, ComponentVector against the columns of SoAComponentVector
+    static void SoAColumns(size_t entityCount);
+
+    // 4 systems that don't conflict, SystemScheduler on 1 thread against all the cores
+    static void ParallelSystems(size_t entityCount);
+
+    // ComponentVector::ParallelForEach and View::ParallelForEach, for 1, 2, 4, 8... threads up to the core count
+    static void ParallelForEachScaling(size_t entityCount);
+
+    // 2% of the positions move each tick, sync them all against sync only the changed ones
+    static void ChangedSince(size_t entityCount);
+
+    // copy of the grid each tick with 2% of the positions moving, binary save/load against ComponentGrid::Snapshot
+    static void Snapshots(size_t entityCount);
+
+    // per tick replication with 2% of the positions moving, full binary save/load against WriteDelta/ApplyDelta
+    static void Deltas(size_t entityCount);
+
+    // a wave of entities with a position and a velocity, CreateEntity + AddComp each against grid.CreateEntities
+    static void Spawn(size_t entityCount);
+
+    // 5% of the entities die and spawn a replacement each tick, decided in a ParallelForEach:
+    // ids pushed under a mutex then applied one by one, against a GridCommandBuffer
+    static void CommandBuffer(size_t entityCount);
+
+    // View join over entities spawned in random places and comps added in random orders, before and after
+    // SortBy Morton code of the position, and the same sort done by GridReorder steps
+    static void Reorder(size_t entityCount);
+
+    // "tag a and tag b but not tag c": count and visit, HasCompForEntity on each entity of a against TagQuery
+    static void TagQueries(size_t entityCount);
+
+    // growing a vector of comps one push_back at a time: std::vector, PagedVector on the heap and on a PagePool,
+    // then the pool memory of a grid before and after all its entities died and respawned a few times
+    static void PagePoolGrowth(size_t entityCount);
+
+    // grid.GetComps<T>() alone, then per entity GetCompIfExists on 3 comp types: hash map lookup of the class id
+    // (what GetComps did before) against the CompTypeIndex array
+    static void CompTypeLookups(size_t entityCount);
+
+    // spawn copies of a template entity (position, velocity, mass, a tag): CreateEntity + AddComp + copy
+    // for each, against grid.Instantiate of a Prefab loaded with GoodHelpers::ReadFromFile
+    static void Prefabs(size_t entityCount);
+
+    // world matrices of a forest of 40 entity trees (depth 4): walking the parent chain of each entity
+    // (what bofgltf::Model did), against TransformHierarchy with everything dirty and with 2% of the roots moving
+    static void TransformPropagation(size_t entityCount);
+
+    // entities with an AABBComp all moving a bit each tick: SpatialIndex update, then sphere queries
+    // by scanning the comps, through the index, and as a batch over all the cores
+    static void SpatialQueries(size_t entityCount);
+
+    // a tick moving all the entities with a velocity plus 16 players following their inputs: ticked by hand,
+    // by a Simulation keeping a snapshot per tick with all the inputs on time, then with inputs up to 6 frames late
+    static void Rollback(size_t entityCount);
+
+    // a minute at 60Hz of inputs from every player, stored then read back each frame: a hash map per frame
+    // in a RingBuffer (what Simulation had, counting its allocations) against Simulation and its PlayerInputs
+    static void PlayerInputStorage(size_t playerCount);
+};
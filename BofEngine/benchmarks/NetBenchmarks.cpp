@@ -0,0 +1,175 @@
+#include "NetBenchmarks.h"
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include "utils/BofAsserts.h"
+#include "utils/Timer.h"
+#include "utils/BofLog.h"
+#include "utils/NetTransport.h"
+#include "components/Simulation.h"
+
+
+namespace
+{
+    class BenchPingMessage : public GoodSerializable
+    {
+    public:
+        int64_t m_sendTimeNano = 0;
+        uint32_t m_index = 0;
+
+        GOOD_SERIALIZABLE(BenchPingMessage, GOOD_VERSION(1)
+            , GOOD(m_sendTimeNano)
+            , GOOD(m_index)
+        );
+    };
+
+    constexpr const char* g_endpointA = "127.0.0.1:27015";
+    constexpr const char* g_endpointB = "127.0.0.1:27016";
+}
+
+
+void NetBenchmarks::RunAll()
+{
+    PlayerInput::RegisterClass();
+    BenchPingMessage::RegisterClass();
+
+    Loopback(600);
+    Throughput(200000);
+}
+
+
+void NetBenchmarks::Loopback(size_t inputCount)
+{
+    NetTransport a(g_endpointA, g_endpointB);
+    NetTransport b(g_endpointB, g_endpointA);
+
+    // each side sends the inputs of its player, and counts the ones of the other
+    vector<int> receivedCountsA(inputCount, 0);
+    vector<int> receivedCountsB(inputCount, 0);
+    auto receiveInto = [](vector<int>& receivedCounts)
+    {
+        return [&receivedCounts](GoodSerializable& message)
+        {
+            BOF_ASSERT(message.GetClassIdVirtual() == PlayerInput::GetClassId());
+            receivedCounts[message.Cast<PlayerInput>().m_frameIndex]++;
+        };
+    };
+    auto sendInput = [](NetTransport& transport, GoodId playerEntityId, size_t frame)
+    {
+        PlayerInput input;
+        input.m_playerEntityId = playerEntityId;
+        input.m_frameIndex = (int)frame;
+        input.m_someInput = (int)frame * 3;
+        input.m_someOtherInput = frame % 2 == 0;
+        transport.SendRedundant(input);
+    };
+
+    size_t maxPendingCount = 0;
+    // both send before receiving: the first datagrams of each side have nothing to ack yet
+    auto tick = [&]()
+    {
+        a.Flush();
+        b.Flush();
+        b.Receive(receiveInto(receivedCountsB));
+        a.Receive(receiveInto(receivedCountsA));
+        maxPendingCount = std::max({ maxPendingCount, a.GetPendingMessageCount(), b.GetPendingMessageCount() });
+    };
+
+    for (size_t frame = 0; frame < inputCount; frame++)
+    {
+        sendInput(a, 1, frame);
+        sendInput(b, 2, frame);
+        // the very first datagram of a is lost and the first of b arrives: b had nothing to ack yet,
+        // a must not take it as an ack of the input that was lost
+        a.SetSimulatedLoss(frame == 0 ? 1.0f : 0.25f);
+        b.SetSimulatedLoss(frame == 0 ? 0.0f : 0.25f);
+        tick();
+    }
+    int extraTickCount = 0;
+    while ((a.GetPendingMessageCount() > 0 || b.GetPendingMessageCount() > 0) && extraTickCount < 100)
+    {
+        tick();
+        extraTickCount++;
+    }
+
+    size_t missingCount = 0;
+    size_t duplicateCount = 0;
+    for (const vector<int>* receivedCounts : { &receivedCountsA, &receivedCountsB })
+    {
+        for (int count : *receivedCounts)
+        {
+            missingCount += count == 0 ? 1 : 0;
+            duplicateCount += count > 1 ? 1 : 0;
+        }
+    }
+    BOF_ASSERT_MSG(missingCount == 0 && duplicateCount == 0, "%d inputs missing, %d received twice", (int)missingCount, (int)duplicateCount);
+
+    const NetTransportStats& statsA = a.GetStats();
+    const NetTransportStats& statsB = b.GetStats();
+    const uint64_t resentCount = statsA.m_messagesResent + statsB.m_messagesResent;
+    BOF_INFO("NetTransport loopback {} inputs each way, 25% datagram loss: {} missing, {} duplicates, {} resends ({:.1f} per input), {} copies dropped by the receivers, {} waiting for an ack at most, rtt {:.3f}ms",
+        inputCount, missingCount, duplicateCount, resentCount, resentCount / double(2 * inputCount),
+        statsA.m_duplicatesDropped + statsB.m_duplicatesDropped, maxPendingCount, statsA.m_roundTripMillis);
+}
+
+
+void NetBenchmarks::Throughput(size_t messageCount)
+{
+    // enough in flight to fill datagrams, not so much that the socket buffer overflows
+    constexpr size_t batchSize = 256;
+
+    Bof::SimpleClock clock;
+    vector<double> latenciesMicros;
+    latenciesMicros.reserve(messageCount);
+
+    for (bool coalesce : { false, true })
+    {
+        NetTransport a(g_endpointA, g_endpointB);
+        NetTransport b(g_endpointB, g_endpointA);
+        latenciesMicros.clear();
+
+        auto receive = [&](GoodSerializable& message)
+        {
+            latenciesMicros.push_back((clock.GetTimeNano() - message.Cast<BenchPingMessage>().m_sendTimeNano) / 1000.0);
+        };
+
+        const int64_t startNano = clock.GetTimeNano();
+        size_t sentCount = 0;
+        while (sentCount < messageCount)
+        {
+            const size_t batchEnd = std::min(messageCount, sentCount + batchSize);
+            for (; sentCount < batchEnd; sentCount++)
+            {
+                BenchPingMessage ping;
+                ping.m_sendTimeNano = clock.GetTimeNano();
+                ping.m_index = (uint32_t)sentCount;
+                a.Send(ping);
+                if (!coalesce)
+                {
+                    a.Flush();
+                }
+            }
+            a.Flush();
+            b.Receive(receive);
+        }
+        // the last ones may still be on their way
+        for (int i = 0; i < 100 && latenciesMicros.size() < messageCount; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            b.Receive(receive);
+        }
+        const double seconds = (clock.GetTimeNano() - startNano) / 1e9;
+
+        std::sort(latenciesMicros.begin(), latenciesMicros.end());
+        const size_t receivedCount = latenciesMicros.size();
+        auto percentile = [&](double p) { return receivedCount == 0 ? 0.0 : latenciesMicros[std::min(receivedCount - 1, (size_t)(p * receivedCount))]; };
+        const NetTransportStats& stats = a.GetStats();
+        BOF_INFO("NetTransport {} {} messages: {:.0f} messages/s, {} datagrams ({:.1f} messages each, {:.0f} bytes), {} lost, latency p50 {:.1f}us p99 {:.1f}us max {:.1f}us",
+            coalesce ? "coalesced    " : "one datagram each", messageCount, receivedCount / seconds, stats.m_datagramsSent,
+            messageCount / double(stats.m_datagramsSent), stats.m_bytesSent / double(stats.m_datagramsSent), messageCount - receivedCount,
+            percentile(0.5), percentile(0.99), receivedCount == 0 ? 0.0 : latenciesMicros.back());
+    }
+}
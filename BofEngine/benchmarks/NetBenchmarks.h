@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// NetTransport between two sockets on 127.0.0.1. Results go to the log.
+// Run them with BofGame2.exe --bench, after the ComponentBenchmarks.
+class NetBenchmarks
+{
+public:
+    static void RunAll();
+
+    // inputs sent redundantly both ways with a quarter of the datagrams lost (and the first one of a side),
+    // both sides sending before they received anything: checks each one arrives exactly once, and how many resends it took
+    static void Loopback(size_t inputCount);
+
+    // small timestamped messages as fast as possible, one datagram each and coalesced by Flush:
+    // messages per second and the latency of each message from Send to Receive
+    static void Throughput(size_t messageCount);
+};
@@ -0,0 +1,891 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+//
+#include "GoodComponents.h"
+
+
+// Opt-in archetype storage, for when systems always touch the same few comps together.
+//
+// ComponentGrid keeps one ComponentVector per comp type, so a system touching 3 comps walks 3 unrelated
+// arrays in 3 different orders. Here, all the entities having exactly the same set of comps (an archetype)
+// live together in fixed size chunks, with one column per comp. A join is a linear walk on the chunks of the
+// matching archetypes, every column in the same order, no lookups at all.
+// The price: adding or removing a comp moves the entity (and all its comps) to another archetype.
+// So it's great for stable entities, bad for comps that come and go every frame. Use ComponentGrid for those.
+//
+// The API mimics ComponentGrid:
+//
+// ArchetypeGrid grid;
+// grid.AddCompVector<PositionComp>(); // registers the comp type
+// grid.AddComp<PositionComp>(entityId)->m_x = 3.0f;
+// grid.View<PositionComp, VelocityComp>().ForEach([](GoodId entityId, PositionComp& p, VelocityComp& v) {...});
+//
+// GetComps<T>() gives an ArchetypeCompVector instead of a ComponentVector (the comps of a type are spread over
+// many chunks, so there is no GetCompAtIndex). AddEntityId, GetCompIfExists, RemoveEntityId and Size are there.
+//
+// GOOD serialization writes exactly what ComponentGrid writes, so a file saved from one loads in the other
+// (as long as the comp types are added in the same order, like between two ComponentGrids).
+// Entity ids round trip as they are. A ComponentGrid loading ids that don't fit its registry gives them new ones
+// (see ComponentGrid::RebuildEntityRegistry).
+// Saving copies the comps, so archetype comps must be copy constructible.
+//
+// Like with ComponentGrid, never keep comp pointers: any add or remove can move comps around.
+
+class ArchetypeGrid;
+
+// type erased operations on one comp type, filled by ArchetypeGrid::AddCompVector<T>
+struct ArchetypeCompType
+{
+    GoodId m_classId = 0;
+    const char* m_className = nullptr;
+    size_t m_size = 0;
+    size_t m_alignment = 0;
+
+    void (*m_defaultConstruct)(void* dest) = nullptr;
+    void (*m_moveConstruct)(void* dest, void* src) = nullptr;
+    void (*m_destroy)(void* comp) = nullptr;
+
+    // serialization goes through a temporary ComponentGrid
+    void (*m_addCompVectorToGrid)(ComponentGrid& grid) = nullptr;
+    void (*m_copyToGrid)(ComponentGrid& grid, GoodId entityId, const void* comp) = nullptr;
+    void (*m_collectEntitiesFromGrid)(ComponentGrid& grid, unordered_map<GoodId, vector<GoodId>>& entityToSignature) = nullptr;
+    void (*m_moveFromGrid)(ComponentGrid& grid, ArchetypeGrid& archetypeGrid) = nullptr;
+};
+
+
+struct ArchetypeChunk
+{
+    std::byte* m_data = nullptr; // entity ids column first, then one column per comp
+    uint32_t m_count = 0;
+};
+
+
+// all the entities having exactly the comps in m_signature
+struct Archetype
+{
+    vector<GoodId> m_signature; // sorted comp class ids
+    vector<const ArchetypeCompType*> m_compTypes; // same order as m_signature
+    vector<size_t> m_columnOffsets; // byte offset of each comp column in a chunk
+    uint32_t m_chunkCapacity = 0;
+    size_t m_entityCount = 0;
+
+    vector<ArchetypeChunk> m_chunks;
+
+    // archetype reached by adding or removing one comp type, cached since it's always the same
+    unordered_map<GoodId, uint32_t> m_addEdges;
+    unordered_map<GoodId, uint32_t> m_removeEdges;
+
+    static constexpr uint32_t m_noColumn = ~uint32_t(0);
+
+    inline uint32_t FindColumn(GoodId classId) const
+    {
+        // signatures are short, a linear search is fine
+        for (uint32_t column = 0; column < (uint32_t)m_signature.size(); column++)
+        {
+            if (m_signature[column] == classId)
+            {
+                return column;
+            }
+        }
+        return m_noColumn;
+    }
+
+    inline GoodId* GetEntities(const ArchetypeChunk& chunk) const
+    {
+        return reinterpret_cast<GoodId*>(chunk.m_data);
+    }
+
+    inline void* GetComp(const ArchetypeChunk& chunk, uint32_t column, uint32_t row) const
+    {
+        return chunk.m_data + m_columnOffsets[column] + row * m_compTypes[column]->m_size;
+    }
+
+    template <class T>
+    inline T* GetColumn(const ArchetypeChunk& chunk, uint32_t column) const
+    {
+        return reinterpret_cast<T*>(chunk.m_data + m_columnOffsets[column]);
+    }
+};
+
+
+// where an entity lives
+struct ArchetypeEntityLocation
+{
+    uint32_t m_archetypeIndex = 0;
+    uint32_t m_chunkIndex = 0;
+    uint32_t m_row = 0;
+};
+
+
+// Iterates the entities having all of CompTypes, chunk by chunk. Get one with archetypeGrid.View<A, B>().
+// Same usage as ComponentView.
+template <typename... CompTypes>
+class ArchetypeView
+{
+public:
+    static constexpr size_t m_maxTagFilters = 4;
+
+    explicit ArchetypeView(ArchetypeGrid& grid) : m_grid(grid) {}
+
+    inline ArchetypeView& WithTag(const TagVector& tags)
+    {
+        BOF_ASSERT_MSG(m_withTagCount < m_maxTagFilters, "more than %i WithTag filters", (int)m_maxTagFilters);
+        m_withTags[m_withTagCount++] = &tags;
+        return *this;
+    }
+
+    inline ArchetypeView& WithoutTag(const TagVector& tags)
+    {
+        BOF_ASSERT_MSG(m_withoutTagCount < m_maxTagFilters, "more than %i WithoutTag filters", (int)m_maxTagFilters);
+        m_withoutTags[m_withoutTagCount++] = &tags;
+        return *this;
+    }
+
+    // func(GoodId entityId, CompTypes&... comps)
+    template <typename Func>
+    inline void ForEach(Func&& func);
+
+    inline size_t Count()
+    {
+        size_t count = 0;
+        ForEach([&count](GoodId, CompTypes&...) { count++; });
+        return count;
+    }
+
+private:
+    template <typename Func, size_t... Is>
+    inline void ForEachImpl(Func& func, std::index_sequence<Is...>);
+
+    inline bool PassesTagFilters(GoodId entityId) const
+    {
+        for (size_t t = 0; t < m_withTagCount; t++)
+        {
+            if (!m_withTags[t]->HasCompForEntity(entityId))
+            {
+                return false;
+            }
+        }
+        for (size_t t = 0; t < m_withoutTagCount; t++)
+        {
+            if (m_withoutTags[t]->HasCompForEntity(entityId))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ArchetypeGrid& m_grid;
+
+    std::array<const TagVector*, m_maxTagFilters> m_withTags = {};
+    size_t m_withTagCount = 0;
+    std::array<const TagVector*, m_maxTagFilters> m_withoutTags = {};
+    size_t m_withoutTagCount = 0;
+};
+
+
+// what ArchetypeGrid::GetComps<T>() gives: the ComponentVector calls that make sense when the comps are in chunks
+template <typename CompType>
+class ArchetypeCompVector
+{
+public:
+    explicit ArchetypeCompVector(ArchetypeGrid& grid) : m_grid(grid) {}
+
+    inline CompType* AddEntityId(GoodId entityId);
+    inline bool RemoveEntityId(GoodId entityId);
+    inline CompType* GetCompIfExists(GoodId entityId);
+    inline bool HasCompForEntity(GoodId entityId) const;
+    inline size_t Size() const;
+
+    // func(GoodId entityId, CompType& comp)
+    template <typename Func>
+    inline void ForEach(Func&& func);
+
+private:
+    ArchetypeGrid& m_grid;
+};
+
+
+class ArchetypeGrid : public GoodSerializable
+{
+public:
+
+    // 16 KB: a few chunks fit in L1, and lots of entities fit in a chunk
+    static constexpr size_t m_chunkSizeInBytes = 16 * 1024;
+    static constexpr size_t m_chunkAlignment = 64;
+
+    ArchetypeGrid()
+    {
+        // archetype 0 is for entities with no comps (that might still have tags)
+        GetOrCreateArchetype({});
+    }
+
+    ArchetypeGrid(const ArchetypeGrid& other) = delete;
+
+    ~ArchetypeGrid()
+    {
+        ClearAll();
+    }
+
+    // removes all the entities and tags, but keeps the registered comp types
+    void ClearEntities()
+    {
+        for (Archetype& archetype : m_archetypes)
+        {
+            for (ArchetypeChunk& chunk : archetype.m_chunks)
+            {
+                for (uint32_t column = 0; column < (uint32_t)archetype.m_signature.size(); column++)
+                {
+                    for (uint32_t row = 0; row < chunk.m_count; row++)
+                    {
+                        archetype.m_compTypes[column]->m_destroy(archetype.GetComp(chunk, column, row));
+                    }
+                }
+                FreeChunk(chunk);
+            }
+            archetype.m_chunks.clear();
+            archetype.m_entityCount = 0;
+        }
+        m_entityToLocation.Clear();
+        m_locations.clear();
+        m_freeLocations.clear();
+        m_tagMap.clear();
+    }
+
+    void ClearAll()
+    {
+        ClearEntities();
+        m_archetypes.clear();
+        m_signatureToArchetype.clear();
+        m_compTypes.clear();
+        m_compTypeOrder.clear();
+        GetOrCreateArchetype({});
+    }
+
+    template <class T>
+    inline void AddCompVector()
+    {
+        static_assert(std::is_default_constructible_v<T> && std::is_move_constructible_v<T>,
+            "archetype comps are default and move constructed in chunks");
+        static_assert(std::is_copy_constructible_v<T>,
+            "archetype comps are copied when saving the grid");
+
+        if (m_compTypes.find(T::GetClassId()) != m_compTypes.end())
+        {
+            std::cerr << "error: adding existing compvector " << T::GetClassName() << std::endl;
+            return;
+        }
+
+        m_compTypeOrder.push_back(T::GetClassId());
+        ArchetypeCompType& compType = m_compTypes[T::GetClassId()];
+        compType.m_classId = T::GetClassId();
+        compType.m_className = T::GetClassName();
+        compType.m_size = sizeof(T);
+        compType.m_alignment = alignof(T);
+        compType.m_defaultConstruct = [](void* dest) { std::construct_at(static_cast<T*>(dest)); };
+        compType.m_moveConstruct = [](void* dest, void* src) { std::construct_at(static_cast<T*>(dest), std::move(*static_cast<T*>(src))); };
+        compType.m_destroy = [](void* comp) { std::destroy_at(static_cast<T*>(comp)); };
+
+        compType.m_addCompVectorToGrid = [](ComponentGrid& grid)
+        {
+            if (grid.m_compVectorMap.find(T::GetClassId()) == grid.m_compVectorMap.end())
+            {
+                grid.AddCompVector<T>();
+            }
+        };
+        compType.m_copyToGrid = [](ComponentGrid& grid, GoodId entityId, const void* comp)
+        {
+            T* gridComp = grid.AddComp<T>(entityId);
+            std::destroy_at(gridComp);
+            std::construct_at(gridComp, *static_cast<const T*>(comp));
+        };
+        compType.m_collectEntitiesFromGrid = [](ComponentGrid& grid, unordered_map<GoodId, vector<GoodId>>& entityToSignature)
+        {
+            const ComponentVector<T>* comps = grid.GetComps<T>();
+            for (size_t i = 0; i < comps->Size(); i++)
+            {
+                entityToSignature[comps->GetEntityAtIndex(i)].push_back(T::GetClassId());
+            }
+        };
+        compType.m_moveFromGrid = [](ComponentGrid& grid, ArchetypeGrid& archetypeGrid)
+        {
+            ComponentVector<T>* comps = grid.GetComps<T>();
+            for (size_t i = 0; i < comps->Size(); i++)
+            {
+                void* dest = archetypeGrid.GetCompSlot(comps->GetEntityAtIndex(i), T::GetClassId());
+                std::construct_at(static_cast<T*>(dest), std::move(comps->GetCompAtIndex(i)));
+            }
+        };
+    }
+
+    inline bool HasEntity(GoodId entityId) const
+    {
+        return m_entityToLocation.Contains(entityId);
+    }
+
+    // entities are created by their first AddComp, or with this if they have no comp yet
+    inline void CreateEntity(GoodId entityId)
+    {
+        if (!HasEntity(entityId))
+        {
+            CreateEntityInArchetype(entityId, 0);
+        }
+    }
+
+    // moves the entity to the archetype that has one more comp type
+    // The returned pointer is valid only until the next add or remove (never keep these pointers)
+    template <class T>
+    inline T* AddComp(GoodId entityId)
+    {
+        BOF_ASSERT_MSG(m_compTypes.find(T::GetClassId()) != m_compTypes.end(),
+            "Can't find comp type. Add it to the grid beforehand with grid.AddCompVector<%s>().",
+            T::GetClassName());
+
+        CreateEntity(entityId);
+        const uint32_t locationIndex = m_entityToLocation.Find(entityId);
+        const uint32_t sourceArchetypeIndex = m_locations[locationIndex].m_archetypeIndex;
+
+        BOF_ASSERT_MSG(m_archetypes[sourceArchetypeIndex].FindColumn(T::GetClassId()) == Archetype::m_noColumn,
+            "can't add already existing component %s to entity %i",
+            T::GetClassName(),
+            entityId);
+
+        const uint32_t destArchetypeIndex = GetArchetypeWithComp(sourceArchetypeIndex, T::GetClassId());
+        MoveEntityToArchetype(locationIndex, destArchetypeIndex);
+
+        return static_cast<T*>(GetCompSlot(entityId, T::GetClassId()));
+    }
+
+    template <class T>
+    inline bool RemoveComp(GoodId entityId)
+    {
+        const uint32_t locationIndex = m_entityToLocation.Find(entityId);
+        if (locationIndex == EntitySlotMap::m_invalidIndex)
+        {
+            return false;
+        }
+        const uint32_t sourceArchetypeIndex = m_locations[locationIndex].m_archetypeIndex;
+        if (m_archetypes[sourceArchetypeIndex].FindColumn(T::GetClassId()) == Archetype::m_noColumn)
+        {
+            return false;
+        }
+        const uint32_t destArchetypeIndex = GetArchetypeWithoutComp(sourceArchetypeIndex, T::GetClassId());
+        MoveEntityToArchetype(locationIndex, destArchetypeIndex);
+        return true;
+    }
+
+    // don't keep this pointer!
+    template <class T>
+    inline T* GetCompIfExists(GoodId entityId)
+    {
+        return static_cast<T*>(GetCompSlot(entityId, T::GetClassId()));
+    }
+
+    template <class T>
+    inline ArchetypeCompVector<T> GetComps()
+    {
+        return ArchetypeCompVector<T>(*this);
+    }
+
+    template <class... Ts>
+    inline ArchetypeView<Ts...> View()
+    {
+        return ArchetypeView<Ts...>(*this);
+    }
+
+    // removes the entity, all its comps, and its tags
+    inline void DestroyEntity(GoodId entityId)
+    {
+        const uint32_t locationIndex = m_entityToLocation.Find(entityId);
+        if (locationIndex == EntitySlotMap::m_invalidIndex)
+        {
+            return;
+        }
+        const ArchetypeEntityLocation location = m_locations[locationIndex];
+        Archetype& archetype = m_archetypes[location.m_archetypeIndex];
+        for (uint32_t column = 0; column < (uint32_t)archetype.m_signature.size(); column++)
+        {
+            archetype.m_compTypes[column]->m_destroy(
+                archetype.GetComp(archetype.m_chunks[location.m_chunkIndex], column, location.m_row));
+        }
+        RemoveRow(location);
+
+        m_entityToLocation.Erase(entityId);
+        m_freeLocations.push_back(locationIndex);
+
+        for (auto& p : m_tagMap)
+        {
+            p.second.RemoveEntityId(entityId);
+        }
+    }
+
+    inline TagVector& GetTags(GoodId tagId)
+    {
+        return m_tagMap[tagId];
+    }
+
+    inline size_t GetEntityCount() const { return m_entityToLocation.Size(); }
+    inline size_t GetArchetypeCount() const { return m_archetypes.size(); }
+    inline const vector<Archetype>& GetArchetypes() const { return m_archetypes; }
+
+    // Copies all the entities and tags to a ComponentGrid. Comp vectors missing in the grid are added.
+    void CopyToGrid(ComponentGrid& grid) const
+    {
+        AddCompVectorsToGrid(grid);
+        for (const Archetype& archetype : m_archetypes)
+        {
+            for (const ArchetypeChunk& chunk : archetype.m_chunks)
+            {
+                const GoodId* entities = archetype.GetEntities(chunk);
+                for (uint32_t column = 0; column < (uint32_t)archetype.m_signature.size(); column++)
+                {
+                    for (uint32_t row = 0; row < chunk.m_count; row++)
+                    {
+                        archetype.m_compTypes[column]->m_copyToGrid(grid, entities[row], archetype.GetComp(chunk, column, row));
+                    }
+                }
+            }
+        }
+        for (const auto& p : m_tagMap)
+        {
+            grid.m_tagMap[p.first] = p.second;
+        }
+    }
+
+    // Replaces everything in here with the content of the grid. The comps are moved out of the grid.
+    // Each entity goes straight to its final archetype, no archetype hopping.
+    void MoveFromGrid(ComponentGrid& grid)
+    {
+        ClearEntities();
+
+        unordered_map<GoodId, vector<GoodId>> entityToSignature;
+        for (auto& p : m_compTypes)
+        {
+            if (grid.m_compVectorMap.find(p.first) != grid.m_compVectorMap.end())
+            {
+                p.second.m_collectEntitiesFromGrid(grid, entityToSignature);
+            }
+        }
+        for (auto& p : entityToSignature)
+        {
+            vector<GoodId>& signature = p.second;
+            std::sort(signature.begin(), signature.end());
+            const uint32_t archetypeIndex = GetOrCreateArchetype(signature);
+            CreateEntityInArchetype(p.first, archetypeIndex, false);
+        }
+        for (auto& p : m_compTypes)
+        {
+            if (grid.m_compVectorMap.find(p.first) != grid.m_compVectorMap.end())
+            {
+                p.second.m_moveFromGrid(grid, *this);
+            }
+        }
+
+        m_tagMap = std::move(grid.m_tagMap);
+        for (auto& p : m_tagMap)
+        {
+            for (size_t i = 0; i < p.second.Size(); i++)
+            {
+                CreateEntity(p.second[i]);
+            }
+        }
+    }
+
+
+    // follows the ComponentGrid version (2 has the entity registry)
+    GOOD_SERIALIZABLE_PARTIAL(ArchetypeGrid, GOOD_VERSION(2));
+
+    // The same fields as ComponentGrid, going through a temporary ComponentGrid.
+    // We don't make our entity ids, they are saved and loaded as they are: the registry saved is the one
+    // made from them when they fit one, else an empty one that a ComponentGrid loading it rebuilds.
+#define THIS_REPEATED_SAVE()\
+    ComponentGrid grid;\
+    CopyToGrid(grid);\
+    grid.RebuildEntityRegistryKeepingIds();\
+    return grid.serialize(serializer, version);
+
+#define THIS_REPEATED_LOAD()\
+    ComponentGrid grid;\
+    AddCompVectorsToGrid(grid);\
+    PODS_SAFE_CALL(grid.serialize(serializer, version));\
+    grid.RestoreLegacyEntityIds();\
+    MoveFromGrid(grid);\
+    return pods::Error::NoError;
+
+    pods::Error serialize(pods::JsonDeserializer<pods::InputBuffer>& serializer, pods::Version version)
+    {
+        THIS_REPEATED_LOAD();
+    }
+    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version version)
+    {
+        THIS_REPEATED_LOAD();
+    }
+    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
+    {
+        THIS_REPEATED_SAVE();
+    }
+    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
+    {
+        THIS_REPEATED_SAVE();
+    }
+    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
+    {
+        THIS_REPEATED_SAVE();
+    }
+#undef THIS_REPEATED_SAVE
+#undef THIS_REPEATED_LOAD
+
+
+    // nullptr if the entity doesn't have this comp
+    inline void* GetCompSlot(GoodId entityId, GoodId classId)
+    {
+        const uint32_t locationIndex = m_entityToLocation.Find(entityId);
+        if (locationIndex == EntitySlotMap::m_invalidIndex)
+        {
+            return nullptr;
+        }
+        const ArchetypeEntityLocation& location = m_locations[locationIndex];
+        const Archetype& archetype = m_archetypes[location.m_archetypeIndex];
+        const uint32_t column = archetype.FindColumn(classId);
+        if (column == Archetype::m_noColumn)
+        {
+            return nullptr;
+        }
+        return archetype.GetComp(archetype.m_chunks[location.m_chunkIndex], column, location.m_row);
+    }
+
+    inline bool HasComp(GoodId entityId, GoodId classId) const
+    {
+        const uint32_t locationIndex = m_entityToLocation.Find(entityId);
+        return locationIndex != EntitySlotMap::m_invalidIndex &&
+            m_archetypes[m_locations[locationIndex].m_archetypeIndex].FindColumn(classId) != Archetype::m_noColumn;
+    }
+
+    unordered_map<GoodId, TagVector> m_tagMap;
+
+private:
+
+    // same order as our AddCompVector calls, so that the grid serializes its comp vectors in the same order
+    void AddCompVectorsToGrid(ComponentGrid& grid) const
+    {
+        for (GoodId classId : m_compTypeOrder)
+        {
+            m_compTypes.at(classId).m_addCompVectorToGrid(grid);
+        }
+    }
+
+    uint32_t GetOrCreateArchetype(const vector<GoodId>& signature)
+    {
+        auto it = m_signatureToArchetype.find(signature);
+        if (it != m_signatureToArchetype.end())
+        {
+            return it->second;
+        }
+
+        Archetype archetype;
+        archetype.m_signature = signature;
+        size_t rowSize = sizeof(GoodId);
+        for (GoodId classId : signature)
+        {
+            const ArchetypeCompType& compType = m_compTypes.at(classId);
+            archetype.m_compTypes.push_back(&compType);
+            rowSize += compType.m_size;
+        }
+
+        // as many rows as possible, while each column stays aligned for its comp type
+        uint32_t capacity = (uint32_t)(m_chunkSizeInBytes / rowSize);
+        while (capacity > 1 && !ComputeColumnOffsets(archetype, capacity))
+        {
+            capacity--;
+        }
+        BOF_ASSERT_MSG(ComputeColumnOffsets(archetype, capacity),
+            "a single entity of this archetype doesn't fit in %i bytes", (int)m_chunkSizeInBytes);
+        archetype.m_chunkCapacity = capacity;
+
+        const uint32_t archetypeIndex = (uint32_t)m_archetypes.size();
+        m_archetypes.push_back(std::move(archetype));
+        m_signatureToArchetype[signature] = archetypeIndex;
+        return archetypeIndex;
+    }
+
+    // entity ids column first, then each comp column. false if it doesn't fit in a chunk
+    static bool ComputeColumnOffsets(Archetype& archetype, uint32_t capacity)
+    {
+        archetype.m_columnOffsets.clear();
+        size_t offset = sizeof(GoodId) * capacity;
+        for (const ArchetypeCompType* compType : archetype.m_compTypes)
+        {
+            offset = (offset + compType->m_alignment - 1) / compType->m_alignment * compType->m_alignment;
+            archetype.m_columnOffsets.push_back(offset);
+            offset += compType->m_size * capacity;
+        }
+        return offset <= m_chunkSizeInBytes;
+    }
+
+    uint32_t GetArchetypeWithComp(uint32_t archetypeIndex, GoodId classId)
+    {
+        auto it = m_archetypes[archetypeIndex].m_addEdges.find(classId);
+        if (it != m_archetypes[archetypeIndex].m_addEdges.end())
+        {
+            return it->second;
+        }
+        vector<GoodId> signature = m_archetypes[archetypeIndex].m_signature;
+        signature.insert(std::upper_bound(signature.begin(), signature.end(), classId), classId);
+        const uint32_t destIndex = GetOrCreateArchetype(signature);
+        m_archetypes[archetypeIndex].m_addEdges[classId] = destIndex;
+        return destIndex;
+    }
+
+    uint32_t GetArchetypeWithoutComp(uint32_t archetypeIndex, GoodId classId)
+    {
+        auto it = m_archetypes[archetypeIndex].m_removeEdges.find(classId);
+        if (it != m_archetypes[archetypeIndex].m_removeEdges.end())
+        {
+            return it->second;
+        }
+        vector<GoodId> signature = m_archetypes[archetypeIndex].m_signature;
+        signature.erase(std::find(signature.begin(), signature.end(), classId));
+        const uint32_t destIndex = GetOrCreateArchetype(signature);
+        m_archetypes[archetypeIndex].m_removeEdges[classId] = destIndex;
+        return destIndex;
+    }
+
+    static std::byte* AllocateChunk()
+    {
+        return static_cast<std::byte*>(::operator new(m_chunkSizeInBytes, std::align_val_t(m_chunkAlignment)));
+    }
+
+    static void FreeChunk(ArchetypeChunk& chunk)
+    {
+        ::operator delete(chunk.m_data, std::align_val_t(m_chunkAlignment));
+        chunk.m_data = nullptr;
+        chunk.m_count = 0;
+    }
+
+    // new row at the end of the archetype. The comps are not constructed.
+    ArchetypeEntityLocation AllocateRow(uint32_t archetypeIndex, GoodId entityId)
+    {
+        Archetype& archetype = m_archetypes[archetypeIndex];
+        if (archetype.m_chunks.empty() || archetype.m_chunks.back().m_count == archetype.m_chunkCapacity)
+        {
+            archetype.m_chunks.push_back(ArchetypeChunk{ AllocateChunk(), 0 });
+        }
+        ArchetypeChunk& chunk = archetype.m_chunks.back();
+        ArchetypeEntityLocation location;
+        location.m_archetypeIndex = archetypeIndex;
+        location.m_chunkIndex = (uint32_t)archetype.m_chunks.size() - 1;
+        location.m_row = chunk.m_count;
+        archetype.GetEntities(chunk)[chunk.m_count] = entityId;
+        chunk.m_count++;
+        archetype.m_entityCount++;
+        return location;
+    }
+
+    // The comps of this row must already be destroyed or moved out.
+    // The last row of the archetype moves into the hole, so chunks stay dense.
+    void RemoveRow(const ArchetypeEntityLocation& location)
+    {
+        Archetype& archetype = m_archetypes[location.m_archetypeIndex];
+        ArchetypeChunk& lastChunk = archetype.m_chunks.back();
+        const uint32_t lastChunkIndex = (uint32_t)archetype.m_chunks.size() - 1;
+        const uint32_t lastRow = lastChunk.m_count - 1;
+
+        if (location.m_chunkIndex != lastChunkIndex || location.m_row != lastRow)
+        {
+            ArchetypeChunk& chunk = archetype.m_chunks[location.m_chunkIndex];
+            for (uint32_t column = 0; column < (uint32_t)archetype.m_signature.size(); column++)
+            {
+                void* lastComp = archetype.GetComp(lastChunk, column, lastRow);
+                archetype.m_compTypes[column]->m_moveConstruct(archetype.GetComp(chunk, column, location.m_row), lastComp);
+                archetype.m_compTypes[column]->m_destroy(lastComp);
+            }
+            const GoodId movedEntityId = archetype.GetEntities(lastChunk)[lastRow];
+            archetype.GetEntities(chunk)[location.m_row] = movedEntityId;
+            m_locations[m_entityToLocation.Find(movedEntityId)] = location;
+        }
+
+        lastChunk.m_count--;
+        archetype.m_entityCount--;
+        if (lastChunk.m_count == 0)
+        {
+            FreeChunk(lastChunk);
+            archetype.m_chunks.pop_back();
+        }
+    }
+
+    void CreateEntityInArchetype(GoodId entityId, uint32_t archetypeIndex, bool constructComps = true)
+    {
+        uint32_t locationIndex;
+        if (m_freeLocations.empty())
+        {
+            locationIndex = (uint32_t)m_locations.size();
+            m_locations.emplace_back();
+        }
+        else
+        {
+            locationIndex = m_freeLocations.back();
+            m_freeLocations.pop_back();
+        }
+        m_locations[locationIndex] = AllocateRow(archetypeIndex, entityId);
+        m_entityToLocation.Set(entityId, locationIndex);
+
+        if (constructComps)
+        {
+            const ArchetypeEntityLocation& location = m_locations[locationIndex];
+            Archetype& archetype = m_archetypes[archetypeIndex];
+            for (uint32_t column = 0; column < (uint32_t)archetype.m_signature.size(); column++)
+            {
+                archetype.m_compTypes[column]->m_defaultConstruct(
+                    archetype.GetComp(archetype.m_chunks[location.m_chunkIndex], column, location.m_row));
+            }
+        }
+    }
+
+    // comps present in both archetypes are moved, new ones default constructed, missing ones destroyed
+    void MoveEntityToArchetype(uint32_t locationIndex, uint32_t destArchetypeIndex)
+    {
+        const ArchetypeEntityLocation sourceLocation = m_locations[locationIndex];
+        const ArchetypeEntityLocation destLocation = AllocateRow(
+            destArchetypeIndex,
+            m_archetypes[sourceLocation.m_archetypeIndex].GetEntities(
+                m_archetypes[sourceLocation.m_archetypeIndex].m_chunks[sourceLocation.m_chunkIndex])[sourceLocation.m_row]);
+
+        Archetype& source = m_archetypes[sourceLocation.m_archetypeIndex];
+        Archetype& dest = m_archetypes[destArchetypeIndex];
+        ArchetypeChunk& sourceChunk = source.m_chunks[sourceLocation.m_chunkIndex];
+        ArchetypeChunk& destChunk = dest.m_chunks[destLocation.m_chunkIndex];
+
+        for (uint32_t destColumn = 0; destColumn < (uint32_t)dest.m_signature.size(); destColumn++)
+        {
+            void* destComp = dest.GetComp(destChunk, destColumn, destLocation.m_row);
+            const uint32_t sourceColumn = source.FindColumn(dest.m_signature[destColumn]);
+            if (sourceColumn == Archetype::m_noColumn)
+            {
+                dest.m_compTypes[destColumn]->m_defaultConstruct(destComp);
+            }
+            else
+            {
+                void* sourceComp = source.GetComp(sourceChunk, sourceColumn, sourceLocation.m_row);
+                dest.m_compTypes[destColumn]->m_moveConstruct(destComp, sourceComp);
+                source.m_compTypes[sourceColumn]->m_destroy(sourceComp);
+            }
+        }
+        for (uint32_t sourceColumn = 0; sourceColumn < (uint32_t)source.m_signature.size(); sourceColumn++)
+        {
+            if (dest.FindColumn(source.m_signature[sourceColumn]) == Archetype::m_noColumn)
+            {
+                source.m_compTypes[sourceColumn]->m_destroy(source.GetComp(sourceChunk, sourceColumn, sourceLocation.m_row));
+            }
+        }
+
+        RemoveRow(sourceLocation);
+        m_locations[locationIndex] = destLocation;
+    }
+
+    template <typename... CompTypes> friend class ArchetypeView;
+    template <typename CompType> friend class ArchetypeCompVector;
+
+    // registered comp types. unordered_map nodes don't move, archetypes keep pointers to them.
+    unordered_map<GoodId, ArchetypeCompType> m_compTypes;
+    vector<GoodId> m_compTypeOrder;
+
+    vector<Archetype> m_archetypes;
+    map<vector<GoodId>, uint32_t> m_signatureToArchetype;
+
+    // entity id -> index in m_locations
+    EntitySlotMap m_entityToLocation;
+    vector<ArchetypeEntityLocation> m_locations;
+    vector<uint32_t> m_freeLocations;
+};
+
+
+
+template <typename... CompTypes>
+template <typename Func>
+inline void ArchetypeView<CompTypes...>::ForEach(Func&& func)
+{
+    ForEachImpl(func, std::index_sequence_for<CompTypes...>{});
+}
+
+template <typename... CompTypes>
+template <typename Func, size_t... Is>
+inline void ArchetypeView<CompTypes...>::ForEachImpl(Func& func, std::index_sequence<Is...>)
+{
+    const bool hasTagFilters = m_withTagCount > 0 || m_withoutTagCount > 0;
+
+    for (const Archetype& archetype : m_grid.m_archetypes)
+    {
+        const uint32_t columns[sizeof...(CompTypes)] = { archetype.FindColumn(CompTypes::GetClassId())... };
+        if (((columns[Is] == Archetype::m_noColumn) || ...))
+        {
+            continue;
+        }
+
+        for (const ArchetypeChunk& chunk : archetype.m_chunks)
+        {
+            const GoodId* entities = archetype.GetEntities(chunk);
+            std::tuple<CompTypes*...> columnPointers(archetype.template GetColumn<CompTypes>(chunk, columns[Is])...);
+
+            for (uint32_t row = 0; row < chunk.m_count; row++)
+            {
+                if (hasTagFilters && !PassesTagFilters(entities[row]))
+                {
+                    continue;
+                }
+                func(entities[row], std::get<Is>(columnPointers)[row]...);
+            }
+        }
+    }
+}
+
+
+template <typename CompType>
+inline CompType* ArchetypeCompVector<CompType>::AddEntityId(GoodId entityId)
+{
+    return m_grid.template AddComp<CompType>(entityId);
+}
+
+template <typename CompType>
+inline bool ArchetypeCompVector<CompType>::RemoveEntityId(GoodId entityId)
+{
+    return m_grid.template RemoveComp<CompType>(entityId);
+}
+
+template <typename CompType>
+inline CompType* ArchetypeCompVector<CompType>::GetCompIfExists(GoodId entityId)
+{
+    return m_grid.template GetCompIfExists<CompType>(entityId);
+}
+
+template <typename CompType>
+inline bool ArchetypeCompVector<CompType>::HasCompForEntity(GoodId entityId) const
+{
+    return m_grid.HasComp(entityId, CompType::GetClassId());
+}
+
+template <typename CompType>
+inline size_t ArchetypeCompVector<CompType>::Size() const
+{
+    size_t size = 0;
+    for (const Archetype& archetype : m_grid.m_archetypes)
+    {
+        if (archetype.FindColumn(CompType::GetClassId()) != Archetype::m_noColumn)
+        {
+            size += archetype.m_entityCount;
+        }
+    }
+    return size;
+}
+
+template <typename CompType>
+template <typename Func>
+inline void ArchetypeCompVector<CompType>::ForEach(Func&& func)
+{
+    m_grid.template View<CompType>().ForEach(func);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+//
+#include "utils/GoodSave.h"
+
+
+// A small dense number per comp type, the same for the whole process: 0, 1, 2... in the order the types
+// are first seen (ComponentGrid::AddCompVector, or the first GetComps). The grids keep their comp vectors
+// in an array at that index, so GetComps<T>() is an array access instead of a hash map lookup.
+//
+// Not stable between runs, never save it, save the class id.
+class CompTypeIndexRegistry
+{
+public:
+    // the index of classId, a new one the first time
+    static uint32_t GetOrAssign(GoodId classId)
+    {
+        CompTypeIndexRegistry& registry = Get();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        auto it = registry.m_indices.try_emplace(classId, (uint32_t)registry.m_indices.size()).first;
+        return it->second;
+    }
+
+    static uint32_t GetCount()
+    {
+        CompTypeIndexRegistry& registry = Get();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        return (uint32_t)registry.m_indices.size();
+    }
+
+private:
+    static CompTypeIndexRegistry& Get()
+    {
+        static CompTypeIndexRegistry s_registry;
+        return s_registry;
+    }
+
+    std::mutex m_mutex;
+    std::unordered_map<GoodId, uint32_t> m_indices;
+};
+
+// After the first call it's the load of a static (and its guard).
+template <class T>
+inline uint32_t GetCompTypeIndex()
+{
+    static const uint32_t s_index = CompTypeIndexRegistry::GetOrAssign(T::GetClassId());
+    return s_index;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+//
+#include "PagedVector.h"
+//
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BOF_BITSET_SSE2
+#endif
+
+
+// Word operations for the bitsets, 2 words at a time with SSE2 (always there on x64).
+// wordCount is a multiple of 2.
+namespace BitsetOps
+{
+    // dest = dest & src
+    inline void And(uint64_t* dest, const uint64_t* src, size_t wordCount)
+    {
+#ifdef BOF_BITSET_SSE2
+        for (size_t i = 0; i < wordCount; i += 2)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_and_si128(a, b));
+        }
+#else
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            dest[i] &= src[i];
+        }
+#endif
+    }
+
+    // dest = dest | src
+    inline void Or(uint64_t* dest, const uint64_t* src, size_t wordCount)
+    {
+#ifdef BOF_BITSET_SSE2
+        for (size_t i = 0; i < wordCount; i += 2)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_or_si128(a, b));
+        }
+#else
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            dest[i] |= src[i];
+        }
+#endif
+    }
+
+    // dest = dest & ~src
+    inline void AndNot(uint64_t* dest, const uint64_t* src, size_t wordCount)
+    {
+#ifdef BOF_BITSET_SSE2
+        for (size_t i = 0; i < wordCount; i += 2)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            // andnot is ~first & second
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_andnot_si128(b, a));
+        }
+#else
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            dest[i] &= ~src[i];
+        }
+#endif
+    }
+
+    inline size_t PopCount(const uint64_t* words, size_t wordCount)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            count += (size_t)std::popcount(words[i]);
+        }
+        return count;
+    }
+
+    // func(bitIndex) for each set bit, firstBitIndex being the index of the first bit of words[0]
+    template <typename Func>
+    inline void ForEachSetBit(const uint64_t* words, size_t wordCount, uint32_t firstBitIndex, Func&& func)
+    {
+        for (size_t i = 0; i < wordCount; i++)
+        {
+            uint64_t word = words[i];
+            while (word != 0)
+            {
+                func(firstBitIndex + (uint32_t)(i * 64) + (uint32_t)std::countr_zero(word));
+                word &= word - 1;
+            }
+        }
+    }
+}
+
+
+
+// One bit per entity slot (see EntityRegistry), for the set algebra of the tags (TagQuery).
+//
+// The words are cut in blocks of m_blockWordCount words (512 slots, a cache line), and a summary has one
+// bit per block that has something in it. Sparse sets, like a tag on a few entities of a big grid, skip the
+// empty blocks 64 at a time when iterating or combining, without the bookkeeping of a compressed bitmap.
+// The words always cover whole blocks, so block operations never check the end.
+// Words and summary are PagedVectors like the rest of the tag storage: a grid Snapshot shares them,
+// and a tick setting a few bits clones only the pages of those bits. A block never straddles two pages.
+class EntityBitset
+{
+public:
+    static constexpr size_t m_blockWordCount = 8;
+    static constexpr size_t m_blockBitCount = m_blockWordCount * 64;
+    using WordVector = PagedVector<uint64_t>;
+    static_assert(WordVector::m_pageCapacity % m_blockWordCount == 0, "a block must fit in a page");
+
+    inline bool Test(uint32_t slot) const
+    {
+        const size_t wordIndex = slot >> 6;
+        return wordIndex < m_words.size() && ((m_words[wordIndex] >> (slot & 63)) & 1) != 0;
+    }
+
+    inline void Set(uint32_t slot)
+    {
+        const size_t wordIndex = slot >> 6;
+        if (wordIndex >= m_words.size())
+        {
+            Grow(wordIndex + 1);
+        }
+        const uint64_t bit = (uint64_t)1 << (slot & 63);
+        if ((std::as_const(m_words)[wordIndex] & bit) == 0)
+        {
+            m_words[wordIndex] |= bit;
+            m_count++;
+            const size_t blockIndex = wordIndex / m_blockWordCount;
+            m_summary[blockIndex >> 6] |= (uint64_t)1 << (blockIndex & 63);
+        }
+    }
+
+    inline void Reset(uint32_t slot)
+    {
+        const size_t wordIndex = slot >> 6;
+        const uint64_t bit = (uint64_t)1 << (slot & 63);
+        if (wordIndex >= m_words.size() || (std::as_const(m_words)[wordIndex] & bit) == 0)
+        {
+            return;
+        }
+        m_words[wordIndex] &= ~bit;
+        m_count--;
+        const size_t blockIndex = wordIndex / m_blockWordCount;
+        const uint64_t* block = GetBlock(blockIndex);
+        if (std::all_of(block, block + m_blockWordCount, [](uint64_t word) { return word == 0; }))
+        {
+            m_summary[blockIndex >> 6] &= ~((uint64_t)1 << (blockIndex & 63));
+        }
+    }
+
+    inline void Clear()
+    {
+        m_words.clear();
+        m_summary.clear();
+        m_count = 0;
+    }
+
+    inline size_t Count() const { return m_count; }
+
+    inline size_t GetBlockCount() const { return m_words.size() / m_blockWordCount; }
+    inline size_t GetSummaryWordCount() const { return m_summary.size(); }
+    inline uint64_t GetSummaryWord(size_t index) const { return index < m_summary.size() ? m_summary[index] : 0; }
+    // m_blockWordCount words, contiguous (in one page)
+    inline const uint64_t* GetBlock(size_t blockIndex) const { return &m_words[blockIndex * m_blockWordCount]; }
+
+    // func(slot) for each slot in the set, in slot order
+    template <typename Func>
+    inline void ForEachSlot(Func&& func) const
+    {
+        for (size_t summaryIndex = 0; summaryIndex < m_summary.size(); summaryIndex++)
+        {
+            uint64_t blocks = m_summary[summaryIndex];
+            while (blocks != 0)
+            {
+                const size_t blockIndex = summaryIndex * 64 + (size_t)std::countr_zero(blocks);
+                BitsetOps::ForEachSetBit(GetBlock(blockIndex), m_blockWordCount, (uint32_t)(blockIndex * m_blockBitCount), func);
+                blocks &= blocks - 1;
+            }
+        }
+    }
+
+    inline size_t GetMemoryUsage() const { return m_words.GetMemoryUsage() + m_summary.GetMemoryUsage(); }
+
+private:
+    // pages don't move when growing, no need to grow ahead
+    void Grow(size_t minWordCount)
+    {
+        const size_t wordCount = (minWordCount + m_blockWordCount - 1) / m_blockWordCount * m_blockWordCount;
+        m_words.resize(wordCount, 0);
+        m_summary.resize((GetBlockCount() + 63) / 64, 0);
+    }
+
+    WordVector m_words;
+    WordVector m_summary;
+    size_t m_count = 0;
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+//
+#include "utils/GoodSave.h"
+#include "PagedVector.h"
+
+
+// Maps an entity id to its index in the dense arrays of a ComponentVector or TagVector.
+//
+// This is an open addressing hash table with linear probing, keys and indices side by side
+// in one flat array. A lookup is a multiply, a shift and (most of the time) one cache line.
+// No allocation per entry, no pointers, no tree walk. It replaces the map<GoodId, size_t> we
+// had before, which was a cache miss per level for every GetCompIfExists.
+//
+// Entity ids are mostly sequential numbers, so we use fibonacci hashing to spread them.
+// Removal uses backward shift deletion, so there are never tombstones to clean up.
+// ~0 is reserved as the empty key, never use it as an entity id.
+//
+// The slots are in a PagedVector, so copying the map (ComponentGrid::Snapshot) shares them,
+// and an insert after that only clones the page or two it touches.
+class EntityIndexMap
+{
+public:
+    static constexpr GoodId m_emptyKey = ~GoodId(0);
+    static constexpr uint32_t m_invalidIndex = ~uint32_t(0);
+
+    EntityIndexMap() = default;
+
+    // returns m_invalidIndex if the entity is not there
+    inline uint32_t Find(GoodId entityId) const
+    {
+        if (m_size == 0)
+        {
+            return m_invalidIndex;
+        }
+
+        size_t slotIndex = HashToSlot(entityId);
+        while (true)
+        {
+            const Slot& slot = m_slots[slotIndex];
+            if (slot.m_key == entityId)
+            {
+                return slot.m_index;
+            }
+            if (slot.m_key == m_emptyKey)
+            {
+                return m_invalidIndex;
+            }
+            slotIndex = (slotIndex + 1) & m_mask;
+        }
+    }
+
+    inline bool Contains(GoodId entityId) const
+    {
+        return Find(entityId) != m_invalidIndex;
+    }
+
+    // insert, or overwrite the index if the entity is already there
+    inline void Set(GoodId entityId, uint32_t index)
+    {
+        BOF_ASSERT_MSG(entityId != m_emptyKey, "entity id %llu is reserved", entityId);
+
+        if ((m_size + 1) * 2 > m_slots.size())
+        {
+            Rehash(m_slots.empty() ? m_minCapacity : m_slots.size() * 2);
+        }
+
+        size_t slotIndex = HashToSlot(entityId);
+        while (true)
+        {
+            Slot& slot = m_slots[slotIndex];
+            if (slot.m_key == entityId)
+            {
+                slot.m_index = index;
+                return;
+            }
+            if (slot.m_key == m_emptyKey)
+            {
+                slot.m_key = entityId;
+                slot.m_index = index;
+                m_size++;
+                return;
+            }
+            slotIndex = (slotIndex + 1) & m_mask;
+        }
+    }
+
+    // returns false if the entity was not there
+    inline bool Erase(GoodId entityId)
+    {
+        if (m_size == 0)
+        {
+            return false;
+        }
+
+        // reads go through the const view, so that shared pages are only cloned where we write
+        const PagedVector<Slot>& slots = m_slots;
+
+        size_t slotIndex = HashToSlot(entityId);
+        while (true)
+        {
+            if (slots[slotIndex].m_key == entityId)
+            {
+                break;
+            }
+            if (slots[slotIndex].m_key == m_emptyKey)
+            {
+                return false;
+            }
+            slotIndex = (slotIndex + 1) & m_mask;
+        }
+
+        // backward shift: pull back the following entries of the cluster that are allowed
+        // to live in the hole, so that lookups never stop too early.
+        size_t holeIndex = slotIndex;
+        size_t nextIndex = (holeIndex + 1) & m_mask;
+        while (slots[nextIndex].m_key != m_emptyKey)
+        {
+            const size_t idealIndex = HashToSlot(slots[nextIndex].m_key);
+            const size_t distanceFromIdealToHole = (holeIndex - idealIndex) & m_mask;
+            const size_t distanceFromIdealToNext = (nextIndex - idealIndex) & m_mask;
+            if (distanceFromIdealToHole < distanceFromIdealToNext)
+            {
+                m_slots[holeIndex] = slots[nextIndex];
+                holeIndex = nextIndex;
+            }
+            nextIndex = (nextIndex + 1) & m_mask;
+        }
+        m_slots[holeIndex] = Slot{};
+        m_size--;
+        return true;
+    }
+
+    inline void Clear()
+    {
+        m_slots.clear();
+        m_mask = 0;
+        m_shift = 64;
+        m_size = 0;
+    }
+
+    // make room for entityCount entries without rehashing
+    inline void Reserve(size_t entityCount)
+    {
+        size_t capacity = m_slots.empty() ? m_minCapacity : m_slots.size();
+        while (entityCount * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (capacity != m_slots.size())
+        {
+            Rehash(capacity);
+        }
+    }
+
+    inline size_t Size() const { return m_size; }
+
+    inline size_t GetMemoryUsage() const { return m_slots.GetMemoryUsage(); }
+
+    inline void SetPagePool(const std::shared_ptr<PagePool>& pagePool) { m_slots.SetPagePool(pagePool); }
+
+private:
+    struct Slot
+    {
+        GoodId m_key = m_emptyKey;
+        uint32_t m_index = m_invalidIndex;
+    };
+
+    static constexpr size_t m_minCapacity = 16;
+
+    inline size_t HashToSlot(GoodId entityId) const
+    {
+        // 2^64 / golden ratio. Keep the high bits, they are the well mixed ones.
+        return (size_t)((entityId * UINT64_C(11400714819323198485)) >> m_shift);
+    }
+
+    void Rehash(size_t newCapacity)
+    {
+        PagedVector<Slot> oldSlots = std::move(m_slots);
+
+        m_slots.clear();
+        m_slots.resize(newCapacity);
+        m_mask = newCapacity - 1;
+        m_shift = 64;
+        while (((size_t)1 << (64 - m_shift)) < newCapacity)
+        {
+            m_shift--;
+        }
+        m_size = 0;
+
+        for (const Slot& slot : std::as_const(oldSlots))
+        {
+            if (slot.m_key != m_emptyKey)
+            {
+                Set(slot.m_key, slot.m_index);
+            }
+        }
+    }
+
+    PagedVector<Slot> m_slots;
+    size_t m_mask = 0;
+    uint32_t m_shift = 64;
+    size_t m_size = 0;
+};
+
+
+
+// Maps an entity id to its index in the dense arrays, straight by entity slot.
+//
+// Ids made by EntityRegistry are a 32 bit slot (low bits) and a 32 bit generation (high bits).
+// The slot indexes a flat table: no hashing, no probing, one load. The generation stored next to
+// the index tells the entity living in the slot from a stale id of a previous one.
+//
+// Ids that don't fit the table (slot too big, or slot already used by another generation, which
+// legacy GoodIds can do) go to an EntityIndexMap on the side. So any GoodId still works, only slower.
+// The table grows up to the biggest slot seen, 8 bytes per slot. It's paged like the rest.
+class EntitySlotMap
+{
+public:
+    static constexpr uint32_t m_invalidIndex = EntityIndexMap::m_invalidIndex;
+    static constexpr uint32_t m_maxTableSlot = 1 << 22;
+
+    EntitySlotMap() = default;
+
+    // returns m_invalidIndex if the entity is not there
+    inline uint32_t Find(GoodId entityId) const
+    {
+        const uint32_t slot = (uint32_t)entityId;
+        if (slot < m_table.size())
+        {
+            const Entry& entry = m_table[slot];
+            if (entry.m_index != m_invalidIndex && entry.m_generation == (uint32_t)(entityId >> 32))
+            {
+                return entry.m_index;
+            }
+        }
+        return m_overflow.Size() == 0 ? m_invalidIndex : m_overflow.Find(entityId);
+    }
+
+    inline bool Contains(GoodId entityId) const
+    {
+        return Find(entityId) != m_invalidIndex;
+    }
+
+    // true if the entity is there, in the table (not in the overflow): it's the one entity of its slot
+    inline bool IsInTable(GoodId entityId) const
+    {
+        const uint32_t slot = (uint32_t)entityId;
+        if (slot >= m_table.size())
+        {
+            return false;
+        }
+        const Entry& entry = m_table[slot];
+        return entry.m_index != m_invalidIndex && entry.m_generation == (uint32_t)(entityId >> 32);
+    }
+
+    // the index of the entity of the slot in the table, whatever its generation. m_invalidIndex if none.
+    inline uint32_t FindBySlot(uint32_t slot) const
+    {
+        return slot < m_table.size() ? m_table[slot].m_index : m_invalidIndex;
+    }
+
+    // insert, or overwrite the index if the entity is already there
+    inline void Set(GoodId entityId, uint32_t index)
+    {
+        const uint32_t slot = (uint32_t)entityId;
+        const uint32_t generation = (uint32_t)(entityId >> 32);
+        if (slot < m_table.size())
+        {
+            const Entry& entry = std::as_const(m_table)[slot];
+            if (entry.m_index != m_invalidIndex && entry.m_generation == generation)
+            {
+                m_table[slot].m_index = index;
+                return;
+            }
+        }
+        // it may have landed there while its slot was taken
+        if (m_overflow.Size() != 0 && m_overflow.Contains(entityId))
+        {
+            m_overflow.Set(entityId, index);
+            return;
+        }
+        if (slot < m_maxTableSlot)
+        {
+            if (slot >= m_table.size())
+            {
+                m_table.resize(std::max<size_t>(slot + 1, m_table.size() + m_table.size() / 2));
+            }
+            if (std::as_const(m_table)[slot].m_index == m_invalidIndex)
+            {
+                m_table[slot] = Entry{ index, generation };
+                m_tableSize++;
+                return;
+            }
+        }
+        m_overflow.Set(entityId, index);
+    }
+
+    // returns false if the entity was not there
+    inline bool Erase(GoodId entityId)
+    {
+        const uint32_t slot = (uint32_t)entityId;
+        if (slot < m_table.size())
+        {
+            const Entry& entry = std::as_const(m_table)[slot];
+            if (entry.m_index != m_invalidIndex && entry.m_generation == (uint32_t)(entityId >> 32))
+            {
+                m_table[slot] = Entry{};
+                m_tableSize--;
+                return true;
+            }
+        }
+        return m_overflow.Size() != 0 && m_overflow.Erase(entityId);
+    }
+
+    inline void Clear()
+    {
+        m_table.clear();
+        m_tableSize = 0;
+        m_overflow.Clear();
+    }
+
+    // the table size depends on the slots, not on the count. This only makes room for the page pointers.
+    inline void Reserve(size_t entityCount)
+    {
+        m_table.reserve(entityCount);
+    }
+
+    // grows the table once to hold slots up to slotCount - 1, before setting a lot of entities
+    inline void ReserveSlots(size_t slotCount)
+    {
+        slotCount = std::min<size_t>(slotCount, m_maxTableSlot);
+        if (slotCount > m_table.size())
+        {
+            m_table.resize(slotCount);
+        }
+    }
+
+    inline size_t Size() const { return m_tableSize + m_overflow.Size(); }
+
+    // entities that didn't fit the table
+    inline size_t GetOverflowSize() const { return m_overflow.Size(); }
+
+    inline size_t GetMemoryUsage() const { return m_table.GetMemoryUsage() + m_overflow.GetMemoryUsage(); }
+
+    inline void SetPagePool(const std::shared_ptr<PagePool>& pagePool)
+    {
+        m_table.SetPagePool(pagePool);
+        m_overflow.SetPagePool(pagePool);
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t m_index = m_invalidIndex;
+        uint32_t m_generation = 0;
+    };
+
+    PagedVector<Entry> m_table;
+    size_t m_tableSize = 0;
+    EntityIndexMap m_overflow;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+//
+#include "utils/GoodSave.h"
+#include "utils/BofAsserts.h"
+#include "EntityIndex.h"
+#include "PagedVector.h"
+
+
+// Makes the entity ids of a ComponentGrid (grid.CreateEntity()).
+//
+// An id is still a GoodId, so everything keyed by GoodId keeps working, but it's made of a 32 bit slot
+// (low bits) and a generation (high bits). Slots are dense, from 0, so the comp storage (EntitySlotMap)
+// indexes its tables by slot directly.
+//
+// Destroying an entity bumps the generation of its slot and puts the slot in the free list, the next
+// CreateEntity reuses it with the new generation. An id kept after its entity died doesn't alias the new
+// one: IsAlive is false for it, and the comp vectors don't find it.
+//
+// Generations start at 1, so 0 is never an entity id made here: it's the "no entity" of ParentComp::m_parentId
+// and others. RebuildFromEntityIds doesn't keep it either.
+// Don't mix ids made here with ids made elsewhere (counters) in the same grid, they would collide.
+// Grids filled with such ids, like the ones saved before the registry existed, go through
+// ComponentGrid::RebuildEntityRegistry when they are loaded.
+class EntityRegistry : public GoodSerializable
+{
+public:
+    static inline GoodId MakeEntityId(uint32_t slot, uint32_t generation) { return ((GoodId)generation << 32) | slot; }
+    static inline uint32_t GetSlot(GoodId entityId) { return (uint32_t)entityId; }
+    static inline uint32_t GetGeneration(GoodId entityId) { return (uint32_t)(entityId >> 32); }
+
+    inline GoodId CreateEntity()
+    {
+        uint32_t slot;
+        if (!m_freeSlots.empty())
+        {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            slot = (uint32_t)m_slots.size();
+            m_slots.push_back(m_freeBit | 1);
+        }
+        const uint32_t generation = std::as_const(m_slots)[slot] & ~m_freeBit;
+        m_slots[slot] = generation;
+        m_aliveCount++;
+        return MakeEntityId(slot, generation);
+    }
+
+    // count new ids at the end of outEntityIds: the free slots first, then new slots added in one go
+    inline void CreateEntities(size_t count, std::vector<GoodId>& outEntityIds)
+    {
+        outEntityIds.reserve(outEntityIds.size() + count);
+        while (count > 0 && !m_freeSlots.empty())
+        {
+            outEntityIds.push_back(CreateEntity());
+            count--;
+        }
+        const uint32_t firstSlot = (uint32_t)m_slots.size();
+        m_slots.resize(m_slots.size() + count, 1);
+        for (uint32_t i = 0; i < (uint32_t)count; i++)
+        {
+            outEntityIds.push_back(MakeEntityId(firstSlot + i, 1));
+        }
+        m_aliveCount += (uint32_t)count;
+    }
+
+    // returns false if the entity was already dead (or never made here)
+    inline bool DestroyEntity(GoodId entityId)
+    {
+        if (!IsAlive(entityId))
+        {
+            return false;
+        }
+        const uint32_t slot = GetSlot(entityId);
+        uint32_t nextGeneration = (GetGeneration(entityId) + 1) & ~m_freeBit;
+        if (nextGeneration == 0)
+        {
+            nextGeneration = 1;
+        }
+        m_slots[slot] = nextGeneration | m_freeBit;
+        m_freeSlots.push_back(slot);
+        m_aliveCount--;
+        return true;
+    }
+
+    inline bool IsAlive(GoodId entityId) const
+    {
+        const uint32_t slot = GetSlot(entityId);
+        return slot < m_slots.size() && m_slots[slot] == GetGeneration(entityId);
+    }
+
+    inline size_t GetAliveCount() const { return m_aliveCount; }
+    inline size_t GetSlotCount() const { return m_slots.size(); }
+    inline size_t GetMemoryUsage() const { return m_slots.GetMemoryUsage() + m_freeSlots.GetMemoryUsage(); }
+
+    inline void Clear()
+    {
+        m_slots.clear();
+        m_freeSlots.clear();
+        m_aliveCount = 0;
+    }
+
+    // The translation from ids made elsewhere. Starts over with entityIds alive (duplicates are fine).
+    // An id is kept as is when its slot is free and small enough for the slot tables, and its generation
+    // fits. Small counters (generation 0) are kept too, but not 0. The others get a new id, written in
+    // outRemap (old id -> new id).
+    void RebuildFromEntityIds(std::span<const GoodId> entityIds, std::unordered_map<GoodId, GoodId>& outRemap)
+    {
+        Clear();
+        outRemap.clear();
+
+        std::vector<GoodId> idsToRemap;
+        for (GoodId entityId : entityIds)
+        {
+            const uint32_t slot = GetSlot(entityId);
+            const uint32_t generation = GetGeneration(entityId);
+            if (entityId == 0 || (generation & m_freeBit) != 0 || slot >= EntitySlotMap::m_maxTableSlot)
+            {
+                idsToRemap.push_back(entityId);
+                continue;
+            }
+            while (m_slots.size() <= slot)
+            {
+                m_slots.push_back(m_freeBit | 1);
+            }
+            const uint32_t state = std::as_const(m_slots)[slot];
+            if (state == generation)
+            {
+                continue; // already seen in another vector
+            }
+            if ((state & m_freeBit) == 0)
+            {
+                idsToRemap.push_back(entityId); // the slot is taken by another generation
+                continue;
+            }
+            m_slots[slot] = generation;
+            m_aliveCount++;
+        }
+
+        // backwards, so that the small slots get reused first
+        for (uint32_t slot = (uint32_t)m_slots.size(); slot > 0; slot--)
+        {
+            if ((std::as_const(m_slots)[slot - 1] & m_freeBit) != 0)
+            {
+                m_freeSlots.push_back(slot - 1);
+            }
+        }
+
+        for (GoodId entityId : idsToRemap)
+        {
+            if (!outRemap.contains(entityId))
+            {
+                outRemap[entityId] = CreateEntity();
+            }
+        }
+    }
+
+    // see GoodHelpers::WriteDelta: the slots that changed state, and the end of the free list that changed
+    pods::Error WriteDelta(const EntityRegistry& base, pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer) const
+    {
+        std::vector<uint32_t> changedSlots;
+        std::vector<uint32_t> changedStates;
+        for (size_t slot = 0; slot < m_slots.size(); slot++)
+        {
+            const uint32_t& state = m_slots[slot];
+            if (slot >= base.m_slots.size() || (&state != &base.m_slots[slot] && state != base.m_slots[slot]))
+            {
+                changedSlots.push_back((uint32_t)slot);
+                changedStates.push_back(state);
+            }
+        }
+
+        // the free list is a stack, usually only its top moves
+        uint32_t keptFreeSlotCount = 0;
+        const size_t maxKeptCount = std::min(m_freeSlots.size(), base.m_freeSlots.size());
+        while (keptFreeSlotCount < maxKeptCount && m_freeSlots[keptFreeSlotCount] == base.m_freeSlots[keptFreeSlotCount])
+        {
+            keptFreeSlotCount++;
+        }
+        std::vector<uint32_t> newFreeSlots;
+        for (size_t i = keptFreeSlotCount; i < m_freeSlots.size(); i++)
+        {
+            newFreeSlots.push_back(m_freeSlots[i]);
+        }
+
+        const uint32_t slotCount = (uint32_t)m_slots.size();
+        return serializer(GOOD(slotCount), GOOD(changedSlots), GOOD(changedStates),
+            GOOD(keptFreeSlotCount), GOOD(newFreeSlots), GOOD(m_aliveCount));
+    }
+
+    pods::Error ApplyDelta(pods::BinaryDeserializer<pods::InputBuffer>& deserializer)
+    {
+        uint32_t slotCount = 0;
+        std::vector<uint32_t> changedSlots;
+        std::vector<uint32_t> changedStates;
+        uint32_t keptFreeSlotCount = 0;
+        std::vector<uint32_t> newFreeSlots;
+        PODS_SAFE_CALL(deserializer(GOOD(slotCount), GOOD(changedSlots), GOOD(changedStates),
+            GOOD(keptFreeSlotCount), GOOD(newFreeSlots), GOOD(m_aliveCount)));
+        if (changedSlots.size() != changedStates.size() || keptFreeSlotCount > m_freeSlots.size())
+        {
+            return pods::Error::CorruptedArchive;
+        }
+
+        m_slots.resize(slotCount);
+        for (size_t i = 0; i < changedSlots.size(); i++)
+        {
+            if (changedSlots[i] >= slotCount)
+            {
+                return pods::Error::CorruptedArchive;
+            }
+            m_slots[changedSlots[i]] = changedStates[i];
+        }
+        m_freeSlots.resize(keptFreeSlotCount);
+        for (uint32_t slot : newFreeSlots)
+        {
+            m_freeSlots.push_back(slot);
+        }
+        return pods::Error::NoError;
+    }
+
+    GOOD_SERIALIZABLE(EntityRegistry, GOOD_VERSION(1)
+        , GOOD(m_slots)
+        , GOOD(m_freeSlots)
+        , GOOD(m_aliveCount)
+    );
+
+private:
+    // the generation of the entity in the slot, or of the next one with m_freeBit when the slot is free
+    static constexpr uint32_t m_freeBit = 1u << 31;
+
+    PagedVector<uint32_t> m_slots;
+    PagedVector<uint32_t> m_freeSlots;
+    uint32_t m_aliveCount = 0;
+};
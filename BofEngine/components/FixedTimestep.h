@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+//
+#include "Simulation.h"
+#include "TransformHierarchy.h"
+#include "utils/Timer.h"
+
+using namespace std;
+
+
+struct FixedTimestepStats
+{
+    uint64_t m_frameCount = 0;
+    uint64_t m_tickCount = 0;
+    int m_maxTicksInAFrame = 0;
+    // ticks given up because the simulation couldn't keep up (see m_maxTicksPerFrame)
+    uint64_t m_droppedTickCount = 0;
+};
+
+
+// Runs a Simulation at a fixed rate, whatever the frame rate.
+//
+//  FixedTimestep fixedTimestep(simulation, 60);
+//  while (running)
+//  {
+//      fixedTimestep.Advance(); // 0, 1 or a few Simulation::Update
+//      fixedTimestep.ForEachInterpolated<LocalTransformComp>([](GoodId entityId, const LocalTransformComp& previous, const LocalTransformComp& current, float alpha)
+//      {
+//          const glm::mat4 model = Interpolate(previous, current, alpha).GetMatrix();
+//      });
+//      draw();
+//  }
+//
+// The real time since the last Advance goes in an accumulator, and a tick is taken out of it for each Update.
+// What is left is how far the render is between the last two states: GetAlpha. So the render shows the
+// state one tick late, but smoothly at any frame rate, and the simulation stays deterministic.
+// The previous state is the snapshot Simulation keeps for rollback, it must have a tick function.
+//
+// When the ticks cost more than the time they simulate, catching up makes the next frame longer, which needs
+// more ticks... At most m_maxTicksPerFrame are done in a frame and the rest of the time is dropped: the simulation
+// runs slower than real time, but the frames keep coming.
+class FixedTimestep
+{
+public:
+    FixedTimestep(Simulation& simulation, int ticksPerSecond = 60, int maxTicksPerFrame = 4)
+        : m_simulation(simulation)
+    {
+        SetTicksPerSecond(ticksPerSecond);
+        SetMaxTicksPerFrame(maxTicksPerFrame);
+    }
+
+    void SetTicksPerSecond(int ticksPerSecond)
+    {
+        BOF_ASSERT_MSG(ticksPerSecond > 0, "%d ticks per second", ticksPerSecond);
+        m_tickSeconds = 1.0 / ticksPerSecond;
+    }
+    double GetTickSeconds() const { return m_tickSeconds; }
+
+    void SetMaxTicksPerFrame(int maxTicksPerFrame)
+    {
+        BOF_ASSERT_MSG(maxTicksPerFrame > 0, "%d ticks per frame", maxTicksPerFrame);
+        m_maxTicksPerFrame = maxTicksPerFrame;
+    }
+
+    // with the time since the last call, the number of ticks done
+    int Advance()
+    {
+        const int64_t nowNano = m_clock.GetTimeNano();
+        const double elapsedSecs = m_isFirstAdvance ? 0.0 : (nowNano - m_lastAdvanceNano) / 1e9;
+        m_lastAdvanceNano = nowNano;
+        m_isFirstAdvance = false;
+        return Advance(elapsedSecs);
+    }
+
+    // with a given time, for tests or a replay
+    int Advance(double elapsedSecs)
+    {
+        m_accumulatedSecs += std::max(0.0, elapsedSecs);
+
+        int tickCount = 0;
+        while (m_accumulatedSecs >= m_tickSeconds && tickCount < m_maxTicksPerFrame)
+        {
+            m_simulation.Update();
+            m_accumulatedSecs -= m_tickSeconds;
+            tickCount++;
+        }
+        if (m_accumulatedSecs >= m_tickSeconds)
+        {
+            const uint64_t droppedTickCount = (uint64_t)(m_accumulatedSecs / m_tickSeconds);
+            m_accumulatedSecs -= droppedTickCount * m_tickSeconds;
+            m_stats.m_droppedTickCount += droppedTickCount;
+        }
+
+        m_lastTickCount = tickCount;
+        m_stats.m_frameCount++;
+        m_stats.m_tickCount += tickCount;
+        m_stats.m_maxTicksInAFrame = std::max(m_stats.m_maxTicksInAFrame, tickCount);
+        return tickCount;
+    }
+
+    // 0 is the previous state, 1 the current one
+    float GetAlpha() const { return (float)std::clamp(m_accumulatedSecs / m_tickSeconds, 0.0, 1.0); }
+
+    // how long until the accumulator has a tick, to sleep that long when running on its own thread
+    double GetSecondsUntilNextTick() const { return std::max(0.0, m_tickSeconds - m_accumulatedSecs); }
+
+    int GetLastTickCount() const { return m_lastTickCount; }
+    const FixedTimestepStats& GetStats() const { return m_stats; }
+
+    // func(entityId, previous, current, alpha) for each comp of the current state.
+    // An entity that wasn't there in the previous state gets its current comp as previous.
+    template <class CompType, class Func>
+    void ForEachInterpolated(Func&& func) const
+    {
+        const ComponentVector<CompType>* currentComps = m_simulation.GetState().m_state.GetConstComps<CompType>();
+        if (currentComps == nullptr)
+        {
+            return;
+        }
+        const ComponentGrid* previousState = m_simulation.GetPreviousState();
+        const ComponentVector<CompType>* previousComps = previousState ? previousState->GetConstComps<CompType>() : nullptr;
+        const float alpha = GetAlpha();
+
+        for (size_t i = 0; i < currentComps->Size(); i++)
+        {
+            const GoodId entityId = currentComps->m_entities[i];
+            const CompType& current = currentComps->GetCompAtIndex(i);
+            const CompType* previous = nullptr;
+            if (previousComps != nullptr)
+            {
+                // mostly nothing moved in the vector during the tick
+                previous = (i < previousComps->Size() && previousComps->m_entities[i] == entityId)
+                    ? &previousComps->GetCompAtIndex(i)
+                    : previousComps->GetCompIfExists(entityId);
+            }
+            func(entityId, previous ? *previous : current, current, alpha);
+        }
+    }
+
+private:
+    Simulation& m_simulation;
+
+    double m_tickSeconds = 1.0 / 60.0;
+    int m_maxTicksPerFrame = 4;
+
+    Bof::SimpleClock m_clock;
+    int64_t m_lastAdvanceNano = 0;
+    bool m_isFirstAdvance = true;
+    double m_accumulatedSecs = 0.0;
+
+    int m_lastTickCount = 0;
+    FixedTimestepStats m_stats;
+};
+
+
+inline LocalTransformComp Interpolate(const LocalTransformComp& previous, const LocalTransformComp& current, float alpha)
+{
+    LocalTransformComp result;
+    result.m_translation = glm::mix(previous.m_translation, current.m_translation, alpha);
+    result.m_rotation = glm::slerp(previous.m_rotation, current.m_rotation, alpha);
+    result.m_scale = glm::mix(previous.m_scale, current.m_scale, alpha);
+    return result;
+}
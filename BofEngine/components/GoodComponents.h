@@ -1,17 +1,59 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <span>
+#include <memory>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <numeric>
+#include <algorithm>
 //
 #include "utils/GoodSave.h"
 #include "magic_enum/magic_enum.h"
+#include "EntityIndex.h"
+#include "EntityRegistry.h"
+#include "EntityBitset.h"
+#include "PagedVector.h"
+#include "CompTypeIndex.h"
+#include "utils/JobSystem.h"
 
 
 
 using namespace std;
 
 
+// the slot table size that fits all those entities (EntitySlotMap::ReserveSlots)
+inline size_t GetSlotCountFor(span<const GoodId> entityIds)
+{
+    uint32_t maxSlot = 0;
+    for (GoodId entityId : entityIds)
+    {
+        maxSlot = std::max(maxSlot, EntityRegistry::GetSlot(entityId));
+    }
+    return entityIds.empty() ? 0 : (size_t)maxSlot + 1;
+}
+
+// old id -> new id, in the entities of a vector and in its index
+inline void RemapEntityIdsInVector(PagedVector<GoodId>& entities, EntitySlotMap& entityToIndex, const unordered_map<GoodId, GoodId>& remap)
+{
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        auto it = remap.find(std::as_const(entities)[i]);
+        if (it != remap.end())
+        {
+            entityToIndex.Erase(it->first);
+            entities[i] = it->second;
+            entityToIndex.Set(it->second, (uint32_t)i);
+        }
+    }
+}
+
+
+
 // this is actually a NoDataComponentVector:
 // For each possible tag, a TagVector contains the entities having this tag
 // A tag is just a number, and entity is just a number
@@ -19,24 +61,113 @@ class TagVector : public GoodSerializable
 {
 public:
     
-    vector<GoodId> m_entities;
+    PagedVector<GoodId> m_entities;
 
     // the location in entity for each entityId in m_entities
-    map<GoodId, size_t> m_entityToIndex;
+    EntitySlotMap m_entityToIndex;
+
+    // the slots of the entities, for TagQuery. Only the ones in the slot table of m_entityToIndex,
+    // the overflow ones can share a slot. Not serialized, rebuilt from m_entities.
+    EntityBitset m_slotBits;
 
     inline void AddEntityId(GoodId entityId)
     {
         // todo: check if already here
-        m_entityToIndex[entityId] = m_entities.size();
+        m_entityToIndex.Set(entityId, (uint32_t)m_entities.size());
         m_entities.push_back(entityId);
+        SetSlotBitIfInTable(entityId);
     }
 
     inline bool HasCompForEntity(const GoodId& entityId) const
     {
-        return m_entityToIndex.find(entityId) != m_entityToIndex.end();
+        return m_entityToIndex.Contains(entityId);
+    }
+
+    // see ComponentVector::AddEntityIds
+    inline void AddEntityIds(span<const GoodId> entityIds)
+    {
+        m_entityToIndex.ReserveSlots(GetSlotCountFor(entityIds));
+        for (size_t i = 0; i < entityIds.size(); i++)
+        {
+            m_entityToIndex.Set(entityIds[i], (uint32_t)(m_entities.size() + i));
+            SetSlotBitIfInTable(entityIds[i]);
+        }
+        m_entities.append(entityIds.begin(), entityIds.end());
+    }
+
+    // swap and pop, the order of m_entities is not kept.
+    // returns false if the entity didn't have this tag
+    inline bool RemoveEntityId(GoodId entityId)
+    {
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index == EntitySlotMap::m_invalidIndex)
+        {
+            return false;
+        }
+        EraseFromIndex(entityId);
+
+        const uint32_t lastIndex = (uint32_t)m_entities.size() - 1;
+        if (index != lastIndex)
+        {
+            m_entities[index] = m_entities[lastIndex];
+            m_entityToIndex.Set(m_entities[index], index);
+        }
+        m_entities.pop_back();
+        return true;
+    }
+
+    // same as ComponentVector::RemoveEntityIds
+    inline size_t RemoveEntityIds(span<const GoodId> entityIds)
+    {
+        if (entityIds.size() * m_batchCompactionDivisor < m_entities.size())
+        {
+            size_t removedCount = 0;
+            for (GoodId entityId : entityIds)
+            {
+                removedCount += RemoveEntityId(entityId) ? 1 : 0;
+            }
+            return removedCount;
+        }
+
+        vector<uint8_t> isDead(m_entities.size(), 0);
+        size_t removedCount = 0;
+        for (GoodId entityId : entityIds)
+        {
+            const uint32_t index = m_entityToIndex.Find(entityId);
+            if (index != EntitySlotMap::m_invalidIndex)
+            {
+                EraseFromIndex(entityId);
+                isDead[index] = 1;
+                removedCount++;
+            }
+        }
+
+        uint32_t writeIndex = 0;
+        for (uint32_t readIndex = 0; readIndex < (uint32_t)m_entities.size(); readIndex++)
+        {
+            if (isDead[readIndex])
+            {
+                continue;
+            }
+            if (writeIndex != readIndex)
+            {
+                m_entities[writeIndex] = m_entities[readIndex];
+                m_entityToIndex.Set(m_entities[writeIndex], writeIndex);
+            }
+            writeIndex++;
+        }
+        m_entities.resize(writeIndex);
+        return removedCount;
     }
 
-    inline const vector<GoodId> GetEntities() const { return m_entities; }
+    inline const vector<GoodId> GetEntities() const { return vector<GoodId>(m_entities.begin(), m_entities.end()); }
+
+    // see ComponentGrid::RebuildEntityRegistry
+    inline void RemapEntityIds(const unordered_map<GoodId, GoodId>& remap)
+    {
+        RemapEntityIdsInVector(m_entities, m_entityToIndex, remap);
+        RebuildSlotBits();
+    }
 
     GOOD_SERIALIZABLE(
         TagVector, GOOD_VERSION(1)
@@ -45,22 +176,294 @@ public:
 
     inline void PostDeserialize()
     {
-        m_entityToIndex.clear();
+        m_entityToIndex.Clear();
+        m_entityToIndex.Reserve(m_entities.size());
 
         for (size_t i = 0; i < m_entities.size(); i++)
         {
-            m_entityToIndex[m_entities[i]] = i;
+            m_entityToIndex.Set(m_entities[i], (uint32_t)i);
         }
+        RebuildSlotBits();
     }
 
     inline size_t Size() const { return m_entities.size(); }
 
     GoodId operator[](size_t i) const { return m_entities[i]; }
 
+    inline size_t GetMemoryUsage() const { return m_entities.GetMemoryUsage() + m_entityToIndex.GetMemoryUsage() + m_slotBits.GetMemoryUsage(); }
+
+    // the entity of this tag in that slot (see m_slotBits), 0 if none
+    inline GoodId GetEntityIdAtSlot(uint32_t slot) const
+    {
+        const uint32_t index = m_entityToIndex.FindBySlot(slot);
+        return index != EntitySlotMap::m_invalidIndex ? m_entities[index] : 0;
+    }
+
+    // batch removals killing more than 1/m_batchCompactionDivisor of the vector compact it in one pass instead
+    static constexpr size_t m_batchCompactionDivisor = 8;
+
+private:
+    inline void SetSlotBitIfInTable(GoodId entityId)
+    {
+        if (m_entityToIndex.IsInTable(entityId))
+        {
+            m_slotBits.Set(EntityRegistry::GetSlot(entityId));
+        }
+    }
+
+    inline void EraseFromIndex(GoodId entityId)
+    {
+        if (m_entityToIndex.IsInTable(entityId))
+        {
+            m_slotBits.Reset(EntityRegistry::GetSlot(entityId));
+        }
+        m_entityToIndex.Erase(entityId);
+    }
+
+    inline void RebuildSlotBits()
+    {
+        m_slotBits.Clear();
+        for (GoodId entityId : std::as_const(m_entities))
+        {
+            SetSlotBitIfInTable(entityId);
+        }
+    }
 };
 
 
 
+// Set algebra on tags, on their slot bitsets (see EntityBitset), without allocating:
+//
+// TagQuery query = TagQuery(grid.GetTags(enemyTag)).And(grid.GetTags(visibleTag)).AndNot(grid.GetTags(deadTag));
+// const size_t visibleEnemyCount = query.Count();
+// query.ForEach([](GoodId entityId) {...});
+// grid.View<PositionComp>().WithTags(query).ForEach(...);
+//
+// The tags are combined from left to right, a block of 512 slots at a time, and the empty blocks are skipped.
+// The query only points to the tags: keep them alive, and don't change them while it's used.
+// Entities are found by slot, so ids that went to the overflow of the slot map (legacy ids sharing a slot
+// with another one) are not seen. Ids made by the EntityRegistry of the grid always are.
+class TagQuery
+{
+public:
+    static constexpr size_t m_maxTermCount = 8;
+
+    explicit TagQuery(const TagVector& tags)
+    {
+        AddTerm(tags, Op::First);
+    }
+
+    inline TagQuery& And(const TagVector& tags) { return AddTerm(tags, Op::And); }
+    inline TagQuery& Or(const TagVector& tags) { return AddTerm(tags, Op::Or); }
+    inline TagQuery& AndNot(const TagVector& tags) { return AddTerm(tags, Op::AndNot); }
+
+    inline bool Contains(GoodId entityId) const
+    {
+        return ContainsSlot(EntityRegistry::GetSlot(entityId));
+    }
+
+    inline bool ContainsSlot(uint32_t slot) const
+    {
+        bool isIn = m_tags[0]->m_slotBits.Test(slot);
+        for (size_t t = 1; t < m_termCount; t++)
+        {
+            const bool isInTerm = m_tags[t]->m_slotBits.Test(slot);
+            switch (m_ops[t])
+            {
+            case Op::And: isIn = isIn && isInTerm; break;
+            case Op::Or: isIn = isIn || isInTerm; break;
+            case Op::AndNot: isIn = isIn && !isInTerm; break;
+            case Op::First: break;
+            }
+        }
+        return isIn;
+    }
+
+    inline size_t Count() const
+    {
+        size_t count = 0;
+        ForEachBlock([&count](size_t, const uint64_t* words)
+        {
+            count += BitsetOps::PopCount(words, EntityBitset::m_blockWordCount);
+        });
+        return count;
+    }
+
+    // func(uint32_t slot), in slot order
+    template <typename Func>
+    inline void ForEachSlot(Func&& func) const
+    {
+        ForEachBlock([&func](size_t blockIndex, const uint64_t* words)
+        {
+            BitsetOps::ForEachSetBit(words, EntityBitset::m_blockWordCount, (uint32_t)(blockIndex * EntityBitset::m_blockBitCount), func);
+        });
+    }
+
+    // func(GoodId entityId), in slot order
+    template <typename Func>
+    inline void ForEach(Func&& func) const
+    {
+        ForEachSlot([this, &func](uint32_t slot)
+        {
+            func(GetEntityIdAtSlot(slot));
+        });
+    }
+
+private:
+    enum class Op : uint8_t
+    {
+        First,
+        And,
+        Or,
+        AndNot,
+    };
+
+    inline TagQuery& AddTerm(const TagVector& tags, Op op)
+    {
+        BOF_ASSERT_MSG(m_termCount < m_maxTermCount, "more than %i tags in a TagQuery", (int)m_maxTermCount);
+        m_tags[m_termCount] = &tags;
+        m_ops[m_termCount] = op;
+        m_termCount++;
+        m_hasOr |= op == Op::Or;
+        return *this;
+    }
+
+    // func(blockIndex, words) with the m_blockWordCount words of the result, for the blocks that may have something
+    template <typename Func>
+    inline void ForEachBlock(Func&& func) const
+    {
+        size_t summaryWordCount = 0;
+        for (size_t t = 0; t < m_termCount; t++)
+        {
+            summaryWordCount = std::max(summaryWordCount, m_tags[t]->m_slotBits.GetSummaryWordCount());
+        }
+
+        alignas(16) uint64_t words[EntityBitset::m_blockWordCount];
+        for (size_t summaryIndex = 0; summaryIndex < summaryWordCount; summaryIndex++)
+        {
+            // the blocks that can't be empty. An and-not can't add anything, nor tell a block is empty.
+            uint64_t blocks = m_tags[0]->m_slotBits.GetSummaryWord(summaryIndex);
+            for (size_t t = 1; t < m_termCount; t++)
+            {
+                if (m_ops[t] == Op::And)
+                {
+                    blocks &= m_tags[t]->m_slotBits.GetSummaryWord(summaryIndex);
+                }
+                else if (m_ops[t] == Op::Or)
+                {
+                    blocks |= m_tags[t]->m_slotBits.GetSummaryWord(summaryIndex);
+                }
+            }
+
+            while (blocks != 0)
+            {
+                const size_t blockIndex = summaryIndex * 64 + (size_t)std::countr_zero(blocks);
+                blocks &= blocks - 1;
+
+                CopyBlock(m_tags[0]->m_slotBits, blockIndex, words);
+                for (size_t t = 1; t < m_termCount; t++)
+                {
+                    const EntityBitset& bits = m_tags[t]->m_slotBits;
+                    if (blockIndex >= bits.GetBlockCount())
+                    {
+                        if (m_ops[t] == Op::And)
+                        {
+                            std::fill(std::begin(words), std::end(words), 0);
+                        }
+                        continue;
+                    }
+                    switch (m_ops[t])
+                    {
+                    case Op::And: BitsetOps::And(words, bits.GetBlock(blockIndex), EntityBitset::m_blockWordCount); break;
+                    case Op::Or: BitsetOps::Or(words, bits.GetBlock(blockIndex), EntityBitset::m_blockWordCount); break;
+                    case Op::AndNot: BitsetOps::AndNot(words, bits.GetBlock(blockIndex), EntityBitset::m_blockWordCount); break;
+                    case Op::First: break;
+                    }
+                }
+                func(blockIndex, (const uint64_t*)words);
+            }
+        }
+    }
+
+    static inline void CopyBlock(const EntityBitset& bits, size_t blockIndex, uint64_t* outWords)
+    {
+        if (blockIndex < bits.GetBlockCount())
+        {
+            std::copy_n(bits.GetBlock(blockIndex), EntityBitset::m_blockWordCount, outWords);
+        }
+        else
+        {
+            std::fill_n(outWords, EntityBitset::m_blockWordCount, 0);
+        }
+    }
+
+    // with an Or, the slot may only be in one of the later tags
+    inline GoodId GetEntityIdAtSlot(uint32_t slot) const
+    {
+        if (!m_hasOr)
+        {
+            return m_tags[0]->GetEntityIdAtSlot(slot);
+        }
+        for (size_t t = 0; t < m_termCount; t++)
+        {
+            if (m_tags[t]->m_slotBits.Test(slot))
+            {
+                return m_tags[t]->GetEntityIdAtSlot(slot);
+            }
+        }
+        return 0;
+    }
+
+    std::array<const TagVector*, m_maxTermCount> m_tags = {};
+    std::array<Op, m_maxTermCount> m_ops = {};
+    size_t m_termCount = 0;
+    bool m_hasOr = false;
+};
+
+
+
+// the entities of from that are not in to (TagVectors or ComponentVectors), for the deltas.
+// Entities mostly stay at the same index from a tick to the next, that's checked before the lookup.
+template <class FromVector, class ToVector>
+inline void CollectMissingEntities(const FromVector& from, const ToVector& to, vector<GoodId>& outEntities)
+{
+    for (size_t i = 0; i < from.m_entities.size(); i++)
+    {
+        const GoodId entityId = from.m_entities[i];
+        const bool isAtSameIndex = i < to.m_entities.size() && to.m_entities[i] == entityId;
+        if (!isAtSameIndex && !to.HasCompForEntity(entityId))
+        {
+            outEntities.push_back(entityId);
+        }
+    }
+}
+
+
+
+// where an incremental reorder of one comp vector is at, see ComponentVector::ReorderStep
+struct VectorReorderCursor
+{
+    size_t m_orderIndex = 0;
+    uint32_t m_writeIndex = 0;
+};
+
+// the memory of one comp vector, see ComponentGrid::GetMemoryStats
+struct CompMemoryStats
+{
+    GoodId m_compClassId = 0;
+    const char* m_compClassName = "";
+    size_t m_count = 0;
+    size_t m_usedBytes = 0; // the live comps, with their entity ids and change ticks
+    size_t m_reservedBytes = 0; // the pages holding them
+    size_t m_indexBytes = 0; // the entity -> index map
+    size_t m_pageCount = 0;
+    size_t m_sharedPageCount = 0; // pages shared with snapshots, cloned on the next write
+
+    // the part of the pages not holding comps: the end of the last pages, padding
+    inline size_t GetFragmentationBytes() const { return m_reservedBytes - m_usedBytes; }
+    inline float GetFragmentation() const { return m_reservedBytes > 0 ? (float)GetFragmentationBytes() / (float)m_reservedBytes : 0.0f; }
+};
+
 // type erased version of the ComponentVector, which is just a tag vector, plus the component data
 class ComponentVectorBase : public GoodSerializable
 {
@@ -73,6 +476,40 @@ public:
     virtual GoodId GetCompClassIdVirtual() const = 0;
     virtual const char* GetCompClassNameVirtual() const = 0;
 
+    // needed by ComponentGrid::DestroyEntity, which doesn't know the comp types
+    virtual bool RemoveEntityIdVirtual(GoodId entityId) = 0;
+    virtual size_t RemoveEntityIdsVirtual(span<const GoodId> entityIds) = 0;
+    virtual void GetEntitiesVirtual(vector<GoodId>& outEntities) const = 0;
+    virtual void RemapEntityIdsVirtual(const unordered_map<GoodId, GoodId>& remap) = 0;
+    // needed by ComponentGrid::Reorder and GridReorder
+    virtual void ApplyEntityOrderVirtual(span<const GoodId> orderedEntities) = 0;
+    virtual bool ReorderStepVirtual(span<const GoodId> orderedEntities, VectorReorderCursor& cursor, size_t maxEntityCount) = 0;
+    // needed by ComponentGrid::GetMemoryStats
+    virtual void GetMemoryStatsVirtual(CompMemoryStats& outStats) const = 0;
+    // needed by ComponentGrid::Instantiate. source has the same comp type.
+    virtual bool HasCompForEntityVirtual(GoodId entityId) const = 0;
+    virtual void AddCopiesVirtual(span<const GoodId> entityIds, const ComponentVectorBase& source, GoodId sourceEntityId) = 0;
+
+    // the stamp put on comps touched through a mutable accessor, see ComponentVector::HasChangedSince.
+    // ComponentGrid::AdvanceChangeTick sets it on all its vectors.
+    uint32_t m_changeTick = 1;
+
+    // everything counts as changed after this tick (set when a snapshot restores a vector the grid didn't have)
+    uint32_t m_everythingChangedTick = 0;
+
+    // GetCompTypeIndex of the comp type, where the grid keeps it in ComponentGrid::m_compVectorsByTypeIndex
+    uint32_t m_compTypeIndex = 0;
+
+    // a copy sharing all the pages, see ComponentGrid::Snapshot
+    virtual ComponentVectorBase* CloneShared() const = 0;
+    // becomes a copy of other (same comp type), sharing its pages. The comps that are not the same as before
+    // (not in a page shared with other) get the current change tick.
+    virtual void CopySharedFrom(const ComponentVectorBase& other) = 0;
+
+    // see GoodHelpers::WriteDelta. base has the same comp type.
+    virtual pods::Error WriteDelta(const ComponentVectorBase& base, pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer) const = 0;
+    virtual pods::Error ApplyDelta(pods::BinaryDeserializer<pods::InputBuffer>& deserializer) = 0;
+
 
     virtual pods::Error serialize(pods::JsonDeserializer<pods::InputBuffer>& jsonDeserializer, pods::Version) = 0;
     virtual pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& binaryDeserializer, pods::Version) = 0;
@@ -83,17 +520,35 @@ public:
 
 
 
+// grainSize rounded up to a whole number of cache lines worth of elements
+template <typename ElementType>
+constexpr size_t AlignGrainSizeToCacheLine(size_t grainSize)
+{
+    constexpr size_t cacheLineSize = 64;
+    constexpr size_t elementsPerLine = cacheLineSize / std::gcd(cacheLineSize, sizeof(ElementType));
+    return (std::max<size_t>(grainSize, 1) + elementsPerLine - 1) / elementsPerLine * elementsPerLine;
+}
+
+
+
 // this is a tag vector, with associated data. 
 template<typename CompType>
 class ComponentVector final : public ComponentVectorBase
 {
 public:
-    vector<GoodId> m_entities;
+    // paged, so that ComponentGrid::Snapshot can share the pages that don't change
+    PagedVector<GoodId> m_entities;
 
     // the location in entity for each entityId in m_entities
-    map<GoodId, size_t> m_entityToIndex;
+    EntitySlotMap m_entityToIndex;
+
+    PagedVector<CompType> m_comps; // the data associated with each entity in m_entities
 
-    vector<CompType> m_comps; // the data associated with each entity in m_entities
+    // Change tracking: m_changeTicks[i] is the m_changeTick of the last time m_comps[i] was given out
+    // mutable (AddEntityId, GetCompIfExists, GetCompAtIndex, ParallelForEach, non const View types).
+    // Writing through m_comps directly doesn't count, call MarkChanged then.
+    // Not serialized: everything loaded counts as changed.
+    PagedVector<uint32_t> m_changeTicks;
 
     constexpr GoodId GetCompClassId() const { return CompType::GetClassId(); }
     constexpr const char* GetCompClassName() const { return CompType::GetClassName(); }
@@ -101,13 +556,163 @@ public:
     virtual GoodId GetCompClassIdVirtual() const override { return GetCompClassId(); }
     virtual const char* GetCompClassNameVirtual() const override { return GetCompClassName(); }
 
+    virtual bool RemoveEntityIdVirtual(GoodId entityId) override { return RemoveEntityId(entityId); }
+    virtual size_t RemoveEntityIdsVirtual(span<const GoodId> entityIds) override { return RemoveEntityIds(entityIds); }
+    virtual void GetEntitiesVirtual(vector<GoodId>& outEntities) const override { outEntities.insert(outEntities.end(), m_entities.begin(), m_entities.end()); }
+    virtual void RemapEntityIdsVirtual(const unordered_map<GoodId, GoodId>& remap) override { RemapEntityIdsInVector(m_entities, m_entityToIndex, remap); }
+    virtual void ApplyEntityOrderVirtual(span<const GoodId> orderedEntities) override { ApplyEntityOrder(orderedEntities); }
+    virtual bool ReorderStepVirtual(span<const GoodId> orderedEntities, VectorReorderCursor& cursor, size_t maxEntityCount) override
+    {
+        return ReorderStep(orderedEntities, cursor, maxEntityCount);
+    }
+
+    virtual void GetMemoryStatsVirtual(CompMemoryStats& outStats) const override { GetMemoryStats(outStats); }
+    virtual bool HasCompForEntityVirtual(GoodId entityId) const override { return HasCompForEntity(entityId); }
+    virtual void AddCopiesVirtual(span<const GoodId> entityIds, const ComponentVectorBase& source, GoodId sourceEntityId) override
+    {
+        BOF_ASSERT_MSG(source.GetCompClassIdVirtual() == GetCompClassId(), "can't copy %s comps into %s comps",
+            source.GetCompClassNameVirtual(), GetCompClassName());
+        if constexpr (std::is_copy_constructible_v<CompType>)
+        {
+            const CompType* sourceComp = static_cast<const ComponentVector<CompType>&>(source).GetCompIfExists(sourceEntityId);
+            BOF_ASSERT_MSG(sourceComp != nullptr, "no %s comp to copy on entity %llu", GetCompClassName(), sourceEntityId);
+            // a copy, source can be this vector
+            const CompType prototype = *sourceComp;
+            AddEntityIds(entityIds, prototype);
+        }
+        else
+        {
+            BOF_FAIL("can't copy %s comps, they can't be copied", GetCompClassName());
+        }
+    }
+
+    virtual ComponentVectorBase* CloneShared() const override { return new ComponentVector<CompType>(*this); }
+    virtual void CopySharedFrom(const ComponentVectorBase& other) override
+    {
+        BOF_ASSERT_MSG(other.GetCompClassIdVirtual() == GetCompClassId(), "can't copy %s comps into %s comps",
+            other.GetCompClassNameVirtual(), GetCompClassName());
+        const ComponentVector<CompType>& source = static_cast<const ComponentVector<CompType>&>(other);
+        const uint32_t changeTick = m_changeTick;
+        const uint32_t everythingChangedTick = std::max(m_everythingChangedTick, source.m_everythingChangedTick);
+        const PagedVector<GoodId> previousEntities = std::move(m_entities);
+        const PagedVector<CompType> previousComps = std::move(m_comps);
+
+        *this = source;
+        m_changeTick = changeTick;
+        m_everythingChangedTick = everythingChangedTick;
+
+        // the entity at an index or its comp can differ, each vector has its own page size.
+        // Writing a comp clones its page, so comparing the stamp pages too would only add false positives.
+        auto markChanged = [this](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                m_changeTicks[i] = m_changeTick;
+            }
+        };
+        m_entities.ForEachPageNotSharedWith(previousEntities, markChanged);
+        m_comps.ForEachPageNotSharedWith(previousComps, markChanged);
+    }
+
+    // removed entities, added entities with their whole comp, then the changed comps with the mask of their
+    // changed GOOD fields and those fields only
+    virtual pods::Error WriteDelta(const ComponentVectorBase& baseVector, pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer) const override
+    {
+        BOF_ASSERT_MSG(baseVector.GetCompClassIdVirtual() == GetCompClassId(), "can't diff %s comps against %s comps",
+            GetCompClassName(), baseVector.GetCompClassNameVirtual());
+        const ComponentVector<CompType>& base = static_cast<const ComponentVector<CompType>&>(baseVector);
+
+        vector<GoodId> removedEntities;
+        CollectMissingEntities(base, *this, removedEntities);
+        PODS_SAFE_CALL(serializer(GOOD(removedEntities)));
+
+        vector<uint32_t> addedIndices;
+        vector<std::pair<uint32_t, uint64_t>> changedIndices; // with the changed field mask
+        for (uint32_t i = 0; i < (uint32_t)m_entities.size(); i++)
+        {
+            const GoodId entityId = m_entities[i];
+            const bool isAtSameIndex = i < base.m_entities.size() && base.m_entities[i] == entityId;
+            const uint32_t baseIndex = isAtSameIndex ? i : base.m_entityToIndex.Find(entityId);
+            if (baseIndex == EntitySlotMap::m_invalidIndex)
+            {
+                addedIndices.push_back(i);
+                continue;
+            }
+            const CompType& comp = m_comps[i];
+            const CompType& baseComp = base.m_comps[baseIndex];
+            if (&comp == &baseComp)
+            {
+                // same page, shared since a snapshot and never written
+                continue;
+            }
+            const uint64_t changedMask = GetChangedFields(baseComp, comp);
+            if (changedMask != 0)
+            {
+                changedIndices.push_back({ i, changedMask });
+            }
+        }
+
+        const uint32_t addedCount = (uint32_t)addedIndices.size();
+        PODS_SAFE_CALL(serializer(GOOD(addedCount)));
+        for (uint32_t index : addedIndices)
+        {
+            PODS_SAFE_CALL(serializer("entityId", m_entities[index], "comp", m_comps[index]));
+        }
+
+        const uint32_t changedCount = (uint32_t)changedIndices.size();
+        PODS_SAFE_CALL(serializer(GOOD(changedCount)));
+        for (const auto& [index, changedMask] : changedIndices)
+        {
+            PODS_SAFE_CALL(serializer("entityId", m_entities[index], "changedMask", changedMask));
+            PODS_SAFE_CALL(ProcessChangedFields(serializer, const_cast<CompType&>(m_comps[index]), changedMask));
+        }
+        return pods::Error::NoError;
+    }
+
+    virtual pods::Error ApplyDelta(pods::BinaryDeserializer<pods::InputBuffer>& deserializer) override
+    {
+        vector<GoodId> removedEntities;
+        PODS_SAFE_CALL(deserializer(GOOD(removedEntities)));
+        RemoveEntityIds(removedEntities);
+
+        uint32_t addedCount = 0;
+        PODS_SAFE_CALL(deserializer(GOOD(addedCount)));
+        m_entityToIndex.Reserve(m_entities.size() + addedCount);
+        for (uint32_t i = 0; i < addedCount; i++)
+        {
+            GoodId entityId = 0;
+            PODS_SAFE_CALL(deserializer(GOOD(entityId)));
+            if (HasCompForEntity(entityId))
+            {
+                return pods::Error::CorruptedArchive;
+            }
+            PODS_SAFE_CALL(deserializer("comp", *AddEntityId(entityId)));
+        }
+
+        uint32_t changedCount = 0;
+        PODS_SAFE_CALL(deserializer(GOOD(changedCount)));
+        for (uint32_t i = 0; i < changedCount; i++)
+        {
+            GoodId entityId = 0;
+            uint64_t changedMask = 0;
+            PODS_SAFE_CALL(deserializer(GOOD(entityId), GOOD(changedMask)));
+            CompType* comp = GetCompIfExists(entityId);
+            if (comp == nullptr)
+            {
+                return pods::Error::CorruptedArchive;
+            }
+            PODS_SAFE_CALL(ProcessChangedFields(deserializer, *comp, changedMask));
+        }
+        return pods::Error::NoError;
+    }
+
 
     inline bool HasCompForEntity(const GoodId& entityId) const
     {
-        return m_entityToIndex.find(entityId) != m_entityToIndex.end();
+        return m_entityToIndex.Contains(entityId);
     }
 
-    inline const vector<GoodId> GetEntities() const { return m_entities; }
+    inline const vector<GoodId> GetEntities() const { return vector<GoodId>(m_entities.begin(), m_entities.end()); }
 
 
     // don't keep this pointer, it will become invalid soonish
@@ -118,31 +723,257 @@ public:
             CompType::GetClassName(),
             entityId);
 
-        // todo: check if already here
-        m_entityToIndex[entityId] = m_entities.size();
+        m_entityToIndex.Set(entityId, (uint32_t)m_entities.size());
         m_entities.push_back(entityId);
+        m_changeTicks.push_back(m_changeTick);
         CompType& comp = m_comps.emplace_back(CompType());
         return &comp;
     }
 
 
+    // For spawning waves: adds a default constructed comp (or a copy of prototype) to all those entities.
+    // Each array grows once, page by page, and the index entries are made in one pass.
+    // The new comps are at GetCompAtIndex(returned index + i), in the order of entityIds.
+    inline size_t AddEntityIds(span<const GoodId> entityIds)
+    {
+        const size_t firstIndex = AddEntityIdsWithoutComps(entityIds);
+        m_comps.resize(m_comps.size() + entityIds.size());
+        return firstIndex;
+    }
+    inline size_t AddEntityIds(span<const GoodId> entityIds, const CompType& prototype)
+    {
+        const size_t firstIndex = AddEntityIdsWithoutComps(entityIds);
+        m_comps.resize(m_comps.size() + entityIds.size(), prototype);
+        return firstIndex;
+    }
+
+    // Swap and pop: the last component moves into the hole, so m_entities and m_comps stay dense,
+    // but the order is not kept. O(1).
+    // This doesn't call destroy() on the component. If it owns things, destroy them before.
+    // returns false if the entity didn't have this comp
+    inline bool RemoveEntityId(GoodId entityId)
+    {
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index == EntitySlotMap::m_invalidIndex)
+        {
+            return false;
+        }
+        m_entityToIndex.Erase(entityId);
+
+        const uint32_t lastIndex = (uint32_t)m_entities.size() - 1;
+        if (index != lastIndex)
+        {
+            m_entities[index] = m_entities[lastIndex];
+            m_changeTicks[index] = m_changeTicks[lastIndex];
+            MoveComp(m_comps[index], m_comps[lastIndex]);
+            m_entityToIndex.Set(m_entities[index], index);
+        }
+        m_entities.pop_back();
+        m_changeTicks.pop_back();
+        m_comps.pop_back();
+        return true;
+    }
+
+    // For when thousands of entities die in the same frame.
+    // Few removals are just swap and pops. When more than 1/m_batchCompactionDivisor of the vector dies,
+    // the survivors are compacted in one forward pass instead, which keeps their order
+    // and touches each survivor index entry at most once.
+    // returns the number of entities that actually had this comp
+    inline size_t RemoveEntityIds(span<const GoodId> entityIds)
+    {
+        if (entityIds.size() * m_batchCompactionDivisor < m_entities.size())
+        {
+            size_t removedCount = 0;
+            for (GoodId entityId : entityIds)
+            {
+                removedCount += RemoveEntityId(entityId) ? 1 : 0;
+            }
+            return removedCount;
+        }
+
+        vector<uint8_t> isDead(m_entities.size(), 0);
+        size_t removedCount = 0;
+        for (GoodId entityId : entityIds)
+        {
+            const uint32_t index = m_entityToIndex.Find(entityId);
+            if (index != EntitySlotMap::m_invalidIndex)
+            {
+                m_entityToIndex.Erase(entityId);
+                isDead[index] = 1;
+                removedCount++;
+            }
+        }
+
+        uint32_t writeIndex = 0;
+        for (uint32_t readIndex = 0; readIndex < (uint32_t)m_entities.size(); readIndex++)
+        {
+            if (isDead[readIndex])
+            {
+                continue;
+            }
+            if (writeIndex != readIndex)
+            {
+                m_entities[writeIndex] = m_entities[readIndex];
+                m_changeTicks[writeIndex] = m_changeTicks[readIndex];
+                MoveComp(m_comps[writeIndex], m_comps[readIndex]);
+                m_entityToIndex.Set(m_entities[writeIndex], writeIndex);
+            }
+            writeIndex++;
+        }
+        m_entities.resize(writeIndex);
+        m_changeTicks.resize(writeIndex);
+        while (m_comps.size() > writeIndex)
+        {
+            m_comps.pop_back();
+        }
+        return removedCount;
+    }
+
+    // Storage order, for locality: the entities of the View loops are visited in this order.
+    // Reordering moves the comps, it doesn't change them (their change ticks move with them).
+    // It writes every page though, so it unshares everything with the snapshots.
+
+    // The entities of this vector sorted with less(const CompType&, const CompType&), ties in storage order.
+    template <typename Less>
+    inline void GetSortedEntities(Less&& less, vector<GoodId>& outEntities) const
+    {
+        vector<uint32_t> indices(m_comps.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::stable_sort(indices.begin(), indices.end(), [&](uint32_t a, uint32_t b)
+        {
+            return less(m_comps[a], m_comps[b]);
+        });
+        outEntities.clear();
+        outEntities.reserve(indices.size());
+        for (uint32_t index : indices)
+        {
+            outEntities.push_back(m_entities[index]);
+        }
+    }
+
+    // The same sorted by key(const CompType&), something with a <, like a MortonCode. The key is computed once per comp.
+    template <typename Key>
+    inline void GetEntitiesSortedBy(Key&& key, vector<GoodId>& outEntities) const
+    {
+        using KeyType = std::decay_t<decltype(key(std::declval<const CompType&>()))>;
+        vector<std::pair<KeyType, uint32_t>> keys;
+        keys.reserve(m_comps.size());
+        for (uint32_t i = 0; i < (uint32_t)m_comps.size(); i++)
+        {
+            keys.emplace_back(key(m_comps[i]), i);
+        }
+        std::sort(keys.begin(), keys.end());
+        outEntities.clear();
+        outEntities.reserve(keys.size());
+        for (const auto& [entityKey, index] : keys)
+        {
+            outEntities.push_back(m_entities[index]);
+        }
+    }
+
+    // One pass: the entities of orderedEntities that are here come first, in that order, then the others in
+    // their current order. The arrays are rebuilt, and every index entry is set once.
+    void ApplyEntityOrder(span<const GoodId> orderedEntities)
+    {
+        vector<uint32_t> newOrder;
+        newOrder.reserve(m_entities.size());
+        vector<uint8_t> isPlaced(m_entities.size(), 0);
+        for (GoodId entityId : orderedEntities)
+        {
+            const uint32_t index = m_entityToIndex.Find(entityId);
+            if (index != EntitySlotMap::m_invalidIndex && !isPlaced[index])
+            {
+                isPlaced[index] = 1;
+                newOrder.push_back(index);
+            }
+        }
+        for (uint32_t index = 0; index < (uint32_t)m_entities.size(); index++)
+        {
+            if (!isPlaced[index])
+            {
+                newOrder.push_back(index);
+            }
+        }
+
+        PagedVector<GoodId> entities;
+        PagedVector<uint32_t> changeTicks;
+        PagedVector<CompType> comps;
+        entities.SetPagePool(m_entities.GetPagePool());
+        changeTicks.SetPagePool(m_changeTicks.GetPagePool());
+        comps.SetPagePool(m_comps.GetPagePool());
+        entities.reserve(newOrder.size());
+        changeTicks.reserve(newOrder.size());
+        comps.reserve(newOrder.size());
+        for (uint32_t i = 0; i < (uint32_t)newOrder.size(); i++)
+        {
+            const GoodId entityId = std::as_const(m_entities)[newOrder[i]];
+            entities.push_back(entityId);
+            changeTicks.push_back(std::as_const(m_changeTicks)[newOrder[i]]);
+            comps.push_back(std::move(m_comps[newOrder[i]]));
+            m_entityToIndex.Set(entityId, i);
+        }
+        m_entities = std::move(entities);
+        m_changeTicks = std::move(changeTicks);
+        m_comps = std::move(comps);
+    }
+
+    // ApplyEntityOrder spread over several frames: looks at no more than maxEntityCount entities of the list,
+    // swapping each one to the end of the already ordered part. cursor keeps where it stopped.
+    // The vector stays valid between steps, entities can be added and removed (a swap and pop may then put an
+    // entity out of place, it's only locality). Returns true when the whole list was walked.
+    bool ReorderStep(span<const GoodId> orderedEntities, VectorReorderCursor& cursor, size_t maxEntityCount)
+    {
+        const size_t endIndex = std::min(orderedEntities.size(), cursor.m_orderIndex + maxEntityCount);
+        for (; cursor.m_orderIndex < endIndex; cursor.m_orderIndex++)
+        {
+            const uint32_t index = m_entityToIndex.Find(orderedEntities[cursor.m_orderIndex]);
+            if (index == EntitySlotMap::m_invalidIndex || index < cursor.m_writeIndex)
+            {
+                continue; // not here, or already placed
+            }
+            SwapIndices(index, cursor.m_writeIndex);
+            cursor.m_writeIndex++;
+        }
+        return cursor.m_orderIndex == orderedEntities.size();
+    }
+
+    // the entities at a and b trade places, with their comps
+    inline void SwapIndices(uint32_t a, uint32_t b)
+    {
+        if (a == b)
+        {
+            return;
+        }
+        const GoodId entityA = std::as_const(m_entities)[a];
+        const GoodId entityB = std::as_const(m_entities)[b];
+        m_entities[a] = entityB;
+        m_entities[b] = entityA;
+        std::swap(m_changeTicks[a], m_changeTicks[b]);
+        CompType comp(std::move(m_comps[a]));
+        MoveComp(m_comps[a], m_comps[b]);
+        MoveComp(m_comps[b], comp);
+        m_entityToIndex.Set(entityA, b);
+        m_entityToIndex.Set(entityB, a);
+    }
+
     // don't keep this pointer!
     inline CompType* GetCompIfExists(const GoodId& entityId)
     {
-        auto it = m_entityToIndex.find(entityId);
-        if (it != m_entityToIndex.end())
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index != EntitySlotMap::m_invalidIndex)
         {
-            return &m_comps[it->second];
+            m_changeTicks[index] = m_changeTick;
+            return &m_comps[index];
         }
         return nullptr;
     }
     // don't keep this pointer!
     inline const CompType* GetCompIfExists(const GoodId& entityId) const
     {
-        auto it = const_cast<map<GoodId, size_t>&>(m_entityToIndex).find(entityId);
-        if (it != m_entityToIndex.end())
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index != EntitySlotMap::m_invalidIndex)
         {
-            return &m_comps[it->second];
+            return &m_comps[index];
         }
         return nullptr;
     }
@@ -154,22 +985,49 @@ public:
 
     virtual void PostDeserialize()
     {
-        m_entityToIndex.clear();
+        m_entityToIndex.Clear();
+        m_entityToIndex.Reserve(m_entities.size());
 
         for (size_t i = 0; i < m_entities.size(); i++)
         {
-            m_entityToIndex[m_entities[i]] = i;
+            m_entityToIndex.Set(m_entities[i], (uint32_t)i);
         }
+        m_changeTicks.assign(m_entities.size(), m_changeTick);
     }
 
     inline size_t Size() const { return m_comps.size(); }
 
+    // where the pages come from from now on, the grid's pool (see ComponentGrid::AddCompVector)
+    inline void SetPagePool(const std::shared_ptr<PagePool>& pagePool)
+    {
+        m_entities.SetPagePool(pagePool);
+        m_entityToIndex.SetPagePool(pagePool);
+        m_comps.SetPagePool(pagePool);
+        m_changeTicks.SetPagePool(pagePool);
+    }
+
+    void GetMemoryStats(CompMemoryStats& outStats) const
+    {
+        outStats.m_compClassId = GetCompClassId();
+        outStats.m_compClassName = GetCompClassName();
+        outStats.m_count = m_comps.size();
+        outStats.m_usedBytes = m_comps.size() * (sizeof(CompType) + sizeof(GoodId) + sizeof(uint32_t));
+        outStats.m_reservedBytes = m_comps.GetPageCount() * m_comps.GetPageByteSize()
+            + m_entities.GetPageCount() * m_entities.GetPageByteSize()
+            + m_changeTicks.GetPageCount() * m_changeTicks.GetPageByteSize();
+        outStats.m_indexBytes = m_entityToIndex.GetMemoryUsage();
+        outStats.m_pageCount = m_comps.GetPageCount() + m_entities.GetPageCount() + m_changeTicks.GetPageCount();
+        outStats.m_sharedPageCount = outStats.m_pageCount
+            - m_comps.GetUniquePageCount() - m_entities.GetUniquePageCount() - m_changeTicks.GetUniquePageCount();
+    }
+
     inline GoodId GetEntityAtIndex(size_t index) const
     {
         return m_entities[index];
     }
     inline CompType& GetCompAtIndex(size_t index)
     {
+        m_changeTicks[index] = m_changeTick;
         return m_comps[index];
     }
     inline const CompType& GetCompAtIndex(size_t index) const
@@ -177,6 +1035,150 @@ public:
         return m_comps[index];
     }
 
+    // func(GoodId entityId, CompType& comp), on all the comps, on several threads.
+    // The dense range is cut in chunks of about grainSize comps, rounded up to a whole number of cache lines
+    // worth of comps. Pages have the shared_ptr control block in front, so a chunk doesn't start on a cache
+    // line in memory: two threads share at most the line at the boundary of their chunks.
+    // Chunk boundaries only depend on Size() and grainSize, not on the thread count, so a lockstep
+    // simulation gives the same result everywhere, as long as func only touches its own comp.
+    // Shared pages are cloned first, two threads must not clone the same one.
+    template <typename Func>
+    inline void ParallelForEach(Func&& func, size_t grainSize = m_defaultGrainSize, Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault())
+    {
+        MakePagesUnique();
+        jobSystem.ParallelFor(m_comps.size(), AlignGrainSizeToCacheLine<CompType>(grainSize), [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                m_changeTicks[i] = m_changeTick;
+                func(std::as_const(m_entities)[i], m_comps[i]);
+            }
+        });
+    }
+
+    // see PagedVector::MakePagesUnique. Call it before threads write comps picked by index (m_comps[i]
+    // and MarkChanged), when the vector may share pages with a snapshot.
+    inline void MakePagesUnique()
+    {
+        m_comps.MakePagesUnique();
+        m_changeTicks.MakePagesUnique();
+    }
+
+    // for when comps are written through m_comps
+    inline void MarkChanged(size_t index)
+    {
+        m_changeTicks[index] = m_changeTick;
+    }
+
+    // true if the comp was touched mutably after tick, so with a stamp > tick
+    inline bool HasChangedSince(size_t index, uint32_t tick) const
+    {
+        return m_changeTicks[index] > tick || m_everythingChangedTick > tick;
+    }
+
+    // func(GoodId entityId, const CompType& comp) on the comps changed after tick.
+    // It's a scan of m_changeTicks (4 bytes per comp), the comps themselves are only read when changed.
+    // Removed comps are not reported, they are not there anymore.
+    template <typename Func>
+    inline void ForEachChangedSince(uint32_t tick, Func&& func) const
+    {
+        for (size_t i = 0; i < m_changeTicks.size(); i++)
+        {
+            if (m_changeTicks[i] > tick || m_everythingChangedTick > tick)
+            {
+                func(m_entities[i], m_comps[i]);
+            }
+        }
+    }
+
+    // indices in m_comps of the comps changed after tick
+    inline void GetChangedSince(uint32_t tick, vector<uint32_t>& outIndices) const
+    {
+        outIndices.clear();
+        for (uint32_t i = 0; i < (uint32_t)m_changeTicks.size(); i++)
+        {
+            if (m_changeTicks[i] > tick || m_everythingChangedTick > tick)
+            {
+                outIndices.push_back(i);
+            }
+        }
+    }
+
+    static constexpr size_t m_batchCompactionDivisor = 8;
+    static constexpr size_t m_defaultGrainSize = 4096;
+
+private:
+    inline size_t AddEntityIdsWithoutComps(span<const GoodId> entityIds)
+    {
+        const size_t firstIndex = m_entities.size();
+        m_entityToIndex.ReserveSlots(GetSlotCountFor(entityIds));
+        for (size_t i = 0; i < entityIds.size(); i++)
+        {
+            BOF_ASSERT_MSG(!HasCompForEntity(entityIds[i]), "can't add already existing component %s to entity %llu",
+                CompType::GetClassName(), entityIds[i]);
+            m_entityToIndex.Set(entityIds[i], (uint32_t)(firstIndex + i));
+        }
+        m_entities.append(entityIds.begin(), entityIds.end());
+        m_changeTicks.resize(m_changeTicks.size() + entityIds.size(), m_changeTick);
+        return firstIndex;
+    }
+
+    // comps made with GOOD_SERIALIZABLE_PARTIAL only know the pods serializers, no field list to walk
+    static constexpr bool m_hasGoodFieldList = requires(CompType& comp, GoodFieldComparer& comparer)
+    {
+        comp.serialize(comparer, CompType::version());
+    };
+
+    // a bit per GOOD field that differs
+    static inline uint64_t GetChangedFields(const CompType& baseComp, const CompType& comp)
+    {
+        if constexpr (m_hasGoodFieldList)
+        {
+            std::array<const void*, g_maxGoodDeltaFieldCount> baseFields;
+            GoodFieldAddressCollector collector(baseFields);
+            const_cast<CompType&>(baseComp).serialize(collector, CompType::version());
+            GoodFieldComparer comparer(baseFields);
+            const_cast<CompType&>(comp).serialize(comparer, CompType::version());
+            return comparer.GetChangedMask();
+        }
+        else
+        {
+            // the whole comp is one field
+            return GoodHelpers::AreEqual(baseComp, comp) ? 0 : 1;
+        }
+    }
+
+    // saves or loads the fields of changedMask
+    template <class Archive>
+    static inline pods::Error ProcessChangedFields(Archive& archive, CompType& comp, uint64_t changedMask)
+    {
+        if constexpr (m_hasGoodFieldList)
+        {
+            GoodMaskedFields<Archive> fields(archive, changedMask);
+            return comp.serialize(fields, CompType::version());
+        }
+        else
+        {
+            return archive("comp", comp);
+        }
+    }
+
+    // comps are allowed to have only a move constructor (no assignment), like Allo in BofGame2
+    static inline void MoveComp(CompType& dest, CompType& src)
+    {
+        if constexpr (std::is_move_assignable_v<CompType>)
+        {
+            dest = std::move(src);
+        }
+        else
+        {
+            std::destroy_at(&dest);
+            std::construct_at(&dest, std::move(src));
+        }
+    }
+
+public:
+
 
 #define THIS_REPEATED_SERIALIZE()\
     PODS_SAFE_CALL(serializer(GOOD(m_entities), GOOD(m_comps)))
@@ -187,33 +1189,290 @@ public:
         PostDeserialize();
         return pods::Error::NoError;
     }
-    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version) override
+    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version) override
+    {
+        THIS_REPEATED_SERIALIZE();
+        PostDeserialize();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+#undef THIS_REPEATED_SERIALIZE
+
+};
+
+
+
+// Iterates all the entities having all of CompTypes (a join).
+// Get one with grid.View<PositionComp, VelocityComp>().
+//
+// The smallest of the component vectors (or of the WithTag tag vectors) drives the iteration,
+// the others are probed through their EntitySlotMap. The lambda gets references straight into
+// the dense component arrays:
+//
+// grid.View<PositionComp, VelocityComp>()
+//     .WithTag(grid.GetTags(movingTag))
+//     .WithoutTag(grid.GetTags(frozenTag))
+//     .ForEach([](GoodId entityId, PositionComp& position, VelocityComp& velocity)
+//     {
+//         position.m_x += velocity.m_x;
+//     });
+//
+// Don't add or remove components of those types while iterating, the references would dangle.
+// Building a view doesn't allocate.
+//
+// The comps visited are marked as changed (see ComponentVector::m_changeTicks), except for the
+// types asked as const, which are only read: grid.View<const VelocityComp, PositionComp>().
+template <typename... CompTypes>
+class ComponentView
+{
+public:
+    static_assert(sizeof...(CompTypes) > 0, "a view needs at least one comp type");
+
+    static constexpr size_t m_maxTagFilters = 4;
+
+    explicit ComponentView(ComponentVector<std::remove_const_t<CompTypes>>*... comps) : m_comps(comps...) {}
+
+    // only entities having this tag
+    inline ComponentView& WithTag(const TagVector& tags)
+    {
+        BOF_ASSERT_MSG(m_withTagCount < m_maxTagFilters, "more than %i WithTag filters", (int)m_maxTagFilters);
+        m_withTags[m_withTagCount++] = &tags;
+        return *this;
+    }
+
+    // only entities not having this tag
+    inline ComponentView& WithoutTag(const TagVector& tags)
+    {
+        BOF_ASSERT_MSG(m_withoutTagCount < m_maxTagFilters, "more than %i WithoutTag filters", (int)m_maxTagFilters);
+        m_withoutTags[m_withoutTagCount++] = &tags;
+        return *this;
+    }
+
+    // only entities in the query, checked on its bitsets. The query must live until the loop is done.
+    inline ComponentView& WithTags(const TagQuery& query)
+    {
+        m_tagQuery = &query;
+        return *this;
+    }
+
+    // func(GoodId entityId, CompTypes&... comps)
+    template <typename Func>
+    inline void ForEach(Func&& func)
+    {
+        const Driver driver = ChooseDriver(std::index_sequence_for<CompTypes...>{});
+        ForEachInRange<true>(func, driver, 0, driver.m_entities->size(), std::index_sequence_for<CompTypes...>{});
+    }
+
+    // ForEach on several threads. The driver entities (see above) are cut in chunks of grainSize,
+    // the boundaries only depend on the driver size and grainSize, not on the thread count.
+    // func is called concurrently, it should only write in the comps it gets.
+    // The mutable comp vectors get their shared pages cloned first: the other comps are found at any
+    // index, so two chunks can write in the same page, and two threads must not clone the same one.
+    template <typename Func>
+    inline void ParallelForEach(Func&& func, size_t grainSize = m_defaultGrainSize, Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault())
+    {
+        MakeMutablePagesUnique(std::index_sequence_for<CompTypes...>{});
+        const Driver driver = ChooseDriver(std::index_sequence_for<CompTypes...>{});
+        jobSystem.ParallelFor(driver.m_entities->size(), AlignGrainSizeToCacheLine<GoodId>(grainSize), [&](size_t begin, size_t end)
+        {
+            ForEachInRange<true>(func, driver, begin, end, std::index_sequence_for<CompTypes...>{});
+        });
+    }
+
+    // number of entities ForEach would visit
+    inline size_t Count()
+    {
+        size_t count = 0;
+        auto countOne = [&count](GoodId, CompTypes&...) { count++; };
+        const Driver driver = ChooseDriver(std::index_sequence_for<CompTypes...>{});
+        ForEachInRange<false>(countOne, driver, 0, driver.m_entities->size(), std::index_sequence_for<CompTypes...>{});
+        return count;
+    }
+
+    static constexpr size_t m_defaultGrainSize = 4096;
+
+private:
+
+    // what ForEach walks: the entities of one of the comp vectors, or of a WithTag
+    struct Driver
+    {
+        const PagedVector<GoodId>* m_entities = nullptr;
+        size_t m_compIndex = 0;
+        const TagVector* m_tags = nullptr;
+    };
+
+    template <size_t... Is>
+    inline Driver ChooseDriver(std::index_sequence<Is...>) const
+    {
+        // pick the driver: the smallest comp vector, unless a WithTag is even smaller
+        size_t driverCompIndex = 0;
+        size_t driverSize = std::get<0>(m_comps)->Size();
+        auto considerComp = [&](size_t compIndex, size_t compSize)
+        {
+            if (compSize < driverSize)
+            {
+                driverCompIndex = compIndex;
+                driverSize = compSize;
+            }
+        };
+        (considerComp(Is, std::get<Is>(m_comps)->Size()), ...);
+
+        Driver driver;
+        driver.m_compIndex = driverCompIndex;
+        for (size_t t = 0; t < m_withTagCount; t++)
+        {
+            if (m_withTags[t]->Size() < driverSize)
+            {
+                driver.m_tags = m_withTags[t];
+                driverSize = driver.m_tags->Size();
+            }
+        }
+
+        driver.m_entities = driver.m_tags != nullptr
+            ? &driver.m_tags->m_entities
+            : &GetEntitiesOfComp(driverCompIndex, std::index_sequence<Is...>{});
+        return driver;
+    }
+
+    template <bool MarkChanged, typename Func, size_t... Is>
+    inline void ForEachInRange(Func& func, const Driver& driver, size_t begin, size_t end, std::index_sequence<Is...>)
+    {
+        const PagedVector<GoodId>& driverEntities = *driver.m_entities;
+        for (uint32_t driverIndex = (uint32_t)begin; driverIndex < (uint32_t)end; driverIndex++)
+        {
+            const GoodId entityId = driverEntities[driverIndex];
+
+            // the driver comp doesn't need a lookup
+            uint32_t indices[sizeof...(CompTypes)] = {
+                (driver.m_tags == nullptr && Is == driver.m_compIndex)
+                    ? driverIndex
+                    : std::get<Is>(m_comps)->m_entityToIndex.Find(entityId)... };
+
+            if (((indices[Is] == EntitySlotMap::m_invalidIndex) || ...))
+            {
+                continue;
+            }
+            if (!PassesTagFilters(entityId, driver.m_tags))
+            {
+                continue;
+            }
+
+            if constexpr (MarkChanged)
+            {
+                (MarkChangedIfMutable<Is>(indices[Is]), ...);
+            }
+            func(entityId, GetComp<Is>(indices[Is])...);
+        }
+    }
+
+    // const types are read through the const PagedVector, so that they never clone a shared page
+    template <size_t I>
+    inline std::tuple_element_t<I, std::tuple<CompTypes...>>& GetComp(uint32_t index)
+    {
+        if constexpr (std::is_const_v<std::tuple_element_t<I, std::tuple<CompTypes...>>>)
+        {
+            return std::as_const(std::get<I>(m_comps)->m_comps)[index];
+        }
+        else
+        {
+            return std::get<I>(m_comps)->m_comps[index];
+        }
+    }
+
+    template <size_t I>
+    inline void MarkChangedIfMutable(uint32_t index)
+    {
+        if constexpr (!std::is_const_v<std::tuple_element_t<I, std::tuple<CompTypes...>>>)
+        {
+            std::get<I>(m_comps)->MarkChanged(index);
+        }
+    }
+
+    template <size_t... Is>
+    inline void MakeMutablePagesUnique(std::index_sequence<Is...>)
     {
-        THIS_REPEATED_SERIALIZE();
-        PostDeserialize();
-        return pods::Error::NoError;
+        (MakePagesUniqueIfMutable<Is>(), ...);
     }
-    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+
+    template <size_t I>
+    inline void MakePagesUniqueIfMutable()
     {
-        THIS_REPEATED_SERIALIZE();
-        return pods::Error::NoError;
+        if constexpr (!std::is_const_v<std::tuple_element_t<I, std::tuple<CompTypes...>>>)
+        {
+            std::get<I>(m_comps)->MakePagesUnique();
+        }
     }
-    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+
+    template <size_t... Is>
+    inline const PagedVector<GoodId>& GetEntitiesOfComp(size_t compIndex, std::index_sequence<Is...>) const
     {
-        THIS_REPEATED_SERIALIZE();
-        return pods::Error::NoError;
+        const PagedVector<GoodId>* entities = nullptr;
+        auto considerComp = [&](size_t index, const PagedVector<GoodId>& compEntities)
+        {
+            if (index == compIndex)
+            {
+                entities = &compEntities;
+            }
+        };
+        (considerComp(Is, std::get<Is>(m_comps)->m_entities), ...);
+        return *entities;
     }
-    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version) override
+
+    inline bool PassesTagFilters(GoodId entityId, const TagVector* driverTags) const
     {
-        THIS_REPEATED_SERIALIZE();
-        return pods::Error::NoError;
+        for (size_t t = 0; t < m_withTagCount; t++)
+        {
+            if (m_withTags[t] != driverTags && !m_withTags[t]->HasCompForEntity(entityId))
+            {
+                return false;
+            }
+        }
+        for (size_t t = 0; t < m_withoutTagCount; t++)
+        {
+            if (m_withoutTags[t]->HasCompForEntity(entityId))
+            {
+                return false;
+            }
+        }
+        return m_tagQuery == nullptr || m_tagQuery->Contains(entityId);
     }
-#undef THIS_REPEATED_SERIALIZE
 
+    std::tuple<ComponentVector<std::remove_const_t<CompTypes>>*...> m_comps;
+
+    std::array<const TagVector*, m_maxTagFilters> m_withTags = {};
+    size_t m_withTagCount = 0;
+    std::array<const TagVector*, m_maxTagFilters> m_withoutTags = {};
+    size_t m_withoutTagCount = 0;
+    const TagQuery* m_tagQuery = nullptr;
 };
 
 
 
+class Prefab;
+class SpatialIndex;
+
+struct GridMemoryStats
+{
+    vector<CompMemoryStats> m_comps;
+    size_t m_tagBytes = 0;
+    size_t m_entityRegistryBytes = 0;
+    PagePoolStats m_pagePool;
+};
+
 class ComponentGrid : public GoodSerializable
 {
 public:
@@ -245,8 +1504,15 @@ public:
             delete p.second;
         }
         m_compVectorMap.clear();
+        m_compVectorsByTypeIndex.clear();
+        m_entityRegistry.Clear();
+        m_spatialIndex.reset();
     }
 
+    // a new entity id, see EntityRegistry
+    inline GoodId CreateEntity() { return m_entityRegistry.CreateEntity(); }
+    inline bool IsAlive(GoodId entityId) const { return m_entityRegistry.IsAlive(entityId); }
+
     inline TagVector& GetTags(GoodId tagId)
     {
         auto it = m_tagMap.find(tagId);
@@ -258,25 +1524,26 @@ public:
         return m_tagMap[tagId];
     }
 
+    // an array access, see CompTypeIndexRegistry
     template <class T>
     inline ComponentVector<T>* GetComps()
     {
-        auto it = m_compVectorMap.find(T::GetClassId());
-        BOF_ASSERT_MSG(it != m_compVectorMap.end(),
+        ComponentVectorBase* comps = FindCompVector(GetCompTypeIndex<T>());
+        BOF_ASSERT_MSG(comps != nullptr,
             "Can't find comp vector. Add it to the grid beforehand with grid.AddCompVector<%s>().",
             T::GetClassName());
-        return static_cast<ComponentVector<T>*>(it->second);
+        return static_cast<ComponentVector<T>*>(comps);
     }
     template <class T>
     inline const ComponentVector<T>* GetConstComps() const
-    {        
-        auto it = const_cast<unordered_map<GoodId, ComponentVectorBase*>&>(m_compVectorMap).find(T::GetClassId());
-        if (it == m_compVectorMap.end())
+    {
+        const ComponentVectorBase* comps = FindCompVector(GetCompTypeIndex<T>());
+        if (comps == nullptr)
         {
             std::cerr << "can't find comp vector " << T::GetClassName() << std::endl;
             return nullptr;
         }
-        return static_cast<const ComponentVector<T>*>(it->second);
+        return static_cast<const ComponentVector<T>*>(comps);
     }
 
     template <class T>
@@ -287,7 +1554,37 @@ public:
             std::cerr << "error: adding existing compvector " << T::GetClassName() << std::endl;
             return;
         }
-        m_compVectorMap[T::GetClassId()] = new ComponentVector<T>();
+        ComponentVector<T>* comps = new ComponentVector<T>();
+        comps->m_changeTick = m_changeTick;
+        comps->m_compTypeIndex = GetCompTypeIndex<T>();
+        comps->SetPagePool(m_pagePool);
+        m_compVectorMap[T::GetClassId()] = comps;
+        SetCompVectorByTypeIndex(comps);
+    }
+
+    // The memory of each comp vector (sorted by comp name), of the tags and entity ids, and of the page
+    // pool all the comp pages come from. Walks the page lists, it's for debug panels, not every frame of
+    // a shipping build.
+    GridMemoryStats GetMemoryStats() const
+    {
+        GridMemoryStats stats;
+        stats.m_comps.resize(m_compVectorMap.size());
+        size_t index = 0;
+        for (const auto& p : m_compVectorMap)
+        {
+            p.second->GetMemoryStatsVirtual(stats.m_comps[index++]);
+        }
+        std::sort(stats.m_comps.begin(), stats.m_comps.end(), [](const CompMemoryStats& a, const CompMemoryStats& b)
+        {
+            return std::string_view(a.m_compClassName) < std::string_view(b.m_compClassName);
+        });
+        for (const auto& p : m_tagMap)
+        {
+            stats.m_tagBytes += p.second.GetMemoryUsage();
+        }
+        stats.m_entityRegistryBytes = m_entityRegistry.GetMemoryUsage();
+        stats.m_pagePool = m_pagePool->GetStats();
+        return stats;
     }
 
     // Use this to easily add a component to an entity.
@@ -303,6 +1600,68 @@ public:
         ComponentVector<T>* comps = GetComps<T>();
         return comps->AddEntityId(entityId);
     }
+    // Spawns count entities having a copy of each prototype:
+    // vector<GoodId> rocks = grid.CreateEntities(50000, PositionComp(), RockComp{ .m_size = 3.0f });
+    // CreateEntities<PositionComp, RockComp>(50000) default constructs them instead (for comps that can't be copied).
+    // Each comp vector grows once, see ComponentVector::AddEntityIds.
+    template <class... CompTypes>
+    inline vector<GoodId> CreateEntities(size_t count, const CompTypes&... prototypes)
+    {
+        vector<GoodId> entityIds;
+        m_entityRegistry.CreateEntities(count, entityIds);
+        (GetComps<CompTypes>()->AddEntityIds(entityIds, prototypes), ...);
+        return entityIds;
+    }
+    template <class... CompTypes>
+    inline vector<GoodId> CreateEntities(size_t count)
+    {
+        vector<GoodId> entityIds;
+        m_entityRegistry.CreateEntities(count, entityIds);
+        (GetComps<CompTypes>()->AddEntityIds(entityIds), ...);
+        return entityIds;
+    }
+
+    // Spawns count copies of templateEntityId of source (another grid, or this one): its comps and its tags.
+    // The new ids go at the end of outEntityIds. Like CreateEntities, each comp vector grows once, and
+    // trivially copyable data is copied by blocks (see PagedVector::resize).
+    // This grid needs a comp vector for each comp of the template.
+    void Instantiate(const ComponentGrid& source, GoodId templateEntityId, size_t count, vector<GoodId>& outEntityIds)
+    {
+        const size_t firstIndex = outEntityIds.size();
+        m_entityRegistry.CreateEntities(count, outEntityIds);
+        const span<const GoodId> entityIds(outEntityIds.data() + firstIndex, count);
+
+        for (const auto& p : source.m_compVectorMap)
+        {
+            if (!p.second->HasCompForEntityVirtual(templateEntityId))
+            {
+                continue;
+            }
+            auto it = m_compVectorMap.find(p.first);
+            if (it == m_compVectorMap.end())
+            {
+                std::cerr << "error: can't instantiate " << p.second->GetCompClassNameVirtual() << ", the grid has no comp vector for it" << std::endl;
+                continue;
+            }
+            it->second->AddCopiesVirtual(entityIds, *p.second, templateEntityId);
+        }
+        // the tags of this grid can be the ones of source, look them up first
+        vector<GoodId> tagIds;
+        for (const auto& p : source.m_tagMap)
+        {
+            if (p.second.HasCompForEntity(templateEntityId))
+            {
+                tagIds.push_back(p.first);
+            }
+        }
+        for (GoodId tagId : tagIds)
+        {
+            GetTags(tagId).AddEntityIds(entityIds);
+        }
+    }
+    // see Prefab
+    void Instantiate(const Prefab& prefab, size_t count, vector<GoodId>& outEntityIds);
+
     // use this one only when getting one comp from the compvector,
     // BozoComp* bozo = grid.GetComp<Bozo>(someEntityId);
     // to get multiple components use instead
@@ -317,8 +1676,255 @@ public:
         return comps->GetCompIfExists(entityId);
     }
 
+    // Iterate the entities having all of those comps. See ComponentView.
+    // grid.View<PositionComp, VelocityComp>().ForEach([](GoodId, PositionComp& p, VelocityComp& v) {...});
+    template <class... Ts>
+    inline ComponentView<Ts...> View()
+    {
+        return ComponentView<Ts...>(GetComps<std::remove_const_t<Ts>>()...);
+    }
+
+    // swap and pop, see ComponentVector::RemoveEntityId
+    template <class T>
+    inline bool RemoveComp(GoodId entityId)
+    {
+        ComponentVector<T>* comps = GetComps<T>();
+        return comps->RemoveEntityId(entityId);
+    }
+
+    // Removes the entity from every component vector and every tag. O(1) per vector.
+    // Components are not destroy()ed, do it before if they own things.
+    inline void DestroyEntity(GoodId entityId)
+    {
+        for (auto& p : m_compVectorMap)
+        {
+            p.second->RemoveEntityIdVirtual(entityId);
+        }
+        for (auto& p : m_tagMap)
+        {
+            p.second.RemoveEntityId(entityId);
+        }
+        m_entityRegistry.DestroyEntity(entityId);
+    }
+
+    // Use this when lots of entities die in the same frame: one virtual call per comp vector,
+    // and each vector decides if it's cheaper to swap and pop or to compact.
+    inline void DestroyEntities(span<const GoodId> entityIds)
+    {
+        for (auto& p : m_compVectorMap)
+        {
+            p.second->RemoveEntityIdsVirtual(entityIds);
+        }
+        for (auto& p : m_tagMap)
+        {
+            p.second.RemoveEntityIds(entityIds);
+        }
+        for (GoodId entityId : entityIds)
+        {
+            m_entityRegistry.DestroyEntity(entityId);
+        }
+    }
+
+
+    // Storage order of the entities, for locality (see ComponentVector::ApplyEntityOrder).
+    // The entities of T are sorted with less(const T&, const T&), and the comp vectors of GroupComps
+    // take the same order (their entities without a T go after). No GroupComps: every comp vector does.
+    // grid.Reorder<PositionComp, VelocityComp>([](const PositionComp& a, const PositionComp& b) { return a.m_x < b.m_x; });
+    // See GridReorder to spread it over several frames.
+    template <class T, class... GroupComps, typename Less>
+    inline void Reorder(Less&& less)
+    {
+        vector<GoodId> orderedEntities;
+        std::as_const(*GetComps<T>()).GetSortedEntities(less, orderedEntities);
+        ApplyEntityOrder<T, GroupComps...>(orderedEntities);
+    }
+    // the same, sorted by key(const T&). For space locality:
+    // grid.SortBy<PositionComp>([](const PositionComp& p) { return Bof::MortonCode(p.m_position, worldMin, 1.0f); });
+    // (utils/Morton.h)
+    template <class T, class... GroupComps, typename Key>
+    inline void SortBy(Key&& key)
+    {
+        vector<GoodId> orderedEntities;
+        std::as_const(*GetComps<T>()).GetEntitiesSortedBy(key, orderedEntities);
+        ApplyEntityOrder<T, GroupComps...>(orderedEntities);
+    }
+    template <class T, class... GroupComps>
+    inline void ApplyEntityOrder(span<const GoodId> orderedEntities)
+    {
+        if constexpr (sizeof...(GroupComps) == 0)
+        {
+            for (auto& p : m_compVectorMap)
+            {
+                p.second->ApplyEntityOrderVirtual(orderedEntities);
+            }
+        }
+        else
+        {
+            GetComps<T>()->ApplyEntityOrder(orderedEntities);
+            (GetComps<GroupComps>()->ApplyEntityOrder(orderedEntities), ...);
+        }
+    }
+
+
+    // Change ticks. Comps touched mutably are stamped with the current tick (see ComponentVector::m_changeTicks).
+    // Something that wants only what changed since it last looked does:
+    //
+    // const uint32_t seenUpTo = grid.AdvanceChangeTick();
+    // grid.GetComps<PositionComp>()->ForEachChangedSince(m_lastSeenTick, ...);
+    // m_lastSeenTick = seenUpTo;
+    //
+    // Returns the tick that was current, everything touched from now on gets a bigger one.
+    inline uint32_t AdvanceChangeTick()
+    {
+        const uint32_t previousTick = m_changeTick;
+        m_changeTick++;
+        for (auto& p : m_compVectorMap)
+        {
+            p.second->m_changeTick = m_changeTick;
+        }
+        return previousTick;
+    }
+    inline uint32_t GetChangeTick() const { return m_changeTick; }
+
+
+    // The SpatialIndex of the AABBComps of the grid, made on first use. Not part of snapshots: after a
+    // RestoreSnapshot what it changed counts as changed, the next update catches up.
+    // Defined in SpatialIndex.h, include it to use them.
+    SpatialIndex& GetSpatialIndex();
+    // the AABBComps changed since the last call go in the index
+    void UpdateSpatialIndex();
+
+
+    // A copy of the whole grid, for rollback or to hand the state to another thread.
+    // Nothing is copied: the comp vectors, tags and entity indices are PagedVectors, the snapshot shares
+    // all their pages. Writing in the grid (or in the snapshot) after that clones only the pages written.
+    // So a snapshot per tick costs a refcount per page, plus the pages the tick actually touches.
+    //
+    // Comps that can't be copied (move only) can't be shared, their vectors must be empty.
+    // A snapshot can be read from another thread while this grid keeps going.
+    inline std::unique_ptr<ComponentGrid> Snapshot() const
+    {
+        std::unique_ptr<ComponentGrid> snapshot = std::make_unique<ComponentGrid>();
+        snapshot->m_pagePool = m_pagePool;
+        snapshot->m_tagMap = m_tagMap;
+        // copy the map then replace the pointers, so that it iterates (and serializes) in the same order
+        snapshot->m_compVectorMap = m_compVectorMap;
+        for (auto& p : snapshot->m_compVectorMap)
+        {
+            p.second = p.second->CloneShared();
+            snapshot->SetCompVectorByTypeIndex(p.second);
+        }
+        snapshot->m_entityRegistry = m_entityRegistry;
+        snapshot->m_changeTick = m_changeTick;
+        return snapshot;
+    }
+
+    // Back to the state of a snapshot, sharing its pages (the snapshot stays usable).
+    // The comp vectors stay the same objects, so ComponentVector pointers stay valid, but not comp pointers.
+    // For the change tracking, the comps that differ from the grid before the restore count as changed since now.
+    // That's the pages written since the snapshot was taken, found by comparing the page pointers,
+    // so a rollback of a few ticks doesn't make every consumer of ChangedSince redo everything.
+    inline void RestoreSnapshot(const ComponentGrid& snapshot)
+    {
+        m_tagMap = snapshot.m_tagMap;
+        m_entityRegistry = snapshot.m_entityRegistry;
+        const uint32_t previousTick = AdvanceChangeTick();
+        for (const auto& p : snapshot.m_compVectorMap)
+        {
+            auto it = m_compVectorMap.find(p.first);
+            if (it == m_compVectorMap.end())
+            {
+                ComponentVectorBase* comps = p.second->CloneShared();
+                comps->m_changeTick = m_changeTick;
+                comps->m_everythingChangedTick = previousTick + 1;
+                m_compVectorMap[p.first] = comps;
+                SetCompVectorByTypeIndex(comps);
+            }
+            else
+            {
+                it->second->CopySharedFrom(*p.second);
+            }
+        }
+        BOF_ASSERT_MSG(m_compVectorMap.size() == snapshot.m_compVectorMap.size(),
+            "the grid has %i comp vectors that are not in the snapshot", (int)(m_compVectorMap.size() - snapshot.m_compVectorMap.size()));
+    }
+
+
+    // The translation layer for grids saved before the registry (version 1), or filled with ids made
+    // elsewhere: makes the registry from the entities in the vectors. Ids that can't be kept as they are
+    // (bigger than 32 bit slots, or colliding) get new ones, in all the vectors and tags.
+    // m_legacyEntityIdRemap tells which, for the code that kept old ids around.
+    void RebuildEntityRegistry()
+    {
+        m_entityRegistry.RebuildFromEntityIds(GetAllEntityIds(), m_legacyEntityIdRemap);
+        RemapEntityIds(m_legacyEntityIdRemap);
+    }
+
+    // For the storages that keep the ids they are given (ArchetypeGrid), before a save: the registry made
+    // from the ids in the vectors if they can all be kept as they are, else an empty one. The ids are saved
+    // as they are either way, and loading an empty registry rebuilds it (see serialize).
+    void RebuildEntityRegistryKeepingIds()
+    {
+        unordered_map<GoodId, GoodId> remap;
+        m_entityRegistry.RebuildFromEntityIds(GetAllEntityIds(), remap);
+        if (!remap.empty())
+        {
+            m_entityRegistry.Clear();
+        }
+    }
+
+    // For the same storages, after a load: puts back the ids that RebuildEntityRegistry changed. The registry
+    // doesn't know them, so it's cleared.
+    void RestoreLegacyEntityIds()
+    {
+        if (m_legacyEntityIdRemap.empty())
+        {
+            return;
+        }
+        unordered_map<GoodId, GoodId> newToOld;
+        for (const auto& p : m_legacyEntityIdRemap)
+        {
+            newToOld[p.second] = p.first;
+        }
+        RemapEntityIds(newToOld);
+        m_legacyEntityIdRemap.clear();
+        m_entityRegistry.Clear();
+    }
+
+    // in all the vectors and tags, with duplicates
+    vector<GoodId> GetAllEntityIds() const
+    {
+        vector<GoodId> entityIds;
+        for (const auto& p : m_compVectorMap)
+        {
+            p.second->GetEntitiesVirtual(entityIds);
+        }
+        for (const auto& p : m_tagMap)
+        {
+            entityIds.insert(entityIds.end(), p.second.m_entities.begin(), p.second.m_entities.end());
+        }
+        return entityIds;
+    }
+
+    void RemapEntityIds(const unordered_map<GoodId, GoodId>& remap)
+    {
+        if (remap.empty())
+        {
+            return;
+        }
+        for (auto& p : m_compVectorMap)
+        {
+            p.second->RemapEntityIdsVirtual(remap);
+        }
+        for (auto& p : m_tagMap)
+        {
+            p.second.RemapEntityIds(remap);
+        }
+    }
 
-    GOOD_SERIALIZABLE_PARTIAL(ComponentGrid, GOOD_VERSION(1));
+
+    // version 2: the entity registry
+    GOOD_SERIALIZABLE_PARTIAL(ComponentGrid, GOOD_VERSION(2));
 
 
 #define THIS_REPEATED_SERIALIZE()\
@@ -326,37 +1932,51 @@ public:
     for (auto& p : m_compVectorMap)\
     {\
         PODS_SAFE_CALL(serializer(p.second->GetCompClassNameVirtual(), *p.second));\
+    }\
+    if (version >= 2)\
+    {\
+        PODS_SAFE_CALL(serializer(GOOD(m_entityRegistry)));\
     }
 
-    pods::Error serialize(pods::JsonDeserializer<pods::InputBuffer>& serializer, pods::Version)
+    pods::Error serialize(pods::JsonDeserializer<pods::InputBuffer>& serializer, pods::Version version)
     {
         THIS_REPEATED_SERIALIZE();
         for (auto& p : m_tagMap)
         {
             p.second.PostDeserialize();
         }
+        // no slots at all: ids made elsewhere, see RebuildEntityRegistryKeepingIds
+        if (version < 2 || m_entityRegistry.GetSlotCount() == 0)
+        {
+            RebuildEntityRegistry();
+        }
         return pods::Error::NoError;
     }
-    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version)
+    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version version)
     {
         THIS_REPEATED_SERIALIZE();
         for (auto& p : m_tagMap)
         {
             p.second.PostDeserialize();
         }
+        // no slots at all: ids made elsewhere, see RebuildEntityRegistryKeepingIds
+        if (version < 2 || m_entityRegistry.GetSlotCount() == 0)
+        {
+            RebuildEntityRegistry();
+        }
         return pods::Error::NoError;
     }
-    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
     {
         THIS_REPEATED_SERIALIZE();
         return pods::Error::NoError;
     }
-    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
     {
         THIS_REPEATED_SERIALIZE();
         return pods::Error::NoError;
     }
-    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version version)
     {
         THIS_REPEATED_SERIALIZE();
         return pods::Error::NoError;
@@ -366,9 +1986,40 @@ public:
 
     unordered_map<GoodId, TagVector> m_tagMap;
 
+    // Owns the comp vectors. Read it to walk them, but add them with AddCompVector only, it also fills
+    // m_compVectorsByTypeIndex.
     unordered_map<GoodId, ComponentVectorBase*> m_compVectorMap;
 
+    EntityRegistry m_entityRegistry;
+
+    // old id -> new id, from the last RebuildEntityRegistry
+    unordered_map<GoodId, GoodId> m_legacyEntityIdRemap;
+
+    uint32_t m_changeTick = 1;
+
+    // the pages of all the comp vectors, shared with the snapshots
+    std::shared_ptr<PagePool> m_pagePool = std::make_shared<PagePool>();
+
+    // see GetSpatialIndex. shared_ptr because SpatialIndex is not complete here.
+    std::shared_ptr<SpatialIndex> m_spatialIndex;
+
 private: 
+    inline ComponentVectorBase* FindCompVector(uint32_t compTypeIndex) const
+    {
+        return compTypeIndex < m_compVectorsByTypeIndex.size() ? m_compVectorsByTypeIndex[compTypeIndex] : nullptr;
+    }
+
+    inline void SetCompVectorByTypeIndex(ComponentVectorBase* comps)
+    {
+        if (comps->m_compTypeIndex >= m_compVectorsByTypeIndex.size())
+        {
+            m_compVectorsByTypeIndex.resize(comps->m_compTypeIndex + 1, nullptr);
+        }
+        m_compVectorsByTypeIndex[comps->m_compTypeIndex] = comps;
+    }
+
+    // the same vectors as m_compVectorMap, at their GetCompTypeIndex. nullptr for the types not in this grid.
+    vector<ComponentVectorBase*> m_compVectorsByTypeIndex;
 
     //inline ComponentVectorBase* GetCompVector(CompTypes compType)
     //{
@@ -378,6 +2029,214 @@ private:
 
 
 
+inline pods::Error GoodHelpers::WriteDelta(const ComponentGrid& baseGrid, const ComponentGrid& newGrid, pods::ResizableOutputBuffer& out)
+{
+    pods::BinarySerializer<pods::ResizableOutputBuffer> serializer(out);
+    PODS_SAFE_CALL(newGrid.m_entityRegistry.WriteDelta(baseGrid.m_entityRegistry, serializer));
+
+    // tags of either grid, a missing one is an empty one
+    vector<GoodId> tagIds;
+    for (const auto& p : newGrid.m_tagMap)
+    {
+        tagIds.push_back(p.first);
+    }
+    for (const auto& p : baseGrid.m_tagMap)
+    {
+        if (!newGrid.m_tagMap.contains(p.first))
+        {
+            tagIds.push_back(p.first);
+        }
+    }
+    PODS_SAFE_CALL(serializer(GOOD(tagIds)));
+
+    const TagVector noTags;
+    vector<GoodId> removedEntities;
+    vector<GoodId> addedEntities;
+    for (GoodId tagId : tagIds)
+    {
+        auto it = newGrid.m_tagMap.find(tagId);
+        auto baseIt = baseGrid.m_tagMap.find(tagId);
+        const TagVector& tags = it != newGrid.m_tagMap.end() ? it->second : noTags;
+        const TagVector& baseTags = baseIt != baseGrid.m_tagMap.end() ? baseIt->second : noTags;
+        removedEntities.clear();
+        addedEntities.clear();
+        CollectMissingEntities(baseTags, tags, removedEntities);
+        CollectMissingEntities(tags, baseTags, addedEntities);
+        PODS_SAFE_CALL(serializer(GOOD(removedEntities), GOOD(addedEntities)));
+    }
+
+    const uint32_t compVectorCount = (uint32_t)newGrid.m_compVectorMap.size();
+    PODS_SAFE_CALL(serializer(GOOD(compVectorCount)));
+    for (const auto& p : newGrid.m_compVectorMap)
+    {
+        auto baseIt = baseGrid.m_compVectorMap.find(p.first);
+        if (baseIt == baseGrid.m_compVectorMap.end())
+        {
+            std::cerr << "error: can't write a delta, the base grid has no " << p.second->GetCompClassNameVirtual() << " comps" << std::endl;
+            return pods::Error::WriteError;
+        }
+        PODS_SAFE_CALL(serializer("compClassId", p.first));
+        PODS_SAFE_CALL(p.second->WriteDelta(*baseIt->second, serializer));
+    }
+    return pods::Error::NoError;
+}
+
+inline pods::Error GoodHelpers::ApplyDelta(ComponentGrid& grid, pods::InputBuffer& in)
+{
+    pods::BinaryDeserializer<pods::InputBuffer> deserializer(in);
+    PODS_SAFE_CALL(grid.m_entityRegistry.ApplyDelta(deserializer));
+
+    vector<GoodId> tagIds;
+    PODS_SAFE_CALL(deserializer(GOOD(tagIds)));
+    vector<GoodId> removedEntities;
+    vector<GoodId> addedEntities;
+    for (GoodId tagId : tagIds)
+    {
+        PODS_SAFE_CALL(deserializer(GOOD(removedEntities), GOOD(addedEntities)));
+        TagVector& tags = grid.GetTags(tagId);
+        tags.RemoveEntityIds(removedEntities);
+        for (GoodId entityId : addedEntities)
+        {
+            tags.AddEntityId(entityId);
+        }
+    }
+
+    uint32_t compVectorCount = 0;
+    PODS_SAFE_CALL(deserializer(GOOD(compVectorCount)));
+    for (uint32_t i = 0; i < compVectorCount; i++)
+    {
+        GoodId compClassId = 0;
+        PODS_SAFE_CALL(deserializer(GOOD(compClassId)));
+        auto it = grid.m_compVectorMap.find(compClassId);
+        if (it == grid.m_compVectorMap.end())
+        {
+            std::cerr << "error: can't apply a delta, the grid has no comp vector for class id " << compClassId << std::endl;
+            return pods::Error::CorruptedArchive;
+        }
+        PODS_SAFE_CALL(it->second->ApplyDelta(deserializer));
+    }
+    return pods::Error::NoError;
+}
+
+
+
+
+// A template entity to spawn copies of: grid.Instantiate(rockPrefab, 10000, rockIds).
+// It's a grid holding just that entity, so it saves and loads like any grid (GoodHelpers::WriteToFile and
+// ReadFromFile), and like any grid it needs its comp vectors before loading:
+//
+// Prefab rockPrefab;
+// rockPrefab.AddCompVectors<PositionComp, RockComp>();
+// rockPrefab.ReadFromFile("data/prefabs/rock");
+//
+// or made in code, rockPrefab.AddComp<RockComp>()->m_size = 3.0f;
+class Prefab
+{
+public:
+    template <class... CompTypes>
+    inline void AddCompVectors()
+    {
+        (AddCompVectorIfMissing<CompTypes>(), ...);
+    }
+
+    // a comp of the template entity, its comp vector is added if needed
+    template <class T>
+    inline T* AddComp()
+    {
+        AddCompVectorIfMissing<T>();
+        return m_grid.AddComp<T>(GetOrCreateEntity());
+    }
+    template <class T>
+    inline T* GetCompIfExists()
+    {
+        return m_entityId != 0 && m_grid.m_compVectorMap.contains(T::GetClassId()) ? m_grid.GetCompIfExists<T>(m_entityId) : nullptr;
+    }
+    inline void AddTag(GoodId tagId)
+    {
+        m_grid.GetTags(tagId).AddEntityId(GetOrCreateEntity());
+    }
+
+    // becomes a copy of an entity of a grid. Add the comp vectors first (AddCompVectors), the comps it
+    // has no vector for are skipped with an error.
+    void CopyFrom(const ComponentGrid& grid, GoodId entityId)
+    {
+        Clear();
+        vector<GoodId> entityIds;
+        m_grid.Instantiate(grid, entityId, 1, entityIds);
+        m_entityId = entityIds[0];
+    }
+
+    pods::Error ReadFromFile(const std::string& filenameWithoutExt, GoodFormat format = GoodFormat::Binary)
+    {
+        Clear();
+        PODS_SAFE_CALL(GoodHelpers::ReadFromFile(m_grid, filenameWithoutExt, format));
+        vector<GoodId> entityIds;
+        for (const auto& p : m_grid.m_compVectorMap)
+        {
+            p.second->GetEntitiesVirtual(entityIds);
+        }
+        for (const auto& p : m_grid.m_tagMap)
+        {
+            entityIds.insert(entityIds.end(), p.second.m_entities.begin(), p.second.m_entities.end());
+        }
+        std::sort(entityIds.begin(), entityIds.end());
+        entityIds.erase(std::unique(entityIds.begin(), entityIds.end()), entityIds.end());
+        if (entityIds.size() != 1)
+        {
+            std::cerr << "error: a prefab holds 1 entity, " << filenameWithoutExt << " has " << entityIds.size() << std::endl;
+            return pods::Error::CorruptedArchive;
+        }
+        m_entityId = entityIds[0];
+        return pods::Error::NoError;
+    }
+    pods::Error WriteToFile(const std::string& filenameWithoutExt, GoodFormat format = GoodFormat::Binary) const
+    {
+        return GoodHelpers::WriteToFile(m_grid, filenameWithoutExt, format);
+    }
+
+    // removes the template entity, the comp vectors stay
+    inline void Clear()
+    {
+        if (m_entityId != 0)
+        {
+            m_grid.DestroyEntity(m_entityId);
+            m_entityId = 0;
+        }
+    }
+
+    inline const ComponentGrid& GetGrid() const { return m_grid; }
+    // 0 while empty
+    inline GoodId GetEntityId() const { return m_entityId; }
+
+private:
+    template <class T>
+    inline void AddCompVectorIfMissing()
+    {
+        if (!m_grid.m_compVectorMap.contains(T::GetClassId()))
+        {
+            m_grid.AddCompVector<T>();
+        }
+    }
+
+    inline GoodId GetOrCreateEntity()
+    {
+        if (m_entityId == 0)
+        {
+            m_entityId = m_grid.CreateEntity();
+        }
+        return m_entityId;
+    }
+
+    ComponentGrid m_grid;
+    GoodId m_entityId = 0;
+};
+
+inline void ComponentGrid::Instantiate(const Prefab& prefab, size_t count, vector<GoodId>& outEntityIds)
+{
+    BOF_ASSERT_MSG(prefab.GetEntityId() != 0, "%s", "instantiating an empty prefab");
+    Instantiate(prefab.GetGrid(), prefab.GetEntityId(), count, outEntityIds);
+}
+
 //#define ADD_COMP(grid, comp, entityId) static_cast<comp*>(grid.AddComp(CompTypes::comp, entityId))
 //#define GET_COMP(grid, comp, entityId) static_cast<comp*>(grid.GetCompIfExists(CompTypes::comp, entityId))
 
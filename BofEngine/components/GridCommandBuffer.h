@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+//
+#include "GoodComponents.h"
+#include "utils/BofAsserts.h"
+#include "utils/JobSystem.h"
+
+
+// Structural changes (create, destroy, add comp, remove comp) recorded now, done later on the grid.
+//
+// Adding or removing comps moves the others around, so it can't happen while something iterates the
+// grid, or from several threads. Record them here instead, from any job of the buffer's JobSystem:
+//
+// GridCommandBuffer commands(jobSystem);
+// grid.View<const PositionComp, HealthComp>().ParallelForEach([&](GoodId entityId, const PositionComp& position, HealthComp& health)
+// {
+//     if (health.m_points <= 0)
+//     {
+//         const GoodId explosion = commands.CreateEntity();
+//         commands.AddComp<PositionComp>(explosion, position);
+//         commands.AddComp<ExplosionComp>(explosion)->m_radius = 3.0f;
+//         commands.DestroyEntity(entityId);
+//     }
+// }, 4096, commands.GetJobSystem()); // the jobs must run on the buffer's JobSystem
+// commands.Playback(grid); // at the sync point, nobody else touches the grid
+//
+// Each thread of the JobSystem records in its own arena (commands + comp storage), so recording never
+// locks or contends. The threads that are not workers of the JobSystem all share arena 0, only one of
+// them can record at a time. A worker of another JobSystem would be one of those, with its siblings
+// recording at the same time: that asserts. The arenas keep their memory between playbacks.
+//
+// CreateEntity returns a pending id: it can be used in the commands of this buffer, not in the grid.
+// Playback makes the real entities first (GetCreatedEntityId tells which), then does the commands sorted by
+// kind, comp type and entity: all the adds of a comp type grow its vector once (ComponentVector::AddEntityIds),
+// all the removes of a comp type are one RemoveEntityIds, all the destroys are one DestroyEntities.
+// So for the same entity, a remove wins over an add and a destroy over everything, whatever the recording order.
+// Adding a comp the entity already has overwrites it. When it's added twice, the last thread index wins, then the
+// last recorded.
+class GridCommandBuffer
+{
+public:
+    // pending ids have this bit, the thread index in the high word and a counter in the low word
+    static constexpr GoodId m_pendingBit = GoodId(1) << 63;
+
+    explicit GridCommandBuffer(Bof::JobSystem& jobSystem) : m_jobSystem(jobSystem)
+    {
+        for (size_t i = 0; i < jobSystem.GetThreadCount(); i++)
+        {
+            m_arenas.push_back(std::make_unique<Arena>());
+            m_arenas.back()->m_threadIndex = (uint32_t)i;
+        }
+    }
+
+    GridCommandBuffer(const GridCommandBuffer&) = delete;
+    GridCommandBuffer& operator=(const GridCommandBuffer&) = delete;
+
+    ~GridCommandBuffer()
+    {
+        Clear();
+    }
+
+    inline Bof::JobSystem& GetJobSystem() const { return m_jobSystem; }
+
+    static inline bool IsPendingEntityId(GoodId entityId) { return (entityId & m_pendingBit) != 0; }
+
+    inline GoodId CreateEntity()
+    {
+        Arena& arena = GetArena();
+        return m_pendingBit | ((GoodId)arena.m_threadIndex << 32) | arena.m_createdEntityCount++;
+    }
+
+    // the comp is constructed with args in the arena, the returned pointer can be used to fill it until Playback
+    template <class T, typename... Args>
+    inline T* AddComp(GoodId entityId, Args&&... args)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over aligned comps are not supported by the arenas");
+        Arena& arena = GetArena();
+        T* comp = std::construct_at(static_cast<T*>(arena.Allocate(sizeof(T), alignof(T))), std::forward<Args>(args)...);
+        Command& command = arena.PushCommand(CommandKind::AddComp, entityId);
+        command.m_classId = T::GetClassId();
+        command.m_comp = comp;
+        command.m_compOps = &GetCompOps<T>();
+        return comp;
+    }
+
+    template <class T>
+    inline void RemoveComp(GoodId entityId)
+    {
+        GetArena().PushCommand(CommandKind::RemoveComp, entityId).m_classId = T::GetClassId();
+    }
+
+    inline void DestroyEntity(GoodId entityId)
+    {
+        GetArena().PushCommand(CommandKind::DestroyEntity, entityId);
+    }
+
+    inline bool IsEmpty() const
+    {
+        for (const std::unique_ptr<Arena>& arena : m_arenas)
+        {
+            if (!arena->m_commands.empty() || arena->m_createdEntityCount != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline size_t GetCommandCount() const
+    {
+        size_t count = 0;
+        for (const std::unique_ptr<Arena>& arena : m_arenas)
+        {
+            count += arena->m_commands.size();
+        }
+        return count;
+    }
+
+    // Does everything that was recorded, then clears. Call it when nothing else uses the grid or this buffer.
+    void Playback(ComponentGrid& grid)
+    {
+        if (IsEmpty())
+        {
+            return;
+        }
+
+        // the real ids of the pending entities, arena by arena
+        size_t createdEntityCount = 0;
+        m_firstCreatedEntityIndices.clear();
+        for (const std::unique_ptr<Arena>& arena : m_arenas)
+        {
+            m_firstCreatedEntityIndices.push_back((uint32_t)createdEntityCount);
+            createdEntityCount += arena->m_createdEntityCount;
+        }
+        m_createdEntityIds = grid.CreateEntities(createdEntityCount);
+
+        // bucketed by kind and comp type, in arena order so that the later commands come after
+        for (CommandGroup& group : m_groups)
+        {
+            group.m_commands.clear();
+        }
+        for (const std::unique_ptr<Arena>& arena : m_arenas)
+        {
+            CommandGroup* group = nullptr;
+            for (const Command& command : arena->m_commands)
+            {
+                if (group == nullptr || group->m_kind != command.m_kind || group->m_classId != command.m_classId)
+                {
+                    group = &GetGroup(command);
+                }
+                group->m_commands.push_back(SortedCommand{ GetCreatedEntityId(command.m_entityId), (uint32_t)group->m_commands.size(), command.m_comp });
+            }
+        }
+        std::sort(m_groups.begin(), m_groups.end(), [](const CommandGroup& a, const CommandGroup& b)
+        {
+            return std::tie(a.m_kind, a.m_classId) < std::tie(b.m_kind, b.m_classId);
+        });
+
+        for (CommandGroup& group : m_groups)
+        {
+            if (group.m_commands.empty())
+            {
+                continue;
+            }
+            // by entity, so the result doesn't depend on which thread recorded what
+            std::sort(group.m_commands.begin(), group.m_commands.end(), [](const SortedCommand& a, const SortedCommand& b)
+            {
+                return std::tie(a.m_entityId, a.m_order) < std::tie(b.m_entityId, b.m_order);
+            });
+
+            switch (group.m_kind)
+            {
+            case CommandKind::AddComp:
+                group.m_compOps->m_applyAdds(grid, group.m_commands);
+                break;
+            case CommandKind::RemoveComp:
+            {
+                auto it = grid.m_compVectorMap.find(group.m_classId);
+                BOF_ASSERT_MSG(it != grid.m_compVectorMap.end(), "%s", "removing a comp that has no comp vector in the grid");
+                GetUniqueEntityIds(group.m_commands, m_entityIds);
+                it->second->RemoveEntityIdsVirtual(m_entityIds);
+                break;
+            }
+            case CommandKind::DestroyEntity:
+                GetUniqueEntityIds(group.m_commands, m_entityIds);
+                grid.DestroyEntities(m_entityIds);
+                break;
+            }
+        }
+
+        Clear();
+    }
+
+    // Forgets everything that was recorded.
+    void Clear()
+    {
+        for (std::unique_ptr<Arena>& arena : m_arenas)
+        {
+            arena->Clear();
+        }
+    }
+
+    // The grid id of an entity made with CreateEntity, after Playback and until the next one.
+    // Ids that are not pending are returned as is.
+    inline GoodId GetCreatedEntityId(GoodId entityId) const
+    {
+        if (!IsPendingEntityId(entityId))
+        {
+            return entityId;
+        }
+        const uint32_t threadIndex = (uint32_t)((entityId & ~m_pendingBit) >> 32);
+        const size_t index = m_firstCreatedEntityIndices[threadIndex] + (uint32_t)entityId;
+        BOF_ASSERT_MSG(index < m_createdEntityIds.size(), "%s", "pending entity id of another playback");
+        return m_createdEntityIds[index];
+    }
+
+private:
+    enum class CommandKind : uint8_t
+    {
+        // the playback order
+        AddComp,
+        RemoveComp,
+        DestroyEntity,
+    };
+
+    // the part of a command Playback sorts, m_order is the recording order in the group
+    struct SortedCommand
+    {
+        GoodId m_entityId = 0;
+        uint32_t m_order = 0;
+        void* m_comp = nullptr;
+    };
+
+    // what Playback needs to know about a comp type
+    struct CompOps
+    {
+        void (*m_applyAdds)(ComponentGrid& grid, span<const SortedCommand> commands);
+        void (*m_destroy)(void* comp);
+    };
+
+    struct Command
+    {
+        CommandKind m_kind = CommandKind::AddComp;
+        GoodId m_entityId = 0;
+        GoodId m_classId = 0;
+        void* m_comp = nullptr;
+        const CompOps* m_compOps = nullptr;
+    };
+
+    // the commands of one kind and comp type (0 for destroys). Kept between playbacks, with their memory.
+    struct CommandGroup
+    {
+        CommandKind m_kind = CommandKind::AddComp;
+        GoodId m_classId = 0;
+        const CompOps* m_compOps = nullptr;
+        vector<SortedCommand> m_commands;
+    };
+
+    // commands and comps of one thread. Aligned so that two threads never write the same cache line.
+    struct alignas(64) Arena
+    {
+        static constexpr size_t m_blockByteSize = 64 * 1024;
+
+        struct Block
+        {
+            std::unique_ptr<std::max_align_t[]> m_data;
+            size_t m_byteSize = 0;
+        };
+
+        std::vector<Command> m_commands;
+        std::vector<Block> m_blocks;
+        size_t m_blockIndex = 0;
+        size_t m_blockOffset = 0;
+        uint32_t m_createdEntityCount = 0;
+        uint32_t m_threadIndex = 0;
+
+        inline Command& PushCommand(CommandKind kind, GoodId entityId)
+        {
+            Command& command = m_commands.emplace_back();
+            command.m_kind = kind;
+            command.m_entityId = entityId;
+            return command;
+        }
+
+        // bump allocation in the current block, the blocks are kept for the next frames
+        void* Allocate(size_t byteSize, size_t alignment)
+        {
+            while (true)
+            {
+                if (m_blockIndex == m_blocks.size())
+                {
+                    Block& block = m_blocks.emplace_back();
+                    block.m_byteSize = std::max(byteSize, m_blockByteSize);
+                    block.m_data = std::make_unique<std::max_align_t[]>((block.m_byteSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+                }
+                Block& block = m_blocks[m_blockIndex];
+                const size_t offset = (m_blockOffset + alignment - 1) / alignment * alignment;
+                if (offset + byteSize <= block.m_byteSize)
+                {
+                    m_blockOffset = offset + byteSize;
+                    return reinterpret_cast<std::byte*>(block.m_data.get()) + offset;
+                }
+                m_blockIndex++;
+                m_blockOffset = 0;
+            }
+        }
+
+        void Clear()
+        {
+            for (const Command& command : m_commands)
+            {
+                if (command.m_kind == CommandKind::AddComp)
+                {
+                    command.m_compOps->m_destroy(command.m_comp);
+                }
+            }
+            m_commands.clear();
+            m_blockIndex = 0;
+            m_blockOffset = 0;
+            m_createdEntityCount = 0;
+        }
+    };
+
+    template <class T>
+    static const CompOps& GetCompOps()
+    {
+        static const CompOps s_compOps = { &ApplyAdds<T>, &DestroyComp<T> };
+        return s_compOps;
+    }
+
+    template <class T>
+    static void DestroyComp(void* comp)
+    {
+        std::destroy_at(static_cast<T*>(comp));
+    }
+
+    // commands are sorted by entity, then recording order: the last one of an entity wins
+    template <class T>
+    static void ApplyAdds(ComponentGrid& grid, span<const SortedCommand> commands)
+    {
+        ComponentVector<T>* comps = grid.GetComps<T>();
+        vector<GoodId> newEntityIds;
+        vector<T*> newComps;
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            if (i + 1 < commands.size() && commands[i + 1].m_entityId == commands[i].m_entityId)
+            {
+                continue;
+            }
+            T* comp = static_cast<T*>(commands[i].m_comp);
+            if (T* existingComp = comps->GetCompIfExists(commands[i].m_entityId))
+            {
+                MoveComp(*existingComp, *comp);
+            }
+            else
+            {
+                newEntityIds.push_back(commands[i].m_entityId);
+                newComps.push_back(comp);
+            }
+        }
+        const size_t firstIndex = comps->AddEntityIds(newEntityIds);
+        for (size_t i = 0; i < newComps.size(); i++)
+        {
+            MoveComp(comps->GetCompAtIndex(firstIndex + i), *newComps[i]);
+        }
+    }
+
+    // same as ComponentVector::MoveComp, comps may only have a move constructor
+    template <class T>
+    static inline void MoveComp(T& dest, T& src)
+    {
+        if constexpr (std::is_move_assignable_v<T>)
+        {
+            dest = std::move(src);
+        }
+        else
+        {
+            std::destroy_at(&dest);
+            std::construct_at(&dest, std::move(src));
+        }
+    }
+
+    // commands are sorted by entity
+    static void GetUniqueEntityIds(span<const SortedCommand> commands, vector<GoodId>& outEntityIds)
+    {
+        outEntityIds.clear();
+        for (const SortedCommand& command : commands)
+        {
+            if (outEntityIds.empty() || outEntityIds.back() != command.m_entityId)
+            {
+                outEntityIds.push_back(command.m_entityId);
+            }
+        }
+    }
+
+    // a handful of kinds and comp types, a linear search is fine
+    CommandGroup& GetGroup(const Command& command)
+    {
+        for (CommandGroup& group : m_groups)
+        {
+            if (group.m_kind == command.m_kind && group.m_classId == command.m_classId)
+            {
+                return group;
+            }
+        }
+        CommandGroup& group = m_groups.emplace_back();
+        group.m_kind = command.m_kind;
+        group.m_classId = command.m_classId;
+        group.m_compOps = command.m_compOps;
+        return group;
+    }
+
+    inline Arena& GetArena()
+    {
+        BOF_ASSERT_MSG(!m_jobSystem.IsWorkerOfAnotherJobSystem(), "%s",
+            "recording from a worker of another JobSystem: its workers would all share arena 0");
+        return *m_arenas[m_jobSystem.GetThreadIndex()];
+    }
+
+    Bof::JobSystem& m_jobSystem;
+    vector<std::unique_ptr<Arena>> m_arenas;
+
+    vector<CommandGroup> m_groups;
+    vector<GoodId> m_entityIds;
+
+    // filled by Playback, see GetCreatedEntityId
+    vector<GoodId> m_createdEntityIds;
+    vector<uint32_t> m_firstCreatedEntityIndices;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+//
+#include "GoodComponents.h"
+
+
+// ComponentGrid::Reorder / SortBy spread over several frames, for grids too big to reorder in one go.
+//
+// if (m_reorder.IsDone())
+// {
+//     m_reorder.StartSortBy<PositionComp, VelocityComp>(grid, [](const PositionComp& p) { return Bof::MortonCode(p.m_position, worldMin, 4.0f); });
+// }
+// m_reorder.Step(grid, 10000);
+//
+// Start takes the order once (a sort of the T comps), each Step moves at most maxEntityCount entities of
+// every comp vector of the group into place, by swaps. The grid is valid between steps and can change:
+// entities made after Start stay after the ordered ones, dead ones are skipped.
+// Don't add comp vectors to the grid while a reorder of every vector is running.
+class GridReorder
+{
+public:
+    template <class T, class... GroupComps, typename Less>
+    void Start(ComponentGrid& grid, Less&& less)
+    {
+        std::as_const(*grid.GetComps<T>()).GetSortedEntities(less, m_orderedEntities);
+        StartGroup<T, GroupComps...>(grid);
+    }
+
+    template <class T, class... GroupComps, typename Key>
+    void StartSortBy(ComponentGrid& grid, Key&& key)
+    {
+        std::as_const(*grid.GetComps<T>()).GetEntitiesSortedBy(key, m_orderedEntities);
+        StartGroup<T, GroupComps...>(grid);
+    }
+
+    // returns true when done
+    bool Step(ComponentGrid& grid, size_t maxEntityCount)
+    {
+        bool isDone = true;
+        for (size_t i = 0; i < m_compClassIds.size(); i++)
+        {
+            auto it = grid.m_compVectorMap.find(m_compClassIds[i]);
+            BOF_ASSERT_MSG(it != grid.m_compVectorMap.end(), "%s", "comp vector removed during a reorder");
+            isDone &= it->second->ReorderStepVirtual(m_orderedEntities, m_cursors[i], maxEntityCount);
+        }
+        if (isDone)
+        {
+            Cancel();
+        }
+        return isDone;
+    }
+
+    inline bool IsDone() const { return m_compClassIds.empty(); }
+
+    inline void Cancel()
+    {
+        m_orderedEntities.clear();
+        m_compClassIds.clear();
+        m_cursors.clear();
+    }
+
+private:
+    template <class T, class... GroupComps>
+    void StartGroup(ComponentGrid& grid)
+    {
+        m_compClassIds.clear();
+        if constexpr (sizeof...(GroupComps) == 0)
+        {
+            for (auto& p : grid.m_compVectorMap)
+            {
+                m_compClassIds.push_back(p.first);
+            }
+        }
+        else
+        {
+            m_compClassIds = { T::GetClassId(), GroupComps::GetClassId()... };
+        }
+        m_cursors.assign(m_compClassIds.size(), VectorReorderCursor());
+    }
+
+    vector<GoodId> m_orderedEntities;
+    vector<GoodId> m_compClassIds;
+    vector<VectorReorderCursor> m_cursors;
+};
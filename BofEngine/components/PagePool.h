@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+//
+#include "utils/BofAsserts.h"
+
+
+struct PagePoolStats
+{
+    size_t m_reservedBytes = 0; // the chunks taken from the system
+    size_t m_usedBytes = 0; // the slots given out
+    size_t m_freeBytes = 0; // free slots in the chunks, waiting for a page of their size
+    size_t m_chunkCount = 0;
+    size_t m_sizeClassCount = 0;
+    size_t m_oversizedBytes = 0; // too big or too aligned for a chunk, straight from the system
+};
+
+
+// The memory of the pages of the PagedVectors of a ComponentGrid.
+//
+// Pages are taken in chunks of ~1MB from the system, cut in slots of one page size (one size class per
+// distinct page size, there are a handful). A page freed (entities removed, page cloned by a snapshot
+// and dropped...) goes back to the free slots of its size and is reused by the next page of that size,
+// of any comp type. Chunks are only given back to the system when the pool dies, which is when the grid
+// and every snapshot and PagedVector using it are gone (the pages hold the pool, see PagePoolAllocator).
+//
+// Pages never move, so growing a comp vector never copies comps, it takes a slot.
+// Thread safe, pages are cloned from ParallelForEach workers when they are shared with a snapshot.
+class PagePool
+{
+public:
+    static constexpr size_t m_chunkByteSize = 1024 * 1024;
+    static constexpr size_t m_slotAlignment = 64;
+
+    PagePool() = default;
+    PagePool(const PagePool&) = delete;
+    PagePool& operator=(const PagePool&) = delete;
+
+    ~PagePool()
+    {
+        BOF_ASSERT_MSG(m_usedBytes == 0, "%s", "page pool destroyed with pages still in use");
+        for (const Chunk& chunk : m_chunks)
+        {
+            ::operator delete(chunk.m_memory, std::align_val_t(m_slotAlignment));
+        }
+    }
+
+    void* Allocate(size_t byteSize, size_t alignment)
+    {
+        if (alignment > m_slotAlignment || byteSize > m_chunkByteSize)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_oversizedBytes += byteSize;
+            return ::operator new(byteSize, std::align_val_t(std::max(alignment, m_slotAlignment)));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        SizeClass& sizeClass = GetSizeClass(GetSlotByteSize(byteSize));
+        if (sizeClass.m_freeSlots.empty())
+        {
+            AddChunk(sizeClass);
+        }
+        void* slot = sizeClass.m_freeSlots.back();
+        sizeClass.m_freeSlots.pop_back();
+        m_usedBytes += sizeClass.m_slotByteSize;
+        return slot;
+    }
+
+    void Free(void* memory, size_t byteSize, size_t alignment)
+    {
+        if (alignment > m_slotAlignment || byteSize > m_chunkByteSize)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_oversizedBytes -= byteSize;
+            ::operator delete(memory, std::align_val_t(std::max(alignment, m_slotAlignment)));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        SizeClass& sizeClass = GetSizeClass(GetSlotByteSize(byteSize));
+        sizeClass.m_freeSlots.push_back(memory);
+        m_usedBytes -= sizeClass.m_slotByteSize;
+    }
+
+    PagePoolStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        PagePoolStats stats;
+        for (const Chunk& chunk : m_chunks)
+        {
+            stats.m_reservedBytes += chunk.m_byteSize;
+        }
+        stats.m_usedBytes = m_usedBytes;
+        stats.m_freeBytes = stats.m_reservedBytes - m_usedBytes;
+        stats.m_chunkCount = m_chunks.size();
+        stats.m_sizeClassCount = m_sizeClasses.size();
+        stats.m_oversizedBytes = m_oversizedBytes;
+        return stats;
+    }
+
+    static constexpr size_t GetSlotByteSize(size_t byteSize)
+    {
+        return (byteSize + m_slotAlignment - 1) / m_slotAlignment * m_slotAlignment;
+    }
+
+private:
+    struct SizeClass
+    {
+        size_t m_slotByteSize = 0;
+        std::vector<void*> m_freeSlots;
+    };
+    struct Chunk
+    {
+        void* m_memory = nullptr;
+        size_t m_byteSize = 0;
+    };
+
+    // a handful of sizes, a linear search is fine
+    SizeClass& GetSizeClass(size_t slotByteSize)
+    {
+        for (SizeClass& sizeClass : m_sizeClasses)
+        {
+            if (sizeClass.m_slotByteSize == slotByteSize)
+            {
+                return sizeClass;
+            }
+        }
+        SizeClass& sizeClass = m_sizeClasses.emplace_back();
+        sizeClass.m_slotByteSize = slotByteSize;
+        return sizeClass;
+    }
+
+    void AddChunk(SizeClass& sizeClass)
+    {
+        const size_t slotCount = m_chunkByteSize / sizeClass.m_slotByteSize;
+        Chunk chunk;
+        chunk.m_byteSize = slotCount * sizeClass.m_slotByteSize;
+        chunk.m_memory = ::operator new(chunk.m_byteSize, std::align_val_t(m_slotAlignment));
+        m_chunks.push_back(chunk);
+
+        // backwards, so that pages are given in address order
+        std::byte* memory = static_cast<std::byte*>(chunk.m_memory);
+        for (size_t i = slotCount; i > 0; i--)
+        {
+            sizeClass.m_freeSlots.push_back(memory + (i - 1) * sizeClass.m_slotByteSize);
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<SizeClass> m_sizeClasses;
+    std::vector<Chunk> m_chunks;
+    size_t m_usedBytes = 0;
+    size_t m_oversizedBytes = 0;
+};
+
+
+// For std::allocate_shared of the pages. Holds the pool, so the pool lives as long as its last page.
+template <typename T>
+class PagePoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PagePoolAllocator(std::shared_ptr<PagePool> pool) : m_pool(std::move(pool)) {}
+    template <typename U>
+    PagePoolAllocator(const PagePoolAllocator<U>& other) : m_pool(other.m_pool) {}
+
+    inline T* allocate(size_t count)
+    {
+        return static_cast<T*>(m_pool->Allocate(count * sizeof(T), alignof(T)));
+    }
+    inline void deallocate(T* memory, size_t count)
+    {
+        m_pool->Free(memory, count * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    inline bool operator==(const PagePoolAllocator<U>& other) const { return m_pool == other.m_pool; }
+
+    std::shared_ptr<PagePool> m_pool;
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+//
+#include "utils/BofAsserts.h"
+#include "PagePool.h"
+
+
+// A vector cut in fixed size pages, with copy on write pages.
+//
+// Copying a PagedVector doesn't copy the elements, the copy shares all the pages, it's one refcount
+// increment per page. The first write to a shared page (through operator[], back, push_back...) clones
+// that page only. This is what makes ComponentGrid::Snapshot cheap: a 100k comps vector is a few hundred
+// pages, and between two snapshots most of them are not written.
+//
+// Reading through a const PagedVector never copies. Writing through a non const one checks if the page
+// is shared first, so prefer const access in loops that only read.
+//
+// Elements are not contiguous, there is no data(). Each page is.
+// Element references stay valid when the vector grows (pages don't move), until the page gets cloned.
+// Only copyable types can actually be shared, for the others copying the vector asserts.
+//
+// Pages come from the PagePool given to SetPagePool (the grid's one for comp vectors), or the heap.
+// Copies get the same pool. Assigning keeps the pool of the destination, unless it has none.
+template <typename T, size_t PageByteSize = 16 * 1024>
+class PagedVector
+{
+public:
+    static constexpr size_t m_pageShift = []()
+    {
+        size_t shift = 0;
+        while (((size_t)2 << shift) * sizeof(T) <= PageByteSize)
+        {
+            shift++;
+        }
+        return shift;
+    }();
+    static constexpr size_t m_pageCapacity = (size_t)1 << m_pageShift;
+    static constexpr size_t m_pageMask = m_pageCapacity - 1;
+
+    PagedVector() = default;
+
+    // shares all the pages
+    PagedVector(const PagedVector& other) : m_pages(other.m_pages), m_size(other.m_size), m_pagePool(other.m_pagePool)
+    {
+        BOF_ASSERT_MSG(std::is_copy_constructible_v<T> || m_size == 0, "%s", "can't share pages of a type that can't be copied");
+    }
+    PagedVector& operator=(const PagedVector& other)
+    {
+        BOF_ASSERT_MSG(std::is_copy_constructible_v<T> || other.m_size == 0, "%s", "can't share pages of a type that can't be copied");
+        m_pages = other.m_pages;
+        m_size = other.m_size;
+        if (!m_pagePool)
+        {
+            m_pagePool = other.m_pagePool;
+        }
+        return *this;
+    }
+    // the moved from vector keeps its pool
+    PagedVector(PagedVector&& other) noexcept : m_pages(std::move(other.m_pages)), m_size(other.m_size), m_pagePool(other.m_pagePool)
+    {
+        other.m_size = 0;
+    }
+    PagedVector& operator=(PagedVector&& other) noexcept
+    {
+        m_pages = std::move(other.m_pages);
+        m_size = other.m_size;
+        other.m_size = 0;
+        if (!m_pagePool)
+        {
+            m_pagePool = other.m_pagePool;
+        }
+        return *this;
+    }
+
+    inline size_t size() const { return m_size; }
+    inline bool empty() const { return m_size == 0; }
+
+    inline const T& operator[](size_t index) const
+    {
+        return m_pages[index >> m_pageShift]->m_items[index & m_pageMask];
+    }
+    inline T& operator[](size_t index)
+    {
+        return GetMutablePage(index >> m_pageShift).m_items[index & m_pageMask];
+    }
+
+    inline const T& back() const { return (*this)[m_size - 1]; }
+    inline T& back() { return (*this)[m_size - 1]; }
+
+    template <typename... Args>
+    inline T& emplace_back(Args&&... args)
+    {
+        const size_t pageIndex = m_size >> m_pageShift;
+        if (pageIndex == m_pages.size())
+        {
+            m_pages.push_back(NewPage());
+        }
+        Page& page = GetMutablePage(pageIndex);
+        T* item = std::construct_at(&page.m_items[page.m_count], std::forward<Args>(args)...);
+        page.m_count++;
+        m_size++;
+        return *item;
+    }
+    inline void push_back(const T& value) { emplace_back(value); }
+    inline void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    inline void pop_back()
+    {
+        const size_t pageIndex = (m_size - 1) >> m_pageShift;
+        if ((m_size & m_pageMask) == 1 || m_pageCapacity == 1)
+        {
+            // last element of the page, drop the page instead of cloning it
+            m_pages.pop_back();
+        }
+        else
+        {
+            Page& page = GetMutablePage(pageIndex);
+            page.m_count--;
+            std::destroy_at(&page.m_items[page.m_count]);
+        }
+        m_size--;
+    }
+
+    void resize(size_t newSize)
+    {
+        while (m_size > newSize)
+        {
+            pop_back();
+        }
+        AppendPageByPage(newSize - m_size, [](T* item) { std::construct_at(item); });
+    }
+
+    // grows with copies of value. Trivially copyable values are copied by blocks (see AppendCopiesByBlocks).
+    void resize(size_t newSize, const T& value)
+    {
+        while (m_size > newSize)
+        {
+            pop_back();
+        }
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+            AppendCopiesByBlocks(newSize - m_size, value);
+        }
+        else
+        {
+            AppendPageByPage(newSize - m_size, [&value](T* item) { std::construct_at(item, value); });
+        }
+    }
+
+    template <typename Iterator>
+    void append(Iterator first, Iterator last)
+    {
+        AppendPageByPage((size_t)std::distance(first, last), [&first](T* item) { std::construct_at(item, *first++); });
+    }
+
+    void assign(size_t count, const T& value)
+    {
+        clear();
+        resize(count, value);
+    }
+
+    inline void clear()
+    {
+        m_pages.clear();
+        m_size = 0;
+    }
+
+    inline void reserve(size_t count)
+    {
+        m_pages.reserve((count + m_pageCapacity - 1) >> m_pageShift);
+    }
+
+    // number of pages not shared with another PagedVector (snapshots...)
+    inline size_t GetUniquePageCount() const
+    {
+        size_t count = 0;
+        for (const std::shared_ptr<Page>& page : m_pages)
+        {
+            count += page.use_count() == 1 ? 1 : 0;
+        }
+        return count;
+    }
+    // clones now the pages shared with another PagedVector, so that the writes that follow don't.
+    // Before threads write different elements of the same page: two of them could clone it at the same time.
+    inline void MakePagesUnique()
+    {
+        for (size_t i = 0; i < m_pages.size(); i++)
+        {
+            GetMutablePage(i);
+        }
+    }
+    // func(size_t begin, size_t end) for the element ranges of the pages that are not the same page in other:
+    // written (so cloned) or added since they were shared, or not there in other. A page shared is the same
+    // elements in both, so what is not reported is equal.
+    template <typename Func>
+    inline void ForEachPageNotSharedWith(const PagedVector& other, Func&& func) const
+    {
+        for (size_t i = 0; i < m_pages.size(); i++)
+        {
+            if (i >= other.m_pages.size() || m_pages[i] != other.m_pages[i])
+            {
+                func(i << m_pageShift, std::min(m_size, (i + 1) << m_pageShift));
+            }
+        }
+    }
+    inline size_t GetPageCount() const { return m_pages.size(); }
+    // the bytes of one page, as allocated
+    static constexpr size_t GetPageByteSize() { return sizeof(Page); }
+    inline size_t GetMemoryUsage() const { return m_pages.size() * sizeof(Page) + m_pages.capacity() * sizeof(std::shared_ptr<Page>); }
+
+    // for the pages made from now on, the ones already there stay where they are
+    inline void SetPagePool(std::shared_ptr<PagePool> pagePool) { m_pagePool = std::move(pagePool); }
+    inline const std::shared_ptr<PagePool>& GetPagePool() const { return m_pagePool; }
+
+    // good enough iterators for range for, std algorithms and the pods serializer
+    template <typename VectorType, typename ValueType>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<ValueType>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = ValueType*;
+        using reference = ValueType&;
+
+        Iterator(VectorType* vector, size_t index) : m_vector(vector), m_index(index) {}
+
+        inline ValueType& operator*() const { return (*m_vector)[m_index]; }
+        inline ValueType* operator->() const { return &(*m_vector)[m_index]; }
+        inline Iterator& operator++() { m_index++; return *this; }
+        inline Iterator operator++(int) { Iterator previous = *this; m_index++; return previous; }
+        inline bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        inline bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        VectorType* m_vector;
+        size_t m_index;
+    };
+    using iterator = Iterator<PagedVector, T>;
+    using const_iterator = Iterator<const PagedVector, const T>;
+
+    inline iterator begin() { return iterator(this, 0); }
+    inline iterator end() { return iterator(this, m_size); }
+    inline const_iterator begin() const { return const_iterator(this, 0); }
+    inline const_iterator end() const { return const_iterator(this, m_size); }
+    inline const_iterator cbegin() const { return const_iterator(this, 0); }
+    inline const_iterator cend() const { return const_iterator(this, m_size); }
+
+private:
+    struct Page
+    {
+        Page() {}
+        Page(const Page& other)
+        {
+            if constexpr (std::is_copy_constructible_v<T>)
+            {
+                for (uint32_t i = 0; i < other.m_count; i++)
+                {
+                    std::construct_at(&m_items[i], other.m_items[i]);
+                }
+                m_count = other.m_count;
+            }
+            else
+            {
+                BOF_FAIL("%s", "can't clone a page of a type that can't be copied");
+            }
+        }
+        Page& operator=(const Page&) = delete;
+        ~Page()
+        {
+            for (uint32_t i = 0; i < m_count; i++)
+            {
+                std::destroy_at(&m_items[i]);
+            }
+        }
+
+        // raw storage, only the m_count first ones are alive
+        union
+        {
+            T m_items[m_pageCapacity];
+        };
+        uint32_t m_count = 0;
+    };
+
+    // constructs count items at the end with construct(item), one page lookup per page instead of one per item
+    template <typename Construct>
+    void AppendPageByPage(size_t count, Construct&& construct)
+    {
+        reserve(m_size + count);
+        size_t constructedCount = 0;
+        while (constructedCount < count)
+        {
+            const size_t pageIndex = m_size >> m_pageShift;
+            if (pageIndex == m_pages.size())
+            {
+                m_pages.push_back(NewPage());
+            }
+            Page& page = GetMutablePage(pageIndex);
+            const size_t pageCount = std::min<size_t>(count - constructedCount, m_pageCapacity - page.m_count);
+            for (size_t i = 0; i < pageCount; i++)
+            {
+                construct(&page.m_items[page.m_count]);
+                page.m_count++;
+            }
+            constructedCount += pageCount;
+            m_size += pageCount;
+        }
+    }
+
+    // a new empty page, or a clone of page
+    template <typename... Args>
+    inline std::shared_ptr<Page> NewPage(Args&&... args)
+    {
+        if (m_pagePool)
+        {
+            return std::allocate_shared<Page>(PagePoolAllocator<Page>(m_pagePool), std::forward<Args>(args)...);
+        }
+        return std::make_shared<Page>(std::forward<Args>(args)...);
+    }
+
+    // count copies of value at the end: the first page is filled by doubling memcpys, the next full ones
+    // are one memcpy of the first
+    void AppendCopiesByBlocks(size_t count, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        reserve(m_size + count);
+        const T* fullBlock = nullptr;
+        size_t fullBlockCount = 0;
+        size_t constructedCount = 0;
+        while (constructedCount < count)
+        {
+            const size_t pageIndex = m_size >> m_pageShift;
+            if (pageIndex == m_pages.size())
+            {
+                m_pages.push_back(NewPage());
+            }
+            Page& page = GetMutablePage(pageIndex);
+            const size_t pageCount = std::min<size_t>(count - constructedCount, m_pageCapacity - page.m_count);
+            T* items = &page.m_items[page.m_count];
+            if (fullBlockCount >= pageCount)
+            {
+                std::memcpy(items, fullBlock, pageCount * sizeof(T));
+            }
+            else
+            {
+                std::memcpy(items, &value, sizeof(T));
+                for (size_t copiedCount = 1; copiedCount < pageCount; )
+                {
+                    const size_t blockCount = std::min(copiedCount, pageCount - copiedCount);
+                    std::memcpy(items + copiedCount, items, blockCount * sizeof(T));
+                    copiedCount += blockCount;
+                }
+                fullBlock = items;
+                fullBlockCount = pageCount;
+            }
+            page.m_count += (uint32_t)pageCount;
+            constructedCount += pageCount;
+            m_size += pageCount;
+        }
+    }
+
+    inline Page& GetMutablePage(size_t pageIndex)
+    {
+        std::shared_ptr<Page>& page = m_pages[pageIndex];
+        if (page.use_count() != 1)
+        {
+            page = NewPage(*page);
+        }
+        return *page;
+    }
+
+    std::vector<std::shared_ptr<Page>> m_pages;
+    size_t m_size = 0;
+    std::shared_ptr<PagePool> m_pagePool;
+};
@@ -1,16 +1,29 @@
 #pragma once
 
+#include <bit>
+#include <array>
+#include <algorithm>
+#include <climits>
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <memory>
+#include <functional>
 //
 #include "GoodComponents.h"
-#include "ringbuffer.h"
+#include "utils/RingBuffer.h"
+#include "utils/Timer.h"
 
 using namespace std;
 
 static constexpr int m_ringBufferSize = 100;
 
+// how many ticks back a late input can still be applied, there is a snapshot of the state for each of them
+static constexpr int m_rollbackFrameCount = 32;
+static_assert(m_rollbackFrameCount < m_ringBufferSize, "the inputs of the rollback frames must still be in the ring");
+
+// players are in slots, a bit each in PlayerInputs::m_reportedMask
+static constexpr int m_maxPlayerCount = 64;
+
 class PlayerInput : public GoodSerializable
 {
 public:
@@ -28,12 +41,60 @@ public:
         , GOOD(m_someOtherInput)
     );
 
+    // operator== serializes both (GoodHelpers::AreEqual), which allocates on the receive path.
+    // Field by field instead, add the new fields here.
+    bool IsSameInput(const PlayerInput& other) const
+    {
+        return m_playerEntityId == other.m_playerEntityId
+            && m_frameIndex == other.m_frameIndex
+            && m_someInput == other.m_someInput
+            && m_someOtherInput == other.m_someOtherInput;
+    }
+
 };
 
+// The inputs of all the players for one frame, by player slot (see Simulation::AddPlayer).
+// A fixed array and a bit per player that reported: nothing to allocate, clearing it is resetting the mask.
+//
+//  inputs.ForEach([](int slot, const PlayerInput& input) {...}); // the players that reported, in slot order
 class PlayerInputs
 {
 public:
-    unordered_map<GoodId, PlayerInput> m_playerInputForEntityId;
+    static_assert(m_maxPlayerCount <= 64, "one bit per player in a uint64_t");
+
+    bool HasInput(int slot) const { return (m_reportedMask >> slot) & 1; }
+
+    const PlayerInput& GetInput(int slot) const
+    {
+        BOF_ASSERT_MSG(HasInput(slot), "no input for player slot %d", slot);
+        return m_inputs[slot];
+    }
+
+    void SetInput(int slot, const PlayerInput& input)
+    {
+        m_inputs[slot] = input;
+        m_reportedMask |= uint64_t(1) << slot;
+    }
+
+    void Clear() { m_reportedMask = 0; }
+
+    uint64_t GetReportedMask() const { return m_reportedMask; }
+    int GetReportedCount() const { return std::popcount(m_reportedMask); }
+    bool IsEmpty() const { return m_reportedMask == 0; }
+
+    template <class Func>
+    void ForEach(Func&& func) const
+    {
+        for (uint64_t mask = m_reportedMask; mask != 0; mask &= mask - 1)
+        {
+            const int slot = std::countr_zero(mask);
+            func(slot, m_inputs[slot]);
+        }
+    }
+
+private:
+    std::array<PlayerInput, m_maxPlayerCount> m_inputs;
+    uint64_t m_reportedMask = 0;
 
 };
 
@@ -45,39 +106,202 @@ public:
 };
 
 
+// What the rollbacks cost, for one frame or added up since the start.
+// The depth is the number of ticks simulated again: rolling back to frame 10 during the update of frame 12
+// simulates 10 and 11 again, depth 2.
+struct RollbackFrameStats
+{
+    int m_rollbackDepth = 0;
+    int64_t m_resimulationMicros = 0;
+};
+
+struct RollbackStats
+{
+    uint64_t m_rollbackCount = 0;
+    uint64_t m_resimulatedFrameCount = 0;
+    int64_t m_totalResimulationMicros = 0;
 
+    int m_maxRollbackDepth = 0;
+    int64_t m_maxResimulationMicros = 0;
 
+    // rollbacks that took more than the frame budget
+    uint64_t m_overBudgetCount = 0;
+    // inputs too old to be applied (no snapshot left), too far in the future (no room in the ring) or of no player slot
+    uint64_t m_droppedInputCount = 0;
+};
 
+
+// Deterministic simulation with rollback.
+//
+//  Simulation simulation;
+//  simulation.AddPlayer(playerEntityId); // same order on every peer, the slots decide the order of the inputs
+//  simulation.SetTickFunction([](SimulationState& state, const PlayerInputs& inputs, int frameIndex)
+//  {
+//      // move the players of state.m_state according to their inputs
+//  });
+//  // each frame, with the inputs from the network as they come, late or not
+//  simulation.ReceivePlayerInput(input);
+//  simulation.Update();
+//
+// Update snapshots the state (ComponentGrid::Snapshot, copy on write, cheap) then runs the tick for the new frame.
+// The last m_rollbackFrameCount snapshots are kept. When an input arrives for a frame already simulated,
+// the next Update restores the snapshot of that frame and runs the ticks again up to the present, so the
+// late input counts as if it had arrived on time. The tick function must only depend on the state and the inputs.
+// An input equal to the one already there (resent by the network) doesn't roll back.
+// The whole rollback happens in the Update that follows, it is not spread over frames: the present must be
+// right before the new tick. Which late inputs are dropped only depends on SetMaxRollbackFrames, never on
+// timings, or two peers would apply different inputs and never agree again. The frame budget only feeds the
+// stats, and GetBudgetRollbackFrames, to pick a SetMaxRollbackFrames all the peers agree on.
+//
+// Without a tick function it works as before: call Update, then work on GetState looking at GetCurrentPlayerInputs.
+// There is nothing to simulate again then, so no snapshots and no rollback.
+//
+// The inputs of each frame are PlayerInputs, a fixed array, so ReceivePlayerInput, Update and
+// GetCurrentPlayerInputs don't allocate. With a tick function, only the snapshots do.
 class Simulation
 {
 
 public:
 
+    using TickFunction = std::function<void(SimulationState&, const PlayerInputs&, int frameIndex)>;
+
+    void SetTickFunction(TickFunction tick)
+    {
+        m_tick = std::move(tick);
+    }
+
+    // late inputs further back than that are dropped, to bound the cost of a rollback (at most m_rollbackFrameCount)
+    void SetMaxRollbackFrames(int frameCount)
+    {
+        BOF_ASSERT_MSG(frameCount >= 0 && frameCount <= m_rollbackFrameCount, "max rollback frames %d not in [0, %d]", frameCount, m_rollbackFrameCount);
+        m_maxRollbackFrames = frameCount;
+    }
+
+    // a rollback taking longer than that counts in RollbackStats::m_overBudgetCount, 0 for no budget
+    void SetFrameBudgetMicros(int64_t micros)
+    {
+        m_frameBudgetMicros = micros;
+    }
+
+    // the slot of the player, -1 if all of them are taken. Inputs of players not added are dropped.
+    int AddPlayer(GoodId playerEntityId)
+    {
+        BOF_ASSERT_MSG(playerEntityId != 0, "%s", "0 is no entity");
+        const int existingSlot = GetPlayerSlot(playerEntityId);
+        if (existingSlot != -1)
+        {
+            return existingSlot;
+        }
+        for (int slot = 0; slot < m_maxPlayerCount; slot++)
+        {
+            if (m_playerEntityIds[slot] == 0)
+            {
+                m_playerEntityIds[slot] = playerEntityId;
+                return slot;
+            }
+        }
+        std::cerr << "error: no player slot left for " << playerEntityId << std::endl;
+        return -1;
+    }
+
+    void RemovePlayer(GoodId playerEntityId)
+    {
+        const int slot = GetPlayerSlot(playerEntityId);
+        if (slot != -1)
+        {
+            m_playerEntityIds[slot] = 0;
+        }
+    }
+
+    int GetPlayerSlot(GoodId playerEntityId) const
+    {
+        if (playerEntityId == 0)
+        {
+            return -1;
+        }
+        for (int slot = 0; slot < m_maxPlayerCount; slot++)
+        {
+            if (m_playerEntityIds[slot] == playerEntityId)
+            {
+                return slot;
+            }
+        }
+        return -1;
+    }
 
     void ReceivePlayerInput(const PlayerInput& input)
     {
         int frame = input.m_frameIndex;
-        GoodId playerEntityId = input.m_playerEntityId;
+        const int slot = GetPlayerSlot(input.m_playerEntityId);
+        if (slot == -1)
+        {
+            m_stats.m_droppedInputCount++;
+            return;
+        }
+
+        // too far ahead it would push the frames we still need out of the ring
+        if (frame >= m_currentFrameIndex + m_ringBufferSize - m_rollbackFrameCount)
+        {
+            m_stats.m_droppedInputCount++;
+            return;
+        }
+
+        const bool late = m_tick && frame <= m_lastSimulatedFrame;
+        if (late && (frame <= m_lastSimulatedFrame - m_maxRollbackFrames || !HasSnapshot(frame)))
+        {
+            m_stats.m_droppedInputCount++;
+            return;
+        }
+        if (frame < m_playerInputs.GetMinimumAvailableIndex())
+        {
+            m_stats.m_droppedInputCount++;
+            return;
+        }
 
         while (m_playerInputs.GetCurrentIndex() < frame)
         {
-            m_playerInputs.Push();
+            m_playerInputs.Push().Clear();
+        }
+
+        PlayerInputs& inputsForThisFrame = m_playerInputs.Get(frame);
+
+        if (late)
+        {
+            if (inputsForThisFrame.HasInput(slot) && inputsForThisFrame.GetInput(slot).IsSameInput(input))
+            {
+                return;
+            }
+            m_rollbackFrame = std::min(m_rollbackFrame, frame);
         }
-        
-        unordered_map<GoodId, PlayerInput>& inputsForThisFrame = m_playerInputs.Get(frame);
 
-        inputsForThisFrame[playerEntityId] = input;
+        inputsForThisFrame.SetInput(slot, input);
     }
 
     void Update()
     {
+        RollbackFrameStats frameStats;
+        if (m_tick && m_rollbackFrame <= m_lastSimulatedFrame)
+        {
+            frameStats = Resimulate(m_rollbackFrame);
+        }
+        m_rollbackFrame = INT_MAX;
+
         m_currentFrameIndex++;
 
         while (m_playerInputs.GetCurrentIndex() < m_currentFrameIndex)
         {
-            m_playerInputs.Push();
+            m_playerInputs.Push().Clear();
+        }
+        while (m_frameStats.GetCurrentIndex() < m_currentFrameIndex)
+        {
+            m_frameStats.Push() = RollbackFrameStats();
         }
+        m_frameStats.Get(m_currentFrameIndex) = frameStats;
 
+        if (m_tick)
+        {
+            Tick(m_currentFrameIndex);
+        }
     }
 
     // call update, then work on state looking at currentplayerinput
@@ -86,19 +310,119 @@ public:
         return m_simulationState;
     }
 
-    const unordered_map<GoodId, PlayerInput>& GetCurrentPlayerInputs() const
+    const SimulationState& GetState() const
+    {
+        return m_simulationState;
+    }
+
+    // the state before the tick of the current frame, to interpolate with the current one (see FixedTimestep).
+    // nullptr without a tick function, there are no snapshots then.
+    const ComponentGrid* GetPreviousState() const
+    {
+        return HasSnapshot(m_currentFrameIndex) ? m_snapshots.Get(m_currentFrameIndex).get() : nullptr;
+    }
+
+    const PlayerInputs& GetCurrentPlayerInputs() const
     {
         return m_playerInputs.Get(m_currentFrameIndex);
     }
 
+    int GetCurrentFrameIndex() const { return m_currentFrameIndex; }
+
+    const RollbackStats& GetRollbackStats() const { return m_stats; }
+    // smoothed, snapshot included
+    double GetAverageTickMicros() const { return m_averageTickMicros; }
+
+    // how many frames back a rollback fits in the frame budget with the average tick cost of this machine
+    // (the tick of the new frame is in the budget too). A hint for SetMaxRollbackFrames, not applied by itself.
+    int GetBudgetRollbackFrames() const
+    {
+        if (m_frameBudgetMicros <= 0 || m_averageTickMicros <= 0.0)
+        {
+            return m_maxRollbackFrames;
+        }
+        const int affordableFrames = (int)(m_frameBudgetMicros / m_averageTickMicros) - 1;
+        return std::min(m_maxRollbackFrames, std::max(1, affordableFrames));
+    }
+
+    // the rollback done during the update of that frame, for the last m_ringBufferSize frames
+    const RollbackFrameStats& GetFrameStats(int frame) const { return m_frameStats.Get(frame); }
+    const RollbackFrameStats& GetLastFrameStats() const { return m_frameStats.GetCurrent(); }
+
 private:
+
+    bool HasSnapshot(int frame) const
+    {
+        return frame >= m_snapshots.GetMinimumAvailableIndex() && frame <= m_snapshots.GetMaximumAvailableIndex()
+            && m_snapshots.Get(frame) != nullptr;
+    }
+
+    // the snapshot of a frame is the state before its tick
+    void Tick(int frame)
+    {
+        Bof::SimpleClock clock;
+        while (m_snapshots.GetCurrentIndex() < frame)
+        {
+            m_snapshots.Push().reset();
+        }
+        m_snapshots.Get(frame) = m_simulationState.m_state.Snapshot();
+
+        m_tick(m_simulationState, m_playerInputs.Get(frame), frame);
+        m_lastSimulatedFrame = frame;
+
+        const double tickMicros = clock.GetTimeNano() / 1000.0;
+        m_averageTickMicros = m_averageTickMicros == 0.0
+            ? tickMicros
+            : m_averageTickMicros + (tickMicros - m_averageTickMicros) * 0.1;
+    }
+
+    RollbackFrameStats Resimulate(int fromFrame)
+    {
+        Bof::SimpleClock clock;
+
+        const int toFrame = m_lastSimulatedFrame;
+        m_simulationState.m_state.RestoreSnapshot(*m_snapshots.Get(fromFrame));
+        for (int frame = fromFrame; frame <= toFrame; frame++)
+        {
+            Tick(frame);
+        }
+
+        RollbackFrameStats frameStats;
+        frameStats.m_rollbackDepth = toFrame - fromFrame + 1;
+        frameStats.m_resimulationMicros = clock.GetTimeMicro();
+
+        m_stats.m_rollbackCount++;
+        m_stats.m_resimulatedFrameCount += frameStats.m_rollbackDepth;
+        m_stats.m_totalResimulationMicros += frameStats.m_resimulationMicros;
+        m_stats.m_maxRollbackDepth = std::max(m_stats.m_maxRollbackDepth, frameStats.m_rollbackDepth);
+        m_stats.m_maxResimulationMicros = std::max(m_stats.m_maxResimulationMicros, frameStats.m_resimulationMicros);
+        if (m_frameBudgetMicros > 0 && frameStats.m_resimulationMicros > m_frameBudgetMicros)
+        {
+            m_stats.m_overBudgetCount++;
+        }
+        return frameStats;
+    }
+
     int m_currentFrameIndex = 0;
 
     SimulationState m_simulationState;
 
-    RingBuffer<unordered_map<GoodId, PlayerInput>, m_ringBufferSize> m_playerInputs;
+    RingBuffer<PlayerInputs, m_ringBufferSize> m_playerInputs;
+    // the entity of each player slot, 0 when free
+    std::array<GoodId, m_maxPlayerCount> m_playerEntityIds = {};
+
+    TickFunction m_tick;
+    RingBuffer<std::unique_ptr<ComponentGrid>, m_rollbackFrameCount> m_snapshots;
+    int m_lastSimulatedFrame = -1;
+    // the earliest frame that got a late input since the last update
+    int m_rollbackFrame = INT_MAX;
 
+    int m_maxRollbackFrames = m_rollbackFrameCount;
+    int64_t m_frameBudgetMicros = 16666;
+    double m_averageTickMicros = 0.0;
 
+    RollbackStats m_stats;
+    RingBuffer<RollbackFrameStats, m_ringBufferSize> m_frameStats;
 
 };
 
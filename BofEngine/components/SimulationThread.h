@@ -0,0 +1,190 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cmath>
+
+#ifdef _WIN32
+// same as kissnet, so that winsock2 can come after
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#endif
+//
+#include "FixedTimestep.h"
+#include "utils/TripleBuffer.h"
+#include "utils/FrameTimeHistogram.h"
+#include "utils/Timer.h"
+
+using namespace std;
+
+
+// What the render gets from the simulation: a snapshot of the state after a tick.
+// Nobody writes in it, the simulation makes a new one for each publish.
+struct RenderSnapshot
+{
+    std::unique_ptr<ComponentGrid> m_state;
+    int m_frameIndex = -1;
+};
+
+
+// A Simulation ticking on its own thread at a fixed rate (FixedTimestep), so that a long wait on a fence
+// in the render doesn't slow the game, nor a long tick the render.
+//
+//  SimulationThread simulationThread(simulation, 60);
+//  simulationThread.Start(); // from now on only the thread touches simulation
+//  while (running)
+//  {
+//      simulationThread.PushInput(input);
+//      const RenderSnapshot& snapshot = simulationThread.AcquireLatestSnapshot(); // never waits
+//      if (snapshot.m_state) draw(*snapshot.m_state);
+//  }
+//  simulationThread.Stop();
+//
+// After the ticks of a loop, the state is snapshotted (ComponentGrid::Snapshot, it shares the pages) and
+// published in a TripleBuffer. The render takes the latest one whenever it starts a frame, and keeps reading it
+// while the simulation writes into its own pages (copy on write). Inputs go through a locked vector, they are few.
+// The time of each loop that ticked goes in GetTickTimes.
+//
+// Between ticks the thread sleeps until m_spinSeconds before the next one, then yields until it's time:
+// a sleep can overshoot by a timer period, and a tick late by that much comes in a pair with the next one.
+// On Windows the timer period is 15.6ms by default, about a whole 60Hz tick, so the thread asks for 1ms
+// (timeBeginPeriod) while it runs. How far apart the snapshots are published, compared to one tick,
+// goes in GetTickJitter.
+class SimulationThread
+{
+public:
+    SimulationThread(Simulation& simulation, int ticksPerSecond = 60, int maxTicksPerFrame = 4)
+        : m_simulation(simulation)
+        , m_fixedTimestep(simulation, ticksPerSecond, maxTicksPerFrame)
+    {
+    }
+
+    ~SimulationThread()
+    {
+        Stop();
+    }
+
+    void Start()
+    {
+        BOF_ASSERT_MSG(!m_thread.joinable(), "%s", "simulation thread already started");
+        m_stopRequested = false;
+        m_thread = std::thread([this]() { Run(); });
+    }
+
+    void Stop()
+    {
+        if (m_thread.joinable())
+        {
+            m_stopRequested = true;
+            m_thread.join();
+        }
+    }
+
+    // from any thread, goes to Simulation::ReceivePlayerInput before the next ticks
+    void PushInput(const PlayerInput& input)
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        m_pendingInputs.push_back(input);
+    }
+
+    // render thread: the latest snapshot published, or the same as last time if there is no new one.
+    // m_state is null until the first tick. It stays valid until the next call.
+    const RenderSnapshot& AcquireLatestSnapshot()
+    {
+        m_snapshots.AcquireLatest();
+        return m_snapshots.GetReadBuffer();
+    }
+
+    const FrameTimeHistogram& GetTickTimes() const { return m_tickTimes; }
+    // |time between two publishes - one tick|, 0 when the ticks come on time
+    const FrameTimeHistogram& GetTickJitter() const { return m_tickJitter; }
+    uint64_t GetPublishedCount() const { return m_publishedCount.load(std::memory_order_relaxed); }
+
+private:
+
+    static constexpr double m_spinSeconds = 0.002;
+
+    void Run()
+    {
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        vector<PlayerInput> inputs;
+        Bof::SimpleClock clock;
+        int64_t lastPublishNano = -1;
+        while (!m_stopRequested.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_inputMutex);
+                std::swap(inputs, m_pendingInputs);
+            }
+            for (const PlayerInput& input : inputs)
+            {
+                m_simulation.ReceivePlayerInput(input);
+            }
+            inputs.clear();
+
+            const int64_t loopStartNano = clock.GetTimeNano();
+            if (m_fixedTimestep.Advance() > 0)
+            {
+                RenderSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+                snapshot.m_state = std::as_const(m_simulation).GetState().m_state.Snapshot();
+                snapshot.m_frameIndex = m_simulation.GetCurrentFrameIndex();
+                m_snapshots.Publish();
+                m_publishedCount.fetch_add(1, std::memory_order_relaxed);
+
+                const int64_t publishNano = clock.GetTimeNano();
+                m_tickTimes.Add((publishNano - loopStartNano) / 1000000.0);
+                if (lastPublishNano >= 0)
+                {
+                    const double intervalSecs = (publishNano - lastPublishNano) / 1e9;
+                    m_tickJitter.Add(std::abs(intervalSecs - m_fixedTimestep.GetTickSeconds()) * 1000.0);
+                }
+                lastPublishNano = publishNano;
+            }
+
+            WaitUntil(clock, loopStartNano + (int64_t)(m_fixedTimestep.GetSecondsUntilNextTick() * 1e9));
+        }
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    // sleeps most of the way, yields the end
+    void WaitUntil(const Bof::SimpleClock& clock, int64_t deadlineNano)
+    {
+        const double waitSecs = (deadlineNano - clock.GetTimeNano()) / 1e9;
+        if (waitSecs > m_spinSeconds)
+        {
+            std::this_thread::sleep_for(std::chrono::duration<double>(waitSecs - m_spinSeconds));
+        }
+        while (clock.GetTimeNano() < deadlineNano && !m_stopRequested.load(std::memory_order_relaxed))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    Simulation& m_simulation;
+    FixedTimestep m_fixedTimestep;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stopRequested = false;
+
+    std::mutex m_inputMutex;
+    vector<PlayerInput> m_pendingInputs;
+
+    TripleBuffer<RenderSnapshot> m_snapshots;
+    std::atomic<uint64_t> m_publishedCount = 0;
+    FrameTimeHistogram m_tickTimes;
+    FrameTimeHistogram m_tickJitter;
+};
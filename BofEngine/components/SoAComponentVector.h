@@ -0,0 +1,382 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <span>
+#include <vector>
+//
+#include "GoodComponents.h"
+
+
+// Structure of arrays version of ComponentVector.
+//
+// The GOOD_SERIALIZABLE field list of the comp is walked once, and each field gets its own contiguous,
+// 64 bytes aligned column. A system that only reads m_position streams through the m_position column,
+// instead of dragging the whole fat comp through the cache:
+//
+// SoAComponentVector<ParticleComp> particles;
+// particles.AddEntityId(someEntityId).Get(&ParticleComp::m_x) = 3.0f;
+//
+// float* xs = particles.GetColumn(&ParticleComp::m_x);
+// const float* vxs = particles.GetColumn(&ParticleComp::m_vx);
+// for (size_t i = 0; i < particles.Size(); i++) { xs[i] += vxs[i] * dt; } // this vectorizes
+//
+// GetCompAtIndex and GetCompIfExists give an SoACompRef proxy instead of a comp reference.
+// Use Get(&Comp::m_field) on it, or Load() and Store() to gather and scatter a whole comp.
+//
+// Only trivially copyable fields are allowed (numbers, glm vectors, plain structs, fixed arrays).
+// That's what lets binary serialization write each column with one bulk copy.
+// Columns are padded to a multiple of m_columnPadding elements, so SIMD loops can run over the tail.
+
+struct SoAField
+{
+    const char* m_name = nullptr;
+    size_t m_offset = 0; // in the comp
+    size_t m_size = 0;
+};
+
+
+// Walks the GOOD fields of a comp, like a pods serializer would, and records where each one lives.
+class SoAFieldCollector
+{
+public:
+    SoAFieldCollector(const void* comp, vector<SoAField>& fields) : m_comp(static_cast<const char*>(comp)), m_fields(fields) {}
+
+    pods::Error operator()() { return pods::Error::NoError; }
+
+    template <class FieldType, class... ArgsT>
+    pods::Error operator()(const char* name, FieldType& field, ArgsT&&... args)
+    {
+        static_assert(std::is_trivially_copyable_v<FieldType>,
+            "SoAComponentVector comps can only have trivially copyable fields (no strings, vectors or GoodSerializables)");
+
+        SoAField& soaField = m_fields.emplace_back();
+        soaField.m_name = name;
+        soaField.m_offset = (size_t)(reinterpret_cast<const char*>(&field) - m_comp);
+        soaField.m_size = sizeof(FieldType);
+        return (*this)(std::forward<ArgsT>(args)...);
+    }
+
+private:
+    const char* m_comp;
+    vector<SoAField>& m_fields;
+};
+
+
+template <typename CompType>
+class SoAComponentVector;
+
+// What you get instead of a CompType& from an SoAComponentVector.
+// Valid until the next add or remove in the vector, like comp pointers.
+template <typename CompType>
+class SoACompRef
+{
+public:
+    SoACompRef() = default;
+    SoACompRef(SoAComponentVector<CompType>* comps, size_t index) : m_comps(comps), m_index(index) {}
+
+    // false when GetCompIfExists didn't find the entity
+    inline explicit operator bool() const { return m_comps != nullptr; }
+
+    // ref.Get(&ParticleComp::m_x) += 1.0f;
+    template <typename FieldType>
+    inline FieldType& Get(FieldType CompType::* member) const
+    {
+        return m_comps->GetColumn(member)[m_index];
+    }
+
+    // gather all the fields in a comp
+    inline CompType Load() const { return m_comps->LoadComp(m_index); }
+
+    // scatter all the fields of a comp
+    inline void Store(const CompType& comp) const { m_comps->StoreComp(m_index, comp); }
+
+    inline size_t GetIndex() const { return m_index; }
+
+private:
+    SoAComponentVector<CompType>* m_comps = nullptr;
+    size_t m_index = 0;
+};
+
+
+template <typename CompType>
+class SoAComponentVector final : public GoodSerializable
+{
+public:
+    static constexpr size_t m_columnAlignment = 64;
+    static constexpr size_t m_columnPadding = 16;
+
+    vector<GoodId> m_entities;
+
+    // the location in entity for each entityId in m_entities
+    EntitySlotMap m_entityToIndex;
+
+    SoAComponentVector()
+    {
+        vector<SoAField> fields;
+        SoAFieldCollector collector(&m_prototype, fields);
+        m_prototype.serialize(collector, CompType::version());
+
+        for (const SoAField& field : fields)
+        {
+            Column& column = m_columns.emplace_back();
+            column.m_field = field;
+        }
+    }
+
+    SoAComponentVector(const SoAComponentVector& other) = delete;
+    SoAComponentVector& operator=(const SoAComponentVector& other) = delete;
+
+    ~SoAComponentVector()
+    {
+        for (Column& column : m_columns)
+        {
+            FreeColumn(column);
+        }
+    }
+
+    constexpr GoodId GetCompClassId() const { return CompType::GetClassId(); }
+    constexpr const char* GetCompClassName() const { return CompType::GetClassName(); }
+
+    inline size_t Size() const { return m_entities.size(); }
+    inline size_t GetColumnCount() const { return m_columns.size(); }
+    inline const SoAField& GetField(size_t columnIndex) const { return m_columns[columnIndex].m_field; }
+
+    inline bool HasCompForEntity(const GoodId& entityId) const
+    {
+        return m_entityToIndex.Contains(entityId);
+    }
+
+    inline GoodId GetEntityAtIndex(size_t index) const
+    {
+        return m_entities[index];
+    }
+
+    // the comp starts with the default values of CompType
+    inline SoACompRef<CompType> AddEntityId(GoodId entityId)
+    {
+        return AddEntityId(entityId, m_prototype);
+    }
+
+    inline SoACompRef<CompType> AddEntityId(GoodId entityId, const CompType& comp)
+    {
+        BOF_ASSERT_MSG(!HasCompForEntity(entityId),
+            "can't add already existing component %s to entity %i",
+            CompType::GetClassName(),
+            entityId);
+
+        const size_t index = m_entities.size();
+        if (index == m_capacity)
+        {
+            Reserve(m_capacity == 0 ? m_columnPadding : m_capacity * 2);
+        }
+        m_entityToIndex.Set(entityId, (uint32_t)index);
+        m_entities.push_back(entityId);
+        StoreComp(index, comp);
+        return SoACompRef<CompType>(this, index);
+    }
+
+    // swap and pop in every column, like ComponentVector::RemoveEntityId
+    inline bool RemoveEntityId(GoodId entityId)
+    {
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index == EntitySlotMap::m_invalidIndex)
+        {
+            return false;
+        }
+        m_entityToIndex.Erase(entityId);
+
+        const uint32_t lastIndex = (uint32_t)m_entities.size() - 1;
+        if (index != lastIndex)
+        {
+            m_entities[index] = m_entities[lastIndex];
+            for (Column& column : m_columns)
+            {
+                memcpy(column.m_data + index * column.m_field.m_size,
+                    column.m_data + lastIndex * column.m_field.m_size,
+                    column.m_field.m_size);
+            }
+            m_entityToIndex.Set(m_entities[index], index);
+        }
+        m_entities.pop_back();
+        return true;
+    }
+
+    // invalid ref (test it with if (ref)) when the entity doesn't have this comp
+    inline SoACompRef<CompType> GetCompIfExists(const GoodId& entityId)
+    {
+        const uint32_t index = m_entityToIndex.Find(entityId);
+        if (index != EntitySlotMap::m_invalidIndex)
+        {
+            return SoACompRef<CompType>(this, index);
+        }
+        return SoACompRef<CompType>();
+    }
+
+    inline SoACompRef<CompType> GetCompAtIndex(size_t index)
+    {
+        return SoACompRef<CompType>(this, index);
+    }
+
+    // The whole column of one field, Size() elements (and a bit of padding after).
+    // Get it once before the loop. It's invalidated by adds, like comp pointers.
+    template <typename FieldType>
+    inline FieldType* GetColumn(FieldType CompType::* member)
+    {
+        return reinterpret_cast<FieldType*>(FindColumn(member).m_data);
+    }
+    template <typename FieldType>
+    inline const FieldType* GetColumn(FieldType CompType::* member) const
+    {
+        return reinterpret_cast<const FieldType*>(FindColumn(member).m_data);
+    }
+
+    template <typename FieldType>
+    inline std::span<FieldType> GetColumnSpan(FieldType CompType::* member)
+    {
+        return std::span<FieldType>(GetColumn(member), Size());
+    }
+
+    inline CompType LoadComp(size_t index) const
+    {
+        CompType comp = m_prototype;
+        for (const Column& column : m_columns)
+        {
+            memcpy(reinterpret_cast<char*>(&comp) + column.m_field.m_offset,
+                column.m_data + index * column.m_field.m_size,
+                column.m_field.m_size);
+        }
+        return comp;
+    }
+
+    inline void StoreComp(size_t index, const CompType& comp)
+    {
+        for (Column& column : m_columns)
+        {
+            memcpy(column.m_data + index * column.m_field.m_size,
+                reinterpret_cast<const char*>(&comp) + column.m_field.m_offset,
+                column.m_field.m_size);
+        }
+    }
+
+    // grows every column (never shrinks)
+    void Reserve(size_t entityCount)
+    {
+        if (entityCount <= m_capacity)
+        {
+            return;
+        }
+        const size_t newCapacity = (entityCount + m_columnPadding - 1) / m_columnPadding * m_columnPadding;
+        for (Column& column : m_columns)
+        {
+            char* newData = static_cast<char*>(::operator new(newCapacity * column.m_field.m_size, std::align_val_t(m_columnAlignment)));
+            if (column.m_data != nullptr)
+            {
+                memcpy(newData, column.m_data, m_entities.size() * column.m_field.m_size);
+            }
+            FreeColumn(column);
+            column.m_data = newData;
+        }
+        m_capacity = newCapacity;
+    }
+
+    void Clear()
+    {
+        m_entities.clear();
+        m_entityToIndex.Clear();
+    }
+
+    // does the same as ComponentVector
+    inline void PostDeserialize()
+    {
+        m_entityToIndex.Clear();
+        m_entityToIndex.Reserve(m_entities.size());
+
+        for (size_t i = 0; i < m_entities.size(); i++)
+        {
+            m_entityToIndex.Set(m_entities[i], (uint32_t)i);
+        }
+    }
+
+
+    GOOD_SERIALIZABLE_PARTIAL(SoAComponentVector, GOOD_VERSION(1));
+
+    // m_entities, then one blob per column named like the field. Each column is one bulk copy.
+    // When loading, the columns are sized from m_entities before their blobs are read.
+#define THIS_REPEATED_SERIALIZE()\
+    PODS_SAFE_CALL(serializer(GOOD(m_entities)));\
+    Reserve(m_entities.size());\
+    for (Column& column : m_columns)\
+    {\
+        PODS_SAFE_CALL(serializer(column.m_field.m_name,\
+            ::pods::details::makeBinary2(column.m_data, m_entities.size() * column.m_field.m_size)));\
+    }
+
+    pods::Error serialize(pods::JsonDeserializer<pods::InputBuffer>& serializer, pods::Version)
+    {
+        THIS_REPEATED_SERIALIZE();
+        PostDeserialize();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::BinaryDeserializer<pods::InputBuffer>& serializer, pods::Version)
+    {
+        THIS_REPEATED_SERIALIZE();
+        PostDeserialize();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::JsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::PrettyJsonSerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+    pods::Error serialize(pods::BinarySerializer<pods::ResizableOutputBuffer>& serializer, pods::Version)
+    {
+        THIS_REPEATED_SERIALIZE();
+        return pods::Error::NoError;
+    }
+#undef THIS_REPEATED_SERIALIZE
+
+private:
+
+    struct Column
+    {
+        SoAField m_field;
+        char* m_data = nullptr;
+    };
+
+    template <typename FieldType>
+    inline const Column& FindColumn(FieldType CompType::* member) const
+    {
+        const size_t offset = (size_t)(reinterpret_cast<const char*>(&(m_prototype.*member)) - reinterpret_cast<const char*>(&m_prototype));
+        for (const Column& column : m_columns)
+        {
+            if (column.m_field.m_offset == offset)
+            {
+                return column;
+            }
+        }
+        BOF_FAIL("field is not in the GOOD_SERIALIZABLE list of %s", CompType::GetClassName());
+        return m_columns[0];
+    }
+
+    static void FreeColumn(Column& column)
+    {
+        if (column.m_data != nullptr)
+        {
+            ::operator delete(column.m_data, std::align_val_t(m_columnAlignment));
+            column.m_data = nullptr;
+        }
+    }
+
+    // default values, and the layout of the comp
+    CompType m_prototype;
+
+    vector<Column> m_columns;
+    size_t m_capacity = 0;
+};
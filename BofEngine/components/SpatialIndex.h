@@ -0,0 +1,595 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+//
+#include "GoodComponents.h"
+#include "utils/AABB.hpp"
+#include "utils/JobSystem.h"
+
+
+// the world space box of an entity, what SpatialIndex indexes. Keep it valid (min <= max).
+class AABBComp : public GoodSerializable
+{
+public:
+    AABB m_box = AABB(glm::vec3(0.0f), glm::vec3(0.0f));
+
+    GOOD_SERIALIZABLE(AABBComp, GOOD_VERSION(1)
+        , GOOD(m_box.m_min.x)
+        , GOOD(m_box.m_min.y)
+        , GOOD(m_box.m_min.z)
+        , GOOD(m_box.m_max.x)
+        , GOOD(m_box.m_max.y)
+        , GOOD(m_box.m_max.z)
+    );
+};
+
+
+// The 6 planes of a view frustum, normals pointing inside.
+struct Frustum
+{
+    std::array<glm::vec4, 6> m_planes;
+
+    // from a projection * view matrix (Gribb & Hartmann). The near plane is the one of a -1..1 depth
+    // range, with a 0..1 one it's a bit behind the real one, which only makes the culling conservative.
+    static Frustum FromMatrix(const glm::mat4& viewProjection)
+    {
+        const glm::mat4 m = glm::transpose(viewProjection); // rows as columns
+        Frustum frustum;
+        frustum.m_planes[0] = m[3] + m[0]; // left
+        frustum.m_planes[1] = m[3] - m[0]; // right
+        frustum.m_planes[2] = m[3] + m[1]; // bottom
+        frustum.m_planes[3] = m[3] - m[1]; // top
+        frustum.m_planes[4] = m[3] + m[2]; // near
+        frustum.m_planes[5] = m[3] - m[2]; // far
+        return frustum;
+    }
+};
+
+
+// Finds the entities around a place without looking at all of them: a dynamic AABB tree over the
+// AABBComps of a grid (the one of ComponentGrid::GetSpatialIndex, or one of your own).
+//
+// grid.UpdateSpatialIndex(); // each tick, after things moved
+// grid.GetSpatialIndex().QuerySphere(explosionCenter, 10.0f, hitEntities);
+//
+// The leaves hold "fat" boxes, the AABBComp box grown by m_fatMargin on every side. An entity that
+// moves but stays inside its fat box costs nothing in the tree, only the ones getting out of it are
+// taken out and inserted again. Insertion picks the sibling that grows the tree surface the least,
+// and rotations keep the tree balanced (like the Box2D tree).
+//
+// Update only looks at the AABBComps changed since the last one (ComponentVector::ForEachChangedSince),
+// plus a sweep of the leaves when entities lost their AABBComp. So move boxes through mutable accessors,
+// or call MarkChanged.
+//
+// Queries are const, any number of threads can run them at the same time, but not during an Update.
+// Results are exact: the fat boxes cull, the real boxes decide.
+class SpatialIndex
+{
+public:
+    explicit SpatialIndex(float fatMargin = 0.5f) : m_fatMargin(fatMargin) {}
+
+    void Update(ComponentGrid& grid)
+    {
+        const uint32_t seenUpTo = grid.AdvanceChangeTick();
+        const ComponentVector<AABBComp>& boxes = *grid.GetComps<AABBComp>();
+        m_lastMovedCount = 0;
+        m_lastReinsertedCount = 0;
+        boxes.ForEachChangedSince(m_lastSeenTick, [this](GoodId entityId, const AABBComp& comp)
+        {
+            MoveOrInsert(entityId, comp.m_box);
+        });
+        // inserts first: entities removed and others added in the same tick leave more leaves than comps
+        if (m_leafCount != boxes.Size())
+        {
+            RemoveMissing(boxes);
+        }
+        m_lastSeenTick = seenUpTo;
+    }
+
+    inline void Clear()
+    {
+        m_nodes.clear();
+        m_root = m_nullNode;
+        m_freeList = m_nullNode;
+        m_leafCount = 0;
+        m_leaves.Clear();
+        m_lastSeenTick = 0;
+    }
+
+    // func(GoodId entityId) for each entity whose box overlaps the box, the sphere, the frustum
+    template <typename Func>
+    void QueryBox(const AABB& box, Func&& func) const
+    {
+        const Bounds bounds{ box.m_min, box.m_max };
+        Traverse([&bounds](const Bounds& nodeBounds) { return nodeBounds.Overlaps(bounds); }, func);
+    }
+    template <typename Func>
+    void QuerySphere(const glm::vec3& center, float radius, Func&& func) const
+    {
+        const float radiusSquared = radius * radius;
+        Traverse([&center, radiusSquared](const Bounds& nodeBounds) { return nodeBounds.DistanceSquared(center) <= radiusSquared; }, func);
+    }
+    template <typename Func>
+    void QueryFrustum(const Frustum& frustum, Func&& func) const
+    {
+        Traverse([&frustum](const Bounds& nodeBounds) { return nodeBounds.IsInFrontOfAll(frustum); }, func);
+    }
+
+    // the same, the entities go in outEntityIds (cleared first)
+    inline void QueryBox(const AABB& box, vector<GoodId>& outEntityIds) const
+    {
+        outEntityIds.clear();
+        QueryBox(box, [&outEntityIds](GoodId entityId) { outEntityIds.push_back(entityId); });
+    }
+    inline void QuerySphere(const glm::vec3& center, float radius, vector<GoodId>& outEntityIds) const
+    {
+        outEntityIds.clear();
+        QuerySphere(center, radius, [&outEntityIds](GoodId entityId) { outEntityIds.push_back(entityId); });
+    }
+    inline void QueryFrustum(const Frustum& frustum, vector<GoodId>& outEntityIds) const
+    {
+        outEntityIds.clear();
+        QueryFrustum(frustum, [&outEntityIds](GoodId entityId) { outEntityIds.push_back(entityId); });
+    }
+
+    // func(GoodId entityId, float distance) for each box the ray hits before maxDistance, in no particular
+    // order. direction doesn't need to be normalized, distances are in units of its length.
+    template <typename Func>
+    void QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Func&& func) const
+    {
+        const Ray ray(origin, direction);
+        float distance = 0.0f;
+        Traverse([&](const Bounds& nodeBounds) { return ray.Hits(nodeBounds, maxDistance, distance); },
+            [&](GoodId entityId) { func(entityId, distance); });
+    }
+
+    // the first box hit, false if none before maxDistance. The search shrinks as hits are found.
+    bool RayCastClosest(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, GoodId& outEntityId, float& outDistance) const
+    {
+        const Ray ray(origin, direction);
+        bool hasHit = false;
+        float distance = 0.0f;
+        Traverse([&](const Bounds& nodeBounds) { return ray.Hits(nodeBounds, maxDistance, distance); },
+            [&](GoodId entityId)
+            {
+                maxDistance = distance;
+                outEntityId = entityId;
+                outDistance = distance;
+                hasHit = true;
+            });
+        return hasHit;
+    }
+
+    // Batches of queries, spread over the JobSystem: outResults[i] gets the entities of query i.
+    // The result vectors are reused, keep outResults from one call to the next.
+    // Spheres are the center in xyz and the radius in w.
+    void QueryBoxes(std::span<const AABB> boxes, vector<vector<GoodId>>& outResults, Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault()) const
+    {
+        outResults.resize(boxes.size());
+        jobSystem.ParallelFor(boxes.size(), m_queriesPerJob, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                QueryBox(boxes[i], outResults[i]);
+            }
+        });
+    }
+    void QuerySpheres(std::span<const glm::vec4> spheres, vector<vector<GoodId>>& outResults, Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault()) const
+    {
+        outResults.resize(spheres.size());
+        jobSystem.ParallelFor(spheres.size(), m_queriesPerJob, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                QuerySphere(glm::vec3(spheres[i]), spheres[i].w, outResults[i]);
+            }
+        });
+    }
+
+    inline size_t GetEntityCount() const { return m_leafCount; }
+    inline bool Contains(GoodId entityId) const { return m_leaves.Contains(entityId); }
+    inline int32_t GetHeight() const { return m_root == m_nullNode ? 0 : m_nodes[m_root].m_height; }
+
+    // what the last Update did: boxes changed, and the ones that got out of their fat box
+    inline size_t GetLastMovedCount() const { return m_lastMovedCount; }
+    inline size_t GetLastReinsertedCount() const { return m_lastReinsertedCount; }
+
+    // added to each side of the boxes in the leaves. Bigger: fewer reinsertions, more false positives
+    // to test in the queries. Only for the leaves inserted from now on.
+    float m_fatMargin;
+
+    static constexpr size_t m_queriesPerJob = 64;
+
+private:
+    static constexpr uint32_t m_nullNode = UINT32_MAX;
+    static constexpr size_t m_maxStackSize = 256;
+
+    // a plain box, AABB copies are not trivial and the tree copies boxes a lot
+    struct Bounds
+    {
+        glm::vec3 m_min;
+        glm::vec3 m_max;
+
+        static inline Bounds Union(const Bounds& a, const Bounds& b)
+        {
+            return Bounds{ glm::min(a.m_min, b.m_min), glm::max(a.m_max, b.m_max) };
+        }
+        inline float GetSurface() const
+        {
+            const glm::vec3 size = m_max - m_min;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+        inline bool Contains(const Bounds& other) const
+        {
+            return glm::all(glm::lessThanEqual(m_min, other.m_min)) && glm::all(glm::lessThanEqual(other.m_max, m_max));
+        }
+        inline bool Overlaps(const Bounds& other) const
+        {
+            return glm::all(glm::lessThanEqual(m_min, other.m_max)) && glm::all(glm::lessThanEqual(other.m_min, m_max));
+        }
+        inline float DistanceSquared(const glm::vec3& point) const
+        {
+            const glm::vec3 delta = point - glm::clamp(point, m_min, m_max);
+            return glm::dot(delta, delta);
+        }
+        // not completely behind one of the planes
+        inline bool IsInFrontOfAll(const Frustum& frustum) const
+        {
+            for (const glm::vec4& plane : frustum.m_planes)
+            {
+                // the corner the most in front of the plane
+                const glm::vec3 corner(plane.x >= 0.0f ? m_max.x : m_min.x, plane.y >= 0.0f ? m_max.y : m_min.y, plane.z >= 0.0f ? m_max.z : m_min.z);
+                if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    struct Ray
+    {
+        Ray(const glm::vec3& origin, const glm::vec3& direction) : m_origin(origin), m_inverseDirection(1.0f / direction) {}
+
+        // slab test, outDistance is where the ray enters the box (0 if it starts inside)
+        inline bool Hits(const Bounds& bounds, float maxDistance, float& outDistance) const
+        {
+            const glm::vec3 t0 = (bounds.m_min - m_origin) * m_inverseDirection;
+            const glm::vec3 t1 = (bounds.m_max - m_origin) * m_inverseDirection;
+            const glm::vec3 tNear = glm::min(t0, t1);
+            const glm::vec3 tFar = glm::max(t0, t1);
+            const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+            const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+            outDistance = enter;
+            return enter <= exit;
+        }
+
+        glm::vec3 m_origin;
+        glm::vec3 m_inverseDirection;
+    };
+
+    struct Node
+    {
+        inline bool IsLeaf() const { return m_child1 == m_nullNode; }
+
+        Bounds m_bounds; // fat for the leaves
+        Bounds m_tightBounds; // leaves only, the AABBComp box
+        uint32_t m_parent = m_nullNode; // the next free node when free
+        uint32_t m_child1 = m_nullNode;
+        uint32_t m_child2 = m_nullNode;
+        int32_t m_height = 0; // 0 for leaves, -1 when free
+        GoodId m_entityId = 0;
+    };
+
+    // overlaps(const Bounds&) decides for the nodes, fat boxes first then the real box for the leaves
+    template <typename Overlaps, typename Func>
+    void Traverse(Overlaps&& overlaps, Func&& func) const
+    {
+        if (m_root == m_nullNode)
+        {
+            return;
+        }
+        std::array<uint32_t, m_maxStackSize> stack;
+        size_t stackSize = 0;
+        stack[stackSize++] = m_root;
+        while (stackSize > 0)
+        {
+            const Node& node = m_nodes[stack[--stackSize]];
+            if (!overlaps(node.m_bounds))
+            {
+                continue;
+            }
+            if (node.IsLeaf())
+            {
+                if (overlaps(node.m_tightBounds))
+                {
+                    func(node.m_entityId);
+                }
+                continue;
+            }
+            BOF_ASSERT_MSG(stackSize + 2 <= m_maxStackSize, "%s", "spatial index too deep");
+            stack[stackSize++] = node.m_child1;
+            stack[stackSize++] = node.m_child2;
+        }
+    }
+
+    void MoveOrInsert(GoodId entityId, const AABB& box)
+    {
+        m_lastMovedCount++;
+        const Bounds tightBounds{ box.m_min, box.m_max };
+        uint32_t leaf = m_leaves.Find(entityId);
+        if (leaf != EntitySlotMap::m_invalidIndex)
+        {
+            Node& node = m_nodes[leaf];
+            node.m_tightBounds = tightBounds;
+            if (node.m_bounds.Contains(tightBounds))
+            {
+                return;
+            }
+            RemoveLeaf(leaf);
+            m_lastReinsertedCount++;
+        }
+        else
+        {
+            leaf = AllocateNode();
+            m_nodes[leaf].m_entityId = entityId;
+            m_nodes[leaf].m_tightBounds = tightBounds;
+            m_leaves.Set(entityId, leaf);
+            m_leafCount++;
+        }
+        const glm::vec3 margin(m_fatMargin);
+        m_nodes[leaf].m_bounds = Bounds{ tightBounds.m_min - margin, tightBounds.m_max + margin };
+        InsertLeaf(leaf);
+    }
+
+    void RemoveMissing(const ComponentVector<AABBComp>& boxes)
+    {
+        for (uint32_t i = 0; i < (uint32_t)m_nodes.size(); i++)
+        {
+            const Node& node = m_nodes[i];
+            if (node.m_height == 0 && node.IsLeaf() && !boxes.HasCompForEntity(node.m_entityId))
+            {
+                m_leaves.Erase(node.m_entityId);
+                RemoveLeaf(i);
+                FreeNode(i);
+                m_leafCount--;
+            }
+        }
+    }
+
+    uint32_t AllocateNode()
+    {
+        if (m_freeList == m_nullNode)
+        {
+            m_nodes.emplace_back();
+            return (uint32_t)m_nodes.size() - 1;
+        }
+        const uint32_t index = m_freeList;
+        m_freeList = m_nodes[index].m_parent;
+        m_nodes[index] = Node();
+        return index;
+    }
+
+    void FreeNode(uint32_t index)
+    {
+        m_nodes[index].m_parent = m_freeList;
+        m_nodes[index].m_child1 = m_nullNode;
+        m_nodes[index].m_height = -1;
+        m_freeList = index;
+    }
+
+    void InsertLeaf(uint32_t leaf)
+    {
+        if (m_root == m_nullNode)
+        {
+            m_root = leaf;
+            m_nodes[leaf].m_parent = m_nullNode;
+            return;
+        }
+
+        // the sibling that costs the least surface: going down costs the growth of the node on the way
+        const Bounds leafBounds = m_nodes[leaf].m_bounds;
+        uint32_t index = m_root;
+        while (!m_nodes[index].IsLeaf())
+        {
+            const Node& node = m_nodes[index];
+            const float surface = node.m_bounds.GetSurface();
+            const float combinedSurface = Bounds::Union(node.m_bounds, leafBounds).GetSurface();
+            // a new parent for this node and the leaf
+            const float cost = 2.0f * combinedSurface;
+            // the minimum cost of pushing the leaf further down
+            const float inheritanceCost = 2.0f * (combinedSurface - surface);
+            const float cost1 = GetDescentCost(node.m_child1, leafBounds) + inheritanceCost;
+            const float cost2 = GetDescentCost(node.m_child2, leafBounds) + inheritanceCost;
+            if (cost < cost1 && cost < cost2)
+            {
+                break;
+            }
+            index = cost1 < cost2 ? node.m_child1 : node.m_child2;
+        }
+        const uint32_t sibling = index;
+
+        const uint32_t oldParent = m_nodes[sibling].m_parent;
+        const uint32_t newParent = AllocateNode();
+        Node& parentNode = m_nodes[newParent];
+        parentNode.m_parent = oldParent;
+        parentNode.m_bounds = Bounds::Union(leafBounds, m_nodes[sibling].m_bounds);
+        parentNode.m_height = m_nodes[sibling].m_height + 1;
+        parentNode.m_child1 = sibling;
+        parentNode.m_child2 = leaf;
+        m_nodes[sibling].m_parent = newParent;
+        m_nodes[leaf].m_parent = newParent;
+        if (oldParent == m_nullNode)
+        {
+            m_root = newParent;
+        }
+        else if (m_nodes[oldParent].m_child1 == sibling)
+        {
+            m_nodes[oldParent].m_child1 = newParent;
+        }
+        else
+        {
+            m_nodes[oldParent].m_child2 = newParent;
+        }
+
+        FixUpwards(m_nodes[leaf].m_parent);
+    }
+
+    inline float GetDescentCost(uint32_t child, const Bounds& leafBounds) const
+    {
+        const Node& node = m_nodes[child];
+        const float combinedSurface = Bounds::Union(node.m_bounds, leafBounds).GetSurface();
+        return node.IsLeaf() ? combinedSurface : combinedSurface - node.m_bounds.GetSurface();
+    }
+
+    // the node stays allocated, for a reinsertion or FreeNode
+    void RemoveLeaf(uint32_t leaf)
+    {
+        if (leaf == m_root)
+        {
+            m_root = m_nullNode;
+            return;
+        }
+        const uint32_t parent = m_nodes[leaf].m_parent;
+        const uint32_t grandParent = m_nodes[parent].m_parent;
+        const uint32_t sibling = m_nodes[parent].m_child1 == leaf ? m_nodes[parent].m_child2 : m_nodes[parent].m_child1;
+        if (grandParent == m_nullNode)
+        {
+            m_root = sibling;
+            m_nodes[sibling].m_parent = m_nullNode;
+            FreeNode(parent);
+            return;
+        }
+        if (m_nodes[grandParent].m_child1 == parent)
+        {
+            m_nodes[grandParent].m_child1 = sibling;
+        }
+        else
+        {
+            m_nodes[grandParent].m_child2 = sibling;
+        }
+        m_nodes[sibling].m_parent = grandParent;
+        FreeNode(parent);
+        FixUpwards(grandParent);
+    }
+
+    // balance, bounds and heights from index up to the root
+    void FixUpwards(uint32_t index)
+    {
+        while (index != m_nullNode)
+        {
+            index = Balance(index);
+            Node& node = m_nodes[index];
+            const Node& child1 = m_nodes[node.m_child1];
+            const Node& child2 = m_nodes[node.m_child2];
+            node.m_height = 1 + std::max(child1.m_height, child2.m_height);
+            node.m_bounds = Bounds::Union(child1.m_bounds, child2.m_bounds);
+            index = node.m_parent;
+        }
+    }
+
+    // if a child of a is 2 levels taller than the other, it takes the place of a (a rotation).
+    // Returns the node now at the place of a.
+    uint32_t Balance(uint32_t a)
+    {
+        Node& nodeA = m_nodes[a];
+        if (nodeA.IsLeaf() || nodeA.m_height < 2)
+        {
+            return a;
+        }
+        const uint32_t b = nodeA.m_child1;
+        const uint32_t c = nodeA.m_child2;
+        const int32_t balance = m_nodes[c].m_height - m_nodes[b].m_height;
+        if (balance > 1)
+        {
+            return Rotate(a, c, b, false);
+        }
+        if (balance < -1)
+        {
+            return Rotate(a, b, c, true);
+        }
+        return a;
+    }
+
+    // up goes up at the place of a, a keeps other and takes the shorter child of up
+    uint32_t Rotate(uint32_t a, uint32_t up, uint32_t other, bool upIsChild1)
+    {
+        Node& nodeA = m_nodes[a];
+        Node& nodeUp = m_nodes[up];
+        const uint32_t f = nodeUp.m_child1;
+        const uint32_t g = nodeUp.m_child2;
+
+        nodeUp.m_child1 = a;
+        nodeUp.m_parent = nodeA.m_parent;
+        nodeA.m_parent = up;
+        if (nodeUp.m_parent == m_nullNode)
+        {
+            m_root = up;
+        }
+        else if (m_nodes[nodeUp.m_parent].m_child1 == a)
+        {
+            m_nodes[nodeUp.m_parent].m_child1 = up;
+        }
+        else
+        {
+            m_nodes[nodeUp.m_parent].m_child2 = up;
+        }
+
+        const bool keepF = m_nodes[f].m_height > m_nodes[g].m_height;
+        const uint32_t kept = keepF ? f : g;
+        const uint32_t given = keepF ? g : f;
+        nodeUp.m_child2 = kept;
+        if (upIsChild1)
+        {
+            nodeA.m_child1 = given;
+        }
+        else
+        {
+            nodeA.m_child2 = given;
+        }
+        m_nodes[given].m_parent = a;
+
+        const Node& nodeOther = m_nodes[other];
+        const Node& nodeGiven = m_nodes[given];
+        const Node& nodeKept = m_nodes[kept];
+        nodeA.m_bounds = Bounds::Union(nodeOther.m_bounds, nodeGiven.m_bounds);
+        nodeA.m_height = 1 + std::max(nodeOther.m_height, nodeGiven.m_height);
+        nodeUp.m_bounds = Bounds::Union(nodeA.m_bounds, nodeKept.m_bounds);
+        nodeUp.m_height = 1 + std::max(nodeA.m_height, nodeKept.m_height);
+        return up;
+    }
+
+    vector<Node> m_nodes;
+    uint32_t m_root = m_nullNode;
+    uint32_t m_freeList = m_nullNode;
+    size_t m_leafCount = 0;
+    EntitySlotMap m_leaves; // entity id -> leaf node
+
+    uint32_t m_lastSeenTick = 0;
+    size_t m_lastMovedCount = 0;
+    size_t m_lastReinsertedCount = 0;
+};
+
+
+inline SpatialIndex& ComponentGrid::GetSpatialIndex()
+{
+    if (!m_spatialIndex)
+    {
+        m_spatialIndex = std::make_shared<SpatialIndex>();
+    }
+    return *m_spatialIndex;
+}
+
+inline void ComponentGrid::UpdateSpatialIndex()
+{
+    GetSpatialIndex().Update(*this);
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+//
+#include "GoodComponents.h"
+#include "GridCommandBuffer.h"
+#include "utils/JobSystem.h"
+#include "utils/Timer.h"
+
+
+// Runs game logic systems on a ComponentGrid, on several cores when it can.
+//
+// Each system declares the comp types it reads and the ones it writes:
+//
+// scheduler.AddSystem("Move", SystemReads<VelocityComp>(), SystemWrites<PositionComp>(),
+//     [](ComponentGrid& grid)
+//     {
+//         grid.View<PositionComp, const VelocityComp>().ForEach(...);
+//     });
+//
+// Two systems conflict when one of them writes something the other reads or writes. The scheduler puts
+// the systems in batches: a system goes in the batch after the last one holding a system it conflicts with.
+// Systems of one batch don't conflict, and run at the same time on the JobSystem. Conflicting systems
+// keep their registration order, so the result doesn't depend on the thread timings.
+//
+// Inside a system, stick to what was declared. Don't add or remove comp vectors, and only use tags
+// that already exist (GetTags creates missing ones). Systems that create or destroy entities, or add or
+// remove comps, record it in GetCommandBuffer(): it's played back at the end of the batch, before the next one.
+// Or declare them with SystemExclusive(), they run alone and can touch the grid directly.
+//
+// Tag ids can be declared like comp types, push them in GetSystemReads / GetSystemWrites.
+
+template <typename... CompTypes>
+struct SystemReads
+{
+    static vector<GoodId> GetIds() { return { CompTypes::GetClassId()... }; }
+};
+
+template <typename... CompTypes>
+struct SystemWrites
+{
+    static vector<GoodId> GetIds() { return { CompTypes::GetClassId()... }; }
+};
+
+struct SystemExclusive {};
+
+
+struct SystemStats
+{
+    int64_t m_lastMicros = 0;
+    int64_t m_totalMicros = 0;
+    uint64_t m_runCount = 0;
+};
+
+
+class SystemScheduler
+{
+public:
+    using SystemFunction = std::function<void(ComponentGrid&)>;
+
+    explicit SystemScheduler(Bof::JobSystem& jobSystem) : m_jobSystem(jobSystem), m_commandBuffer(jobSystem) {}
+
+    template <typename... ReadTypes, typename... WriteTypes>
+    inline size_t AddSystem(std::string name, SystemReads<ReadTypes...>, SystemWrites<WriteTypes...>, SystemFunction update)
+    {
+        System& system = m_systems.emplace_back();
+        system.m_name = std::move(name);
+        system.m_reads = SystemReads<ReadTypes...>::GetIds();
+        system.m_writes = SystemWrites<WriteTypes...>::GetIds();
+        system.m_update = std::move(update);
+        m_batchesAreDirty = true;
+        return m_systems.size() - 1;
+    }
+
+    inline size_t AddSystem(std::string name, SystemExclusive, SystemFunction update)
+    {
+        System& system = m_systems.emplace_back();
+        system.m_name = std::move(name);
+        system.m_exclusive = true;
+        system.m_update = std::move(update);
+        m_batchesAreDirty = true;
+        return m_systems.size() - 1;
+    }
+
+    // to declare tags, or anything else that has a GoodId
+    inline vector<GoodId>& GetSystemReads(size_t systemIndex) { m_batchesAreDirty = true; return m_systems[systemIndex].m_reads; }
+    inline vector<GoodId>& GetSystemWrites(size_t systemIndex) { m_batchesAreDirty = true; return m_systems[systemIndex].m_writes; }
+
+    inline size_t GetSystemCount() const { return m_systems.size(); }
+    inline const std::string& GetSystemName(size_t systemIndex) const { return m_systems[systemIndex].m_name; }
+    inline const SystemStats& GetSystemStats(size_t systemIndex) const { return m_systems[systemIndex].m_stats; }
+
+    inline size_t GetBatchCount()
+    {
+        BuildBatchesIfNeeded();
+        return m_batches.size();
+    }
+
+    // for the structural changes of the systems, see GridCommandBuffer
+    inline GridCommandBuffer& GetCommandBuffer() { return m_commandBuffer; }
+
+    // when on, every system logs its time with the PROFILE logger, each Run
+    inline void SetProfiling(bool isOn) { m_isProfiling = isOn; }
+
+    // runs every system once
+    void Run(ComponentGrid& grid)
+    {
+        BuildBatchesIfNeeded();
+
+        for (const vector<size_t>& batch : m_batches)
+        {
+            m_jobSystem.Run(batch.size(), [&](size_t i)
+            {
+                RunSystem(m_systems[batch[i]], grid);
+            });
+            m_commandBuffer.Playback(grid);
+        }
+    }
+
+    // average time per system since the start, and the batches they are in
+    void LogStats()
+    {
+        BuildBatchesIfNeeded();
+
+        for (size_t batchIndex = 0; batchIndex < m_batches.size(); batchIndex++)
+        {
+            for (size_t systemIndex : m_batches[batchIndex])
+            {
+                const SystemStats& stats = m_systems[systemIndex].m_stats;
+                const double averageMillis = stats.m_runCount > 0 ? stats.m_totalMicros / (1000.0 * stats.m_runCount) : 0.0;
+                BOF_INFO("System batch {} {:<30} {:>8.3f}ms average, {:>8.3f}ms last",
+                    batchIndex, m_systems[systemIndex].m_name, averageMillis, stats.m_lastMicros / 1000.0);
+            }
+        }
+    }
+
+    inline bool DoSystemsConflict(size_t systemIndexA, size_t systemIndexB) const
+    {
+        const System& a = m_systems[systemIndexA];
+        const System& b = m_systems[systemIndexB];
+        if (a.m_exclusive || b.m_exclusive)
+        {
+            return true;
+        }
+        return Intersects(a.m_writes, b.m_writes) || Intersects(a.m_writes, b.m_reads) || Intersects(a.m_reads, b.m_writes);
+    }
+
+private:
+    struct System
+    {
+        std::string m_name;
+        vector<GoodId> m_reads;
+        vector<GoodId> m_writes;
+        bool m_exclusive = false;
+        SystemFunction m_update;
+        SystemStats m_stats;
+    };
+
+    // the lists are a handful of ids, no need to be smart
+    static inline bool Intersects(const vector<GoodId>& a, const vector<GoodId>& b)
+    {
+        for (GoodId id : a)
+        {
+            if (std::find(b.begin(), b.end(), id) != b.end())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void BuildBatchesIfNeeded()
+    {
+        if (!m_batchesAreDirty)
+        {
+            return;
+        }
+        m_batchesAreDirty = false;
+        m_batches.clear();
+
+        vector<size_t> batchOfSystem(m_systems.size(), 0);
+        for (size_t i = 0; i < m_systems.size(); i++)
+        {
+            size_t batchIndex = 0;
+            for (size_t j = 0; j < i; j++)
+            {
+                if (DoSystemsConflict(i, j))
+                {
+                    batchIndex = std::max(batchIndex, batchOfSystem[j] + 1);
+                }
+            }
+            batchOfSystem[i] = batchIndex;
+            if (batchIndex == m_batches.size())
+            {
+                m_batches.emplace_back();
+            }
+            m_batches[batchIndex].push_back(i);
+        }
+    }
+
+    void RunSystem(System& system, ComponentGrid& grid)
+    {
+        Bof::SimpleClock clock;
+        {
+#ifdef ENABLE_PROFILING
+            std::optional<Bof::LogTimeOnDestruction> profile;
+            if (m_isProfiling)
+            {
+                profile.emplace(system.m_name);
+            }
+#endif
+            system.m_update(grid);
+        }
+        // each system is in one batch only, so only one thread writes those
+        system.m_stats.m_lastMicros = clock.GetTimeMicro();
+        system.m_stats.m_totalMicros += system.m_stats.m_lastMicros;
+        system.m_stats.m_runCount++;
+    }
+
+    Bof::JobSystem& m_jobSystem;
+    GridCommandBuffer m_commandBuffer;
+    vector<System> m_systems;
+    vector<vector<size_t>> m_batches;
+    bool m_batchesAreDirty = false;
+    bool m_isProfiling = false;
+};
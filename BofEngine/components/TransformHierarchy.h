@@ -0,0 +1,338 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+//
+#include "GoodComponents.h"
+#include "utils/JobSystem.h"
+
+
+// Transform hierarchy on a ComponentGrid:
+// - LocalTransformComp: translation, rotation, scale relative to the parent
+// - ParentComp: the parent entity, no ParentComp means a root
+// - WorldTransformComp: parent world * local, written by TransformHierarchy::Update, don't write it yourself
+
+class ParentComp : public GoodSerializable
+{
+public:
+    GoodId m_parentId = 0;
+
+    GOOD_SERIALIZABLE(ParentComp, GOOD_VERSION(1)
+        , GOOD(m_parentId)
+    );
+};
+
+class LocalTransformComp : public GoodSerializable
+{
+public:
+    glm::vec3 m_translation{ 0.0f };
+    glm::quat m_rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+    glm::vec3 m_scale{ 1.0f };
+
+    // translate * rotate * scale
+    inline glm::mat4 GetMatrix() const
+    {
+        glm::mat4 matrix = glm::mat4_cast(m_rotation);
+        matrix[0] *= m_scale.x;
+        matrix[1] *= m_scale.y;
+        matrix[2] *= m_scale.z;
+        matrix[3] = glm::vec4(m_translation, 1.0f);
+        return matrix;
+    }
+
+    GOOD_SERIALIZABLE(LocalTransformComp, GOOD_VERSION(1)
+        , GOOD(m_translation.x)
+        , GOOD(m_translation.y)
+        , GOOD(m_translation.z)
+        , GOOD(m_rotation.x)
+        , GOOD(m_rotation.y)
+        , GOOD(m_rotation.z)
+        , GOOD(m_rotation.w)
+        , GOOD(m_scale.x)
+        , GOOD(m_scale.y)
+        , GOOD(m_scale.z)
+    );
+};
+
+// not saved, TransformHierarchy::Update recomputes everything after a load
+class WorldTransformComp : public GoodSerializable
+{
+public:
+    glm::mat4 m_matrix{ 1.0f };
+
+    GOOD_SERIALIZABLE(WorldTransformComp, GOOD_VERSION(1));
+};
+
+
+// Computes the WorldTransformComp of every entity with a LocalTransformComp.
+//
+// TransformHierarchy hierarchy;
+// ...
+// hierarchy.Update(grid); // each frame, after the game logic moved things
+//
+// The entities are kept in depth order, tree by tree: a root, its children, their children... so a parent
+// is always before its children and the world matrices are done in one linear pass, one multiply per
+// entity (instead of walking the parent chain of each entity). Trees are independent, they are cut in
+// jobs of whole trees that run on the JobSystem.
+//
+// Dirty flags: only the entities whose LocalTransformComp changed (see ComponentVector::HasChangedSince),
+// and everything under them, are recomputed. Their WorldTransformComps get marked as changed, so the
+// renderer can upload only those (ForEachChangedSince).
+//
+// The order is rebuilt when the hierarchy changes: ParentComps added, removed or changed, entities with a
+// LocalTransformComp added or removed. Then everything is recomputed. Rebuilding adds the missing
+// WorldTransformComps, so Update changes the grid structure: as a SystemScheduler system, make it
+// SystemExclusive (or add the WorldTransformComps with the LocalTransformComps, then it never does).
+//
+// The grid needs the 3 comp vectors. A parent without a LocalTransformComp counts as the origin.
+// Entities in a parent cycle are skipped.
+// For memory locality, the comps can take the depth order once the hierarchy is built:
+// grid.ApplyEntityOrder<LocalTransformComp, WorldTransformComp>(hierarchy.GetDepthSortedEntities());
+class TransformHierarchy
+{
+public:
+    void Update(ComponentGrid& grid, Bof::JobSystem& jobSystem = Bof::JobSystem::GetDefault())
+    {
+        const uint32_t seenUpTo = grid.AdvanceChangeTick();
+        if (NeedsRebuild(grid))
+        {
+            Rebuild(grid);
+        }
+        if (!Propagate(grid, jobSystem))
+        {
+            // an entity of the order is gone, the counts didn't tell
+            Rebuild(grid);
+            Propagate(grid, jobSystem);
+        }
+        m_lastSeenTick = seenUpTo;
+    }
+
+    // forget the order, the next Update rebuilds it and recomputes everything
+    inline void Invalidate() { m_needsRebuild = true; }
+
+    // roots first, then tree by tree in depth order
+    inline const vector<GoodId>& GetDepthSortedEntities() const { return m_order; }
+    inline size_t GetTreeCount() const { return m_treeBegins.empty() ? 0 : m_treeBegins.size() - 1; }
+
+    // entities recomputed by the last Update
+    inline size_t GetLastUpdatedCount() const { return m_lastUpdatedCount; }
+
+    // trees are grouped in jobs of at least this many entities
+    static constexpr size_t m_minEntitiesPerJob = 1024;
+
+private:
+    bool NeedsRebuild(ComponentGrid& grid) const
+    {
+        if (m_needsRebuild)
+        {
+            return true;
+        }
+        const ComponentVector<LocalTransformComp>& locals = *grid.GetComps<LocalTransformComp>();
+        const ComponentVector<ParentComp>& parents = *grid.GetComps<ParentComp>();
+        if (locals.m_comps.size() != m_localCount || parents.m_comps.size() != m_parentCount)
+        {
+            return true;
+        }
+        // parents are rare compared to the transforms, and rarely touched
+        for (size_t i = 0; i < parents.m_comps.size(); i++)
+        {
+            if (parents.HasChangedSince(i, m_lastSeenTick))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Rebuild(ComponentGrid& grid)
+    {
+        ComponentVector<LocalTransformComp>& locals = *grid.GetComps<LocalTransformComp>();
+        ComponentVector<WorldTransformComp>& worlds = *grid.GetComps<WorldTransformComp>();
+        const ComponentVector<ParentComp>& parents = *grid.GetComps<ParentComp>();
+        const size_t localCount = locals.m_entities.size();
+
+        for (size_t i = 0; i < localCount; i++)
+        {
+            const GoodId entityId = std::as_const(locals.m_entities)[i];
+            if (!worlds.HasCompForEntity(entityId))
+            {
+                worlds.AddEntityId(entityId);
+            }
+        }
+
+        // the parent of each local, as an index in locals. Children lists packed by parent (counting sort).
+        constexpr uint32_t noParent = EntitySlotMap::m_invalidIndex;
+        m_scratchParents.assign(localCount, noParent);
+        m_scratchChildBegins.assign(localCount + 1, 0);
+        for (size_t i = 0; i < localCount; i++)
+        {
+            const ParentComp* parent = parents.GetCompIfExists(std::as_const(locals.m_entities)[i]);
+            if (parent != nullptr)
+            {
+                const uint32_t parentIndex = locals.m_entityToIndex.Find(parent->m_parentId);
+                if (parentIndex != noParent)
+                {
+                    m_scratchParents[i] = parentIndex;
+                    m_scratchChildBegins[parentIndex + 1]++;
+                }
+            }
+        }
+        for (size_t i = 0; i < localCount; i++)
+        {
+            m_scratchChildBegins[i + 1] += m_scratchChildBegins[i];
+        }
+        m_scratchChildren.resize(localCount);
+        m_scratchCursors.assign(m_scratchChildBegins.begin(), m_scratchChildBegins.end() - 1);
+        for (uint32_t i = 0; i < (uint32_t)localCount; i++)
+        {
+            if (m_scratchParents[i] != noParent)
+            {
+                m_scratchChildren[m_scratchCursors[m_scratchParents[i]]++] = i;
+            }
+        }
+
+        // breadth first from each root, the local indices go in m_scratchOrder, then the ids in m_order
+        m_order.clear();
+        m_parentOrderIndices.clear();
+        m_treeBegins.clear();
+        m_jobBegins.clear();
+        m_scratchOrder.clear();
+        for (uint32_t root = 0; root < (uint32_t)localCount; root++)
+        {
+            if (m_scratchParents[root] != noParent)
+            {
+                continue;
+            }
+            const uint32_t treeBegin = (uint32_t)m_scratchOrder.size();
+            m_treeBegins.push_back(treeBegin);
+            if (m_jobBegins.empty() || treeBegin - m_jobBegins.back() >= m_minEntitiesPerJob)
+            {
+                m_jobBegins.push_back(treeBegin);
+            }
+            m_scratchOrder.push_back(root);
+            m_parentOrderIndices.push_back(m_invalidOrderIndex);
+            for (uint32_t orderIndex = treeBegin; orderIndex < (uint32_t)m_scratchOrder.size(); orderIndex++)
+            {
+                const uint32_t node = m_scratchOrder[orderIndex];
+                for (uint32_t c = m_scratchChildBegins[node]; c < m_scratchChildBegins[node + 1]; c++)
+                {
+                    m_scratchOrder.push_back(m_scratchChildren[c]);
+                    m_parentOrderIndices.push_back(orderIndex);
+                }
+            }
+        }
+        m_treeBegins.push_back((uint32_t)m_scratchOrder.size());
+        m_jobBegins.push_back((uint32_t)m_scratchOrder.size());
+
+        if (m_scratchOrder.size() != localCount)
+        {
+            std::cerr << "error: " << localCount - m_scratchOrder.size() << " entities in ParentComp cycles, their transforms are not updated" << std::endl;
+        }
+
+        m_order.resize(m_scratchOrder.size());
+        for (size_t i = 0; i < m_scratchOrder.size(); i++)
+        {
+            m_order[i] = std::as_const(locals.m_entities)[m_scratchOrder[i]];
+        }
+        m_worldIndices.resize(m_order.size());
+        m_dirty.resize(m_order.size());
+
+        m_localCount = localCount;
+        m_parentCount = parents.m_comps.size();
+        m_needsRebuild = false;
+        m_recomputeAll = true;
+    }
+
+    // false if an entity of the order lost its transforms, nothing is wrong but the order must be rebuilt
+    bool Propagate(ComponentGrid& grid, Bof::JobSystem& jobSystem)
+    {
+        const ComponentVector<LocalTransformComp>& locals = *grid.GetComps<LocalTransformComp>();
+        ComponentVector<WorldTransformComp>& worlds = *grid.GetComps<WorldTransformComp>();
+        worlds.MakePagesUnique();
+
+        const uint32_t lastSeenTick = m_recomputeAll ? 0 : m_lastSeenTick;
+        const bool recomputeAll = m_recomputeAll;
+        std::atomic<bool> isMissingEntity = false;
+        std::atomic<size_t> updatedCount = 0;
+
+        jobSystem.ParallelFor(m_jobBegins.size() - 1, 1, [&](size_t jobBegin, size_t jobEnd)
+        {
+            size_t jobUpdatedCount = 0;
+            for (uint32_t i = m_jobBegins[jobBegin]; i < m_jobBegins[jobEnd]; i++)
+            {
+                const GoodId entityId = m_order[i];
+                const uint32_t localIndex = locals.m_entityToIndex.Find(entityId);
+                const uint32_t worldIndex = worlds.m_entityToIndex.Find(entityId);
+                m_worldIndices[i] = worldIndex;
+                if (localIndex == EntitySlotMap::m_invalidIndex || worldIndex == EntitySlotMap::m_invalidIndex)
+                {
+                    isMissingEntity = true;
+                    m_dirty[i] = false;
+                    continue;
+                }
+
+                const uint32_t parentOrderIndex = m_parentOrderIndices[i];
+                const bool hasParent = parentOrderIndex != m_invalidOrderIndex;
+                const bool isDirty = recomputeAll || locals.HasChangedSince(localIndex, lastSeenTick) || (hasParent && m_dirty[parentOrderIndex]);
+                m_dirty[i] = isDirty;
+                if (!isDirty)
+                {
+                    continue;
+                }
+
+                const glm::mat4 localMatrix = std::as_const(locals.m_comps)[localIndex].GetMatrix();
+                glm::mat4& worldMatrix = worlds.m_comps[worldIndex].m_matrix;
+                if (hasParent && m_worldIndices[parentOrderIndex] != EntitySlotMap::m_invalidIndex)
+                {
+                    worldMatrix = std::as_const(worlds.m_comps)[m_worldIndices[parentOrderIndex]].m_matrix * localMatrix;
+                }
+                else
+                {
+                    worldMatrix = localMatrix;
+                }
+                worlds.MarkChanged(worldIndex);
+                jobUpdatedCount++;
+            }
+            updatedCount += jobUpdatedCount;
+        });
+
+        m_lastUpdatedCount = updatedCount;
+        if (isMissingEntity)
+        {
+            m_needsRebuild = true;
+            return false;
+        }
+        m_recomputeAll = false;
+        return true;
+    }
+
+    static constexpr uint32_t m_invalidOrderIndex = UINT32_MAX;
+
+    vector<GoodId> m_order;
+    vector<uint32_t> m_parentOrderIndices; // index in m_order of the parent of each one
+    vector<uint32_t> m_treeBegins; // index in m_order of each root, plus the end
+    vector<uint32_t> m_jobBegins; // the same, only one root every m_minEntitiesPerJob entities
+
+    // per Update, at the index of the entity in m_order
+    vector<uint32_t> m_worldIndices;
+    vector<uint8_t> m_dirty;
+
+    // Rebuild only, kept for their memory
+    vector<uint32_t> m_scratchParents;
+    vector<uint32_t> m_scratchChildBegins;
+    vector<uint32_t> m_scratchChildren;
+    vector<uint32_t> m_scratchCursors;
+    vector<uint32_t> m_scratchOrder;
+
+    size_t m_localCount = 0;
+    size_t m_parentCount = 0;
+    uint32_t m_lastSeenTick = 0;
+    size_t m_lastUpdatedCount = 0;
+    bool m_needsRebuild = true;
+    bool m_recomputeAll = true;
+};
@@ -26,6 +26,10 @@
 #include "../errors.h"
 #include "../types.h"
 
+// simon: the engine paged vector, serialized like a std::vector
+template <typename T, size_t PageByteSize>
+class PagedVector;
+
 namespace pods
 {
     namespace details
@@ -228,6 +232,13 @@ namespace pods
                 return loadSequenceContainer<T>(value);
             }
 
+            // simon
+            template <class T, size_t PageByteSize>
+            Error doProcess(::PagedVector<T, PageByteSize>& value)
+            {
+                return loadSequenceContainer<T>(value);
+            }
+
             template <class T>
             Error doProcess(std::deque<T>& value)
             {
@@ -26,6 +26,10 @@
 #include "../errors.h"
 #include "../types.h"
 
+// simon: the engine paged vector, serialized like a std::vector
+template <typename T, size_t PageByteSize>
+class PagedVector;
+
 namespace pods
 {
     namespace details
@@ -235,6 +239,13 @@ namespace pods
                 return saveArray<const T>(value.data(), value.size());
             }
 
+            // simon
+            template <class T, size_t PageByteSize>
+            Error doProcess(const ::PagedVector<T, PageByteSize>& value)
+            {
+                return saveArray<const T>(value.cbegin(), value.size());
+            }
+
             template <class T>
             Error doProcess(const std::deque<T>& value)
             {
@@ -20,8 +20,8 @@ namespace Bof
 		static void Init()
 		{
 			std::vector<spdlog::sink_ptr> sinks;
-			sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_st>());
-			sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_st>("BofEngine.log", true));
+			sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+			sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>("BofEngine.log", true));
 
 			spdlog::set_default_logger(std::make_shared<spdlog::logger>("Bof", begin(sinks), end(sinks)));
 			spdlog::default_logger()->sinks()[0]->set_pattern("[%H:%M:%S] [%^%L%$] %v");
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Frame times counted in buckets of m_bucketMS, the last bucket has everything longer.
+// One thread adds, any thread can read (relaxed atomics, a read during an Add can be one frame off).
+//
+//  histogram.Add(frameTimeMS);
+//  ImGui::Text("p99 %.1f ms", histogram.GetPercentileMS(0.99));
+class FrameTimeHistogram
+{
+public:
+    static constexpr int m_bucketCount = 100;
+    static constexpr double m_bucketMS = 0.5;
+
+    void Add(double frameTimeMS)
+    {
+        const int bucket = std::clamp((int)(frameTimeMS / m_bucketMS), 0, m_bucketCount - 1);
+        m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_totalCount.fetch_add(1, std::memory_order_relaxed);
+
+        const int64_t frameTimeMicros = (int64_t)(frameTimeMS * 1000.0);
+        m_totalMicros.fetch_add(frameTimeMicros, std::memory_order_relaxed);
+        if (frameTimeMicros > m_maxMicros.load(std::memory_order_relaxed))
+        {
+            m_maxMicros.store(frameTimeMicros, std::memory_order_relaxed);
+        }
+    }
+
+    // from the adding thread
+    void Clear()
+    {
+        for (std::atomic<uint32_t>& count : m_counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+        m_totalCount.store(0, std::memory_order_relaxed);
+        m_totalMicros.store(0, std::memory_order_relaxed);
+        m_maxMicros.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t GetCount(int bucket) const { return m_counts[bucket].load(std::memory_order_relaxed); }
+    uint64_t GetTotalCount() const { return m_totalCount.load(std::memory_order_relaxed); }
+
+    double GetMeanMS() const
+    {
+        const uint64_t totalCount = GetTotalCount();
+        return totalCount == 0 ? 0.0 : m_totalMicros.load(std::memory_order_relaxed) / 1000.0 / totalCount;
+    }
+    double GetMaxMS() const { return m_maxMicros.load(std::memory_order_relaxed) / 1000.0; }
+
+    // the end of the bucket where the percentile falls, 0.5 for the median
+    double GetPercentileMS(double percentile) const
+    {
+        const uint64_t wantedCount = (uint64_t)(percentile * GetTotalCount());
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < m_bucketCount; bucket++)
+        {
+            count += GetCount(bucket);
+            if (count > wantedCount)
+            {
+                return (bucket + 1) * m_bucketMS;
+            }
+        }
+        return m_bucketCount * m_bucketMS;
+    }
+
+    // as floats, for ImGui::PlotHistogram
+    void GetCounts(std::array<float, m_bucketCount>& outCounts) const
+    {
+        for (int bucket = 0; bucket < m_bucketCount; bucket++)
+        {
+            outCounts[bucket] = (float)GetCount(bucket);
+        }
+    }
+
+private:
+    std::array<std::atomic<uint32_t>, m_bucketCount> m_counts = {};
+    std::atomic<uint64_t> m_totalCount = 0;
+    std::atomic<int64_t> m_totalMicros = 0;
+    std::atomic<int64_t> m_maxMicros = 0;
+};
@@ -3,6 +3,9 @@
 //#include <assert.h>
 
 #include <string>
+#include <array>
+#include <concepts>
+#include <type_traits>
 #include <fstream>
 #include <iostream>
 #include "pods/pods.h"
@@ -291,10 +294,131 @@ private:
 
 
 
+// Field by field deltas, walking the GOOD field list of a class like a pods serializer would.
+// Used by GoodHelpers::WriteDelta: a changed comp only sends the fields that changed, with a bit mask.
+//
+// GoodFieldAddressCollector records where each field of the base object lives, then GoodFieldComparer
+// walks the new object and sets the bit of each field that differs. Fields without operator== always differ.
+// GoodMaskedFields then saves (or loads) only the fields of the mask, with a pods serializer (or deserializer).
+
+static constexpr size_t g_maxGoodDeltaFieldCount = 64;
+
+class GoodFieldAddressCollector
+{
+public:
+    explicit GoodFieldAddressCollector(std::array<const void*, g_maxGoodDeltaFieldCount>& fields) : m_fields(fields) {}
+
+    pods::Error operator()() { return pods::Error::NoError; }
+
+    template <class FieldType, class... ArgsT>
+    pods::Error operator()(const char* /*name*/, FieldType&& field, ArgsT&&... args)
+    {
+        assert(m_fieldCount < g_maxGoodDeltaFieldCount && "too many GOOD fields for a delta");
+        m_fields[m_fieldCount++] = &field;
+        return (*this)(std::forward<ArgsT>(args)...);
+    }
+
+private:
+    std::array<const void*, g_maxGoodDeltaFieldCount>& m_fields;
+    size_t m_fieldCount = 0;
+};
+
+class GoodFieldComparer
+{
+public:
+    explicit GoodFieldComparer(const std::array<const void*, g_maxGoodDeltaFieldCount>& baseFields) : m_baseFields(baseFields) {}
+
+    pods::Error operator()() { return pods::Error::NoError; }
+
+    template <class FieldType, class... ArgsT>
+    pods::Error operator()(const char* /*name*/, FieldType&& field, ArgsT&&... args)
+    {
+        using Field = std::remove_cvref_t<FieldType>;
+        const Field& baseField = *static_cast<const Field*>(m_baseFields[m_fieldIndex]);
+        if (!AreFieldsEqual(field, baseField))
+        {
+            m_changedMask |= uint64_t(1) << m_fieldIndex;
+        }
+        m_fieldIndex++;
+        return (*this)(std::forward<ArgsT>(args)...);
+    }
+
+    inline uint64_t GetChangedMask() const { return m_changedMask; }
+
+private:
+    template <class Field>
+    static inline bool AreFieldsEqual(const Field& field, const Field& baseField)
+    {
+        if constexpr (std::is_array_v<Field>)
+        {
+            // == on C arrays compares the addresses
+            for (size_t i = 0; i < std::extent_v<Field>; i++)
+            {
+                if (!AreFieldsEqual(field[i], baseField[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        else if constexpr (std::equality_comparable<Field>)
+        {
+            return field == baseField;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    const std::array<const void*, g_maxGoodDeltaFieldCount>& m_baseFields;
+    size_t m_fieldIndex = 0;
+    uint64_t m_changedMask = 0;
+};
+
+template <class Archive>
+class GoodMaskedFields
+{
+public:
+    GoodMaskedFields(Archive& archive, uint64_t mask) : m_archive(archive), m_mask(mask) {}
+
+    pods::Error operator()() { return pods::Error::NoError; }
+
+    template <class FieldType, class... ArgsT>
+    pods::Error operator()(const char* name, FieldType&& field, ArgsT&&... args)
+    {
+        if (m_mask & (uint64_t(1) << m_fieldIndex))
+        {
+            PODS_SAFE_CALL(m_archive(name, field));
+        }
+        m_fieldIndex++;
+        return (*this)(std::forward<ArgsT>(args)...);
+    }
+
+private:
+    Archive& m_archive;
+    uint64_t m_mask;
+    size_t m_fieldIndex = 0;
+};
+
+
+class ComponentGrid;
+
+
+
 class GoodHelpers
 {
 public:
 
+    // Only what changed between two states of a grid, in binary: for each tag and comp type, the entities
+    // removed, the entities added (whole comps) and, for the others, the GOOD fields that changed.
+    // ApplyDelta on a grid equal to baseGrid makes it equal to newGrid, except maybe for the order of
+    // the entities in the vectors. Both grids need the same comp vectors.
+    // When newGrid is a Snapshot of baseGrid (or the other way around), the comps sitting in shared pages
+    // are not even compared. Defined in GoodComponents.h.
+    static pods::Error WriteDelta(const ComponentGrid& baseGrid, const ComponentGrid& newGrid, pods::ResizableOutputBuffer& out);
+    static pods::Error ApplyDelta(ComponentGrid& grid, pods::InputBuffer& in);
+
     template <class T>
     inline static pods::Error SerializeTyped(
         pods::ResizableOutputBuffer& out,
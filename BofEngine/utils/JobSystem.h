@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+//
+#include "BofAsserts.h"
+
+namespace Bof
+{
+
+// A fixed pool of worker threads, with work stealing.
+//
+// Run(jobCount, job) calls job(0) .. job(jobCount - 1), spread over the workers and the calling thread,
+// and returns when they are all done. The calling thread works too, so a JobSystem with 0 workers
+// just runs everything inline (handy to compare, and to debug).
+//
+// Every worker has its own queue. Run pushes its jobs in the queue of the calling thread, the owner
+// takes them from the back, idle threads steal from the front of the others' queues.
+// A thread waiting for its jobs keeps running jobs (its own or stolen ones), so Run can be called from
+// inside a job: a system running on a worker can use ComponentVector::ParallelForEach.
+//
+// Which thread runs which job is not deterministic. What a job does with its index should not depend on it.
+class JobSystem
+{
+public:
+    // by default, one worker per core, minus the one that calls Run
+    JobSystem() : JobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1) {}
+
+    explicit JobSystem(size_t workerCount)
+    {
+        // queue 0 is for the threads that are not workers
+        for (size_t i = 0; i < workerCount + 1; i++)
+        {
+            m_queues.push_back(std::make_unique<WorkQueue>());
+        }
+        for (size_t i = 0; i < workerCount; i++)
+        {
+            m_workers.emplace_back([this, i]() { WorkerLoop(i + 1); });
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard lock(m_sleepMutex);
+            m_stop = true;
+        }
+        m_wakeUpWorkers.notify_all();
+        for (std::thread& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    // the one used by ParallelForEach when you don't give one. Created on first use.
+    static JobSystem& GetDefault()
+    {
+        static JobSystem s_defaultJobSystem;
+        return s_defaultJobSystem;
+    }
+
+    // workers + the thread that calls Run
+    inline size_t GetThreadCount() const { return m_workers.size() + 1; }
+
+    // in [0, GetThreadCount()): the workers are 1 and up, any thread that is not one of our workers is 0.
+    // For per thread scratch data (see GridCommandBuffer).
+    inline size_t GetThreadIndex() const { return GetQueueIndex(); }
+    // on a worker of another JobSystem, for which GetThreadIndex here is 0 like on any other thread
+    inline bool IsWorkerOfAnotherJobSystem() const { return t_jobSystem != nullptr && t_jobSystem != this; }
+
+    void Run(size_t jobCount, const std::function<void(size_t)>& job)
+    {
+        if (jobCount == 0)
+        {
+            return;
+        }
+        if (m_workers.empty() || jobCount == 1)
+        {
+            for (size_t i = 0; i < jobCount; i++)
+            {
+                job(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> pendingJobCount = jobCount;
+        WorkQueue& queue = *m_queues[GetQueueIndex()];
+        // counted before they are visible, so that the count is never below the real number
+        m_queuedTaskCount.fetch_add(jobCount);
+        {
+            std::lock_guard lock(queue.m_mutex);
+            // reversed, so that the owner takes them in order, and thieves take the far end
+            for (size_t i = jobCount; i > 0; i--)
+            {
+                queue.m_tasks.push_back(Task{ &job, i - 1, &pendingJobCount });
+            }
+        }
+        {
+            std::lock_guard lock(m_sleepMutex);
+        }
+        m_wakeUpWorkers.notify_all();
+
+        while (pendingJobCount.load(std::memory_order_acquire) != 0)
+        {
+            if (!RunOneTask(GetQueueIndex()))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Calls func(begin, end) on [0, count) cut in chunks of grainSize (the last one can be smaller).
+    // The chunk boundaries only depend on count and grainSize, never on the number of threads.
+    template <typename Func>
+    void ParallelFor(size_t count, size_t grainSize, Func&& func)
+    {
+        grainSize = std::max<size_t>(grainSize, 1);
+        const size_t chunkCount = (count + grainSize - 1) / grainSize;
+        Run(chunkCount, [&](size_t chunkIndex)
+        {
+            const size_t begin = chunkIndex * grainSize;
+            func(begin, std::min(begin + grainSize, count));
+        });
+    }
+
+private:
+    struct Task
+    {
+        const std::function<void(size_t)>* m_job = nullptr;
+        size_t m_index = 0;
+        std::atomic<size_t>* m_pendingJobCount = nullptr;
+    };
+
+    // a mutex and a deque: jobs are chunks of thousands of comps, the lock is not what costs
+    struct WorkQueue
+    {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
+    inline size_t GetQueueIndex() const
+    {
+        return t_jobSystem == this ? t_queueIndex : 0;
+    }
+
+    // own queue first (from the back), then steal (from the front). false if there was nothing to do.
+    bool RunOneTask(size_t queueIndex)
+    {
+        Task task;
+        bool found = false;
+        {
+            WorkQueue& queue = *m_queues[queueIndex];
+            std::lock_guard lock(queue.m_mutex);
+            if (!queue.m_tasks.empty())
+            {
+                task = queue.m_tasks.back();
+                queue.m_tasks.pop_back();
+                found = true;
+            }
+        }
+        for (size_t i = 1; !found && i < m_queues.size(); i++)
+        {
+            WorkQueue& victim = *m_queues[(queueIndex + i) % m_queues.size()];
+            std::lock_guard lock(victim.m_mutex);
+            if (!victim.m_tasks.empty())
+            {
+                task = victim.m_tasks.front();
+                victim.m_tasks.pop_front();
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+
+        m_queuedTaskCount.fetch_sub(1);
+        (*task.m_job)(task.m_index);
+        task.m_pendingJobCount->fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void WorkerLoop(size_t queueIndex)
+    {
+        t_jobSystem = this;
+        t_queueIndex = queueIndex;
+        while (true)
+        {
+            if (RunOneTask(queueIndex))
+            {
+                continue;
+            }
+            std::unique_lock lock(m_sleepMutex);
+            m_wakeUpWorkers.wait(lock, [this]() { return m_stop || m_queuedTaskCount.load() > 0; });
+            if (m_stop)
+            {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+    std::atomic<size_t> m_queuedTaskCount = 0;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUpWorkers;
+    bool m_stop = false;
+
+    static inline thread_local JobSystem* t_jobSystem = nullptr;
+    static inline thread_local size_t t_queueIndex = 0;
+};
+
+}
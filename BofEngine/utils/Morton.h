@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace Bof
+{
+
+// Morton code (Z order curve): the bits of x, y and z interleaved. Points close in space mostly get close
+// codes, so sorting things by it keeps neighbours close in memory (see ComponentGrid::SortBy).
+
+// the 21 low bits of value, spread to every third bit
+inline uint64_t SpreadBitsBy3(uint32_t value)
+{
+    uint64_t bits = value & 0x1fffff;
+    bits = (bits | bits << 32) & 0x1f00000000ffff;
+    bits = (bits | bits << 16) & 0x1f0000ff0000ff;
+    bits = (bits | bits << 8) & 0x100f00f00f00f00f;
+    bits = (bits | bits << 4) & 0x10c30c30c30c30c3;
+    bits = (bits | bits << 2) & 0x1249249249249249;
+    return bits;
+}
+
+inline uint64_t MortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return SpreadBitsBy3(x) | (SpreadBitsBy3(y) << 1) | (SpreadBitsBy3(z) << 2);
+}
+
+// position cut in cells of cellSize from origin, 2^21 cells per axis. Outside of that it's clamped.
+inline uint64_t MortonCode(const glm::vec3& position, const glm::vec3& origin, float cellSize)
+{
+    constexpr float maxCell = (float)0x1fffff;
+    const glm::vec3 cell = glm::clamp(glm::floor((position - origin) / cellSize), glm::vec3(0.0f), glm::vec3(maxCell));
+    return MortonCode((uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z);
+}
+
+}
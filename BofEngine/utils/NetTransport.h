@@ -0,0 +1,473 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <iostream>
+
+// don't care about warnings from those
+#pragma warning(push, 0)
+#include "kissnet/kissnet.hpp"
+#pragma warning(pop)
+
+#include "utils/GoodSave.h"
+#include "utils/Timer.h"
+
+using namespace std;
+
+
+struct NetTransportStats
+{
+    uint64_t m_datagramsSent = 0;
+    uint64_t m_datagramsReceived = 0;
+    uint64_t m_bytesSent = 0;
+    uint64_t m_bytesReceived = 0;
+
+    uint64_t m_messagesSent = 0;
+    uint64_t m_messagesReceived = 0;
+    // redundant messages sent again because they weren't acked yet
+    uint64_t m_messagesResent = 0;
+    // redundant messages already received, from a datagram that was sent again
+    uint64_t m_duplicatesDropped = 0;
+    // redundant messages given up on, too many waiting for an ack
+    uint64_t m_messagesDropped = 0;
+    uint64_t m_malformedDatagrams = 0;
+    // dropped on purpose, see SetSimulatedLoss
+    uint64_t m_simulatedLosses = 0;
+
+    // smoothed, from the acks
+    double m_roundTripMillis = 0.0;
+};
+
+
+// GoodSerializable messages over UDP, between this side and one other (kissnet sockets).
+//
+//  PlayerInput::RegisterClass(); // DeserializeTyped must know the classes
+//  NetTransport transport("0.0.0.0:27015", "192.168.1.12:27016"); // where we listen, where the other side listens
+//  transport.SendRedundant(input); // in every datagram until the other side acks one of them
+//  transport.Send(chatMessage);    // once, may be lost
+//  transport.Flush();              // once per tick: all of it in as few datagrams as possible
+//  transport.Receive([&](GoodSerializable& message)
+//  {
+//      if (message.GetClassIdVirtual() == PlayerInput::GetClassId())
+//      {
+//          simulation.ReceivePlayerInput(message.Cast<PlayerInput>());
+//      }
+//  });
+//
+// Messages are GoodHelpers::SerializeTyped, so the other side knows what they are. Flush packs the messages
+// back to back in datagrams of at most m_maxDatagramSize, under the MTU of pretty much any route.
+// Each datagram has a sequence number, the latest sequence received from the other side and a bit for
+// each of the 32 before it: every datagram acks the last 33 received. Until a side has received something,
+// its datagrams say they have no acks (m_hasAcksFlag), the zeros there are not an ack of datagram 0. There is no resend of lost datagrams:
+// redundant messages just go in every datagram until one of those is acked, which is what inputs need
+// (a new datagram every tick carries all the recent inputs, one of them gets through).
+// Redundant messages have an id so that the receiver drops the copies.
+//
+// Receive uses the same buffer for every datagram and the send side keeps its buffers,
+// the only allocation left per message is the GoodSerializable that DeserializeTyped makes.
+// Numbers are in the host byte order, both sides are little endian PCs.
+class NetTransport
+{
+public:
+    static constexpr size_t m_maxDatagramSize = 1200;
+
+    NetTransport(const std::string& localEndpoint, const std::string& remoteEndpoint)
+        : m_receiveSocket(kissnet::endpoint(localEndpoint))
+        , m_sendSocket(kissnet::endpoint(remoteEndpoint))
+    {
+        m_receiveSocket.bind();
+        m_receiveSocket.set_non_blocking(true);
+        m_sendSocket.set_non_blocking(true);
+        m_sendBuffer.reserve(m_maxDatagramSize);
+    }
+
+    // sent in the next Flush only
+    template <class T>
+    bool Send(const T& message)
+    {
+        if (!SerializeMessage(message))
+        {
+            return false;
+        }
+        AppendMessage(m_unreliableMessages, 0, (const uint8_t*)m_serializeBuffer.data(), (uint16_t)m_serializeBuffer.size());
+        m_stats.m_messagesSent++;
+        return true;
+    }
+
+    // sent in every Flush until a datagram that had it is acked
+    template <class T>
+    bool SendRedundant(const T& message)
+    {
+        if (!SerializeMessage(message))
+        {
+            return false;
+        }
+        if (m_pendingMessages.size() >= m_maxPendingMessageCount)
+        {
+            // the other side doesn't ack anymore, don't pile up forever
+            RecycleBytes(m_pendingMessages.front().m_bytes);
+            m_pendingMessages.erase(m_pendingMessages.begin());
+            m_stats.m_messagesDropped++;
+        }
+
+        m_nextMessageId = m_nextMessageId == UINT16_MAX ? 1 : m_nextMessageId + 1;
+        PendingMessage& pending = m_pendingMessages.emplace_back();
+        pending.m_id = m_nextMessageId;
+        if (!m_freeByteBuffers.empty())
+        {
+            pending.m_bytes = std::move(m_freeByteBuffers.back());
+            m_freeByteBuffers.pop_back();
+        }
+        pending.m_bytes.assign((const uint8_t*)m_serializeBuffer.data(), (const uint8_t*)m_serializeBuffer.data() + m_serializeBuffer.size());
+        m_stats.m_messagesSent++;
+        return true;
+    }
+
+    // the messages of Send and SendRedundant since the last Flush, and the redundant ones not acked yet.
+    // If there is nothing to send but something was received, an empty datagram goes anyway for the acks.
+    void Flush()
+    {
+        // the acked ones are done
+        size_t keptCount = 0;
+        for (size_t i = 0; i < m_pendingMessages.size(); i++)
+        {
+            PendingMessage& pending = m_pendingMessages[i];
+            if (m_ackedMessageIds[pending.m_id % m_messageWindowSize] == pending.m_id)
+            {
+                RecycleBytes(pending.m_bytes);
+                continue;
+            }
+            if (keptCount != i)
+            {
+                std::swap(m_pendingMessages[keptCount], pending);
+            }
+            keptCount++;
+        }
+        m_pendingMessages.resize(keptCount);
+
+        BeginDatagram();
+        for (PendingMessage& pending : m_pendingMessages)
+        {
+            AddToDatagram(pending.m_id, pending.m_bytes.data(), (uint16_t)pending.m_bytes.size());
+            m_stats.m_messagesResent += pending.m_sendCount > 0 ? 1 : 0;
+            pending.m_sendCount++;
+        }
+        for (size_t offset = 0; offset < m_unreliableMessages.size();)
+        {
+            uint16_t size;
+            memcpy(&size, m_unreliableMessages.data() + offset, sizeof(size));
+            AddToDatagram(0, m_unreliableMessages.data() + offset + m_messageHeaderSize, size);
+            offset += m_messageHeaderSize + size;
+        }
+        m_unreliableMessages.clear();
+
+        if (m_currentMessageCount > 0 || m_hasReceivedSinceFlush)
+        {
+            SendDatagram();
+        }
+        m_hasReceivedSinceFlush = false;
+    }
+
+    // func(GoodSerializable& message) for each message arrived since the last call, doesn't wait
+    template <class Func>
+    void Receive(Func&& func)
+    {
+        for (;;)
+        {
+            const auto [receivedSize, status] = m_receiveSocket.recv(m_receiveBuffer);
+            if (receivedSize == 0 || !status)
+            {
+                return;
+            }
+            m_stats.m_datagramsReceived++;
+            m_stats.m_bytesReceived += receivedSize;
+            if (!ReadDatagram((const uint8_t*)m_receiveBuffer.data(), receivedSize, func))
+            {
+                m_stats.m_malformedDatagrams++;
+            }
+        }
+    }
+
+    // the ratio of datagrams not sent, to see the redundancy do its thing
+    void SetSimulatedLoss(float lossRatio)
+    {
+        m_simulatedLoss = lossRatio;
+    }
+
+    const NetTransportStats& GetStats() const { return m_stats; }
+    size_t GetPendingMessageCount() const { return m_pendingMessages.size(); }
+
+private:
+    static constexpr uint32_t m_protocolId = 0xB0F0E702;
+    // protocol id, sequence, ack, ack bits, message count, flags
+    static constexpr size_t m_datagramHeaderSize = 4 + 2 + 2 + 4 + 2 + 1;
+    // ack and ack bits are meaningful
+    static constexpr uint8_t m_hasAcksFlag = 1;
+    // size, id (0 for the not redundant ones)
+    static constexpr size_t m_messageHeaderSize = 2 + 2;
+    static constexpr size_t m_maxMessageSize = m_maxDatagramSize - m_datagramHeaderSize - m_messageHeaderSize;
+
+    // the sent datagrams and the redundant message ids are remembered in rings this big
+    static constexpr size_t m_datagramWindowSize = 1024;
+    static constexpr size_t m_messageWindowSize = 1024;
+    static constexpr size_t m_maxPendingMessageCount = m_messageWindowSize / 2;
+
+    struct PendingMessage
+    {
+        uint16_t m_id = 0;
+        int m_sendCount = 0;
+        vector<uint8_t> m_bytes;
+    };
+
+    struct SentDatagram
+    {
+        uint16_t m_sequence = 0;
+        bool m_waitingForAck = false;
+        int64_t m_sendTimeNano = 0;
+        vector<uint16_t> m_messageIds;
+    };
+
+    // a newer than b, with the wrap around
+    static bool IsSequenceNewer(uint16_t a, uint16_t b)
+    {
+        return ((a > b) && (a - b <= 32768)) || ((a < b) && (b - a > 32768));
+    }
+
+    template <class T>
+    bool SerializeMessage(const T& message)
+    {
+        m_serializeBuffer.clear();
+        if (GoodHelpers::SerializeTyped(m_serializeBuffer, message) != pods::Error::NoError)
+        {
+            std::cerr << "error: can't serialize message " << T::GetClassName() << std::endl;
+            return false;
+        }
+        if (m_serializeBuffer.size() > m_maxMessageSize)
+        {
+            std::cerr << "error: message " << T::GetClassName() << " is " << m_serializeBuffer.size() << " bytes, more than a datagram" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static void AppendMessage(vector<uint8_t>& bytes, uint16_t id, const uint8_t* data, uint16_t size)
+    {
+        const size_t offset = bytes.size();
+        bytes.resize(offset + m_messageHeaderSize + size);
+        memcpy(bytes.data() + offset, &size, sizeof(size));
+        memcpy(bytes.data() + offset + 2, &id, sizeof(id));
+        memcpy(bytes.data() + offset + m_messageHeaderSize, data, size);
+    }
+
+    void RecycleBytes(vector<uint8_t>& bytes)
+    {
+        bytes.clear();
+        m_freeByteBuffers.push_back(std::move(bytes));
+    }
+
+    void BeginDatagram()
+    {
+        m_sendBuffer.resize(m_datagramHeaderSize);
+        m_currentMessageCount = 0;
+        SentDatagram& sent = m_sentDatagrams[m_nextSequence % m_datagramWindowSize];
+        sent.m_messageIds.clear();
+    }
+
+    void AddToDatagram(uint16_t id, const uint8_t* data, uint16_t size)
+    {
+        if (m_sendBuffer.size() + m_messageHeaderSize + size > m_maxDatagramSize)
+        {
+            SendDatagram();
+            BeginDatagram();
+        }
+        AppendMessage(m_sendBuffer, id, data, size);
+        m_currentMessageCount++;
+        if (id != 0)
+        {
+            m_sentDatagrams[m_nextSequence % m_datagramWindowSize].m_messageIds.push_back(id);
+        }
+    }
+
+    void SendDatagram()
+    {
+        const uint16_t sequence = m_nextSequence++;
+        uint8_t* header = m_sendBuffer.data();
+        memcpy(header, &m_protocolId, 4);
+        memcpy(header + 4, &sequence, 2);
+        memcpy(header + 6, &m_remoteSequence, 2);
+        memcpy(header + 8, &m_receivedBits, 4);
+        memcpy(header + 12, &m_currentMessageCount, 2);
+        header[14] = m_hasReceived ? m_hasAcksFlag : 0;
+
+        SentDatagram& sent = m_sentDatagrams[sequence % m_datagramWindowSize];
+        sent.m_sequence = sequence;
+        sent.m_waitingForAck = true;
+        sent.m_sendTimeNano = m_clock.GetTimeNano();
+
+        m_stats.m_datagramsSent++;
+        if (m_simulatedLoss > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(m_lossRng) < m_simulatedLoss)
+        {
+            m_stats.m_simulatedLosses++;
+            return;
+        }
+        const auto [sentSize, status] = m_sendSocket.send((const std::byte*)m_sendBuffer.data(), m_sendBuffer.size());
+        if (!status)
+        {
+            std::cerr << "error: can't send datagram " << sequence << std::endl;
+            return;
+        }
+        m_stats.m_bytesSent += sentSize;
+    }
+
+    void OnAck(uint16_t sequence, int64_t nowNano)
+    {
+        SentDatagram& sent = m_sentDatagrams[sequence % m_datagramWindowSize];
+        if (!sent.m_waitingForAck || sent.m_sequence != sequence)
+        {
+            return;
+        }
+        sent.m_waitingForAck = false;
+        for (uint16_t id : sent.m_messageIds)
+        {
+            m_ackedMessageIds[id % m_messageWindowSize] = id;
+        }
+        const double roundTripMillis = (nowNano - sent.m_sendTimeNano) / 1000000.0;
+        m_stats.m_roundTripMillis = m_stats.m_roundTripMillis == 0.0
+            ? roundTripMillis
+            : m_stats.m_roundTripMillis + (roundTripMillis - m_stats.m_roundTripMillis) * 0.1;
+    }
+
+    template <class Func>
+    bool ReadDatagram(const uint8_t* data, size_t size, Func&& func)
+    {
+        if (size < m_datagramHeaderSize)
+        {
+            return false;
+        }
+        uint32_t protocolId;
+        uint16_t sequence;
+        uint16_t ack;
+        uint32_t ackBits;
+        uint16_t messageCount;
+        memcpy(&protocolId, data, 4);
+        memcpy(&sequence, data + 4, 2);
+        memcpy(&ack, data + 6, 2);
+        memcpy(&ackBits, data + 8, 4);
+        memcpy(&messageCount, data + 12, 2);
+        const uint8_t flags = data[14];
+        if (protocolId != m_protocolId)
+        {
+            return false;
+        }
+
+        // what they got from us, if they got anything
+        if (flags & m_hasAcksFlag)
+        {
+            const int64_t nowNano = m_clock.GetTimeNano();
+            OnAck(ack, nowNano);
+            for (uint16_t bit = 0; bit < 32; bit++)
+            {
+                if (ackBits & (1u << bit))
+                {
+                    OnAck((uint16_t)(ack - 1 - bit), nowNano);
+                }
+            }
+        }
+
+        // what we got from them, for our next acks
+        if (!m_hasReceived || IsSequenceNewer(sequence, m_remoteSequence))
+        {
+            const uint16_t shift = m_hasReceived ? (uint16_t)(sequence - m_remoteSequence) : 0;
+            if (m_hasReceived)
+            {
+                m_receivedBits = shift > 32 ? 0 : shift == 32 ? (1u << 31) : ((m_receivedBits << shift) | (1u << (shift - 1)));
+            }
+            m_remoteSequence = sequence;
+            m_hasReceived = true;
+        }
+        else
+        {
+            const uint16_t age = (uint16_t)(m_remoteSequence - sequence);
+            if (age >= 1 && age <= 32)
+            {
+                m_receivedBits |= 1u << (age - 1);
+            }
+        }
+        m_hasReceivedSinceFlush = true;
+
+        size_t offset = m_datagramHeaderSize;
+        for (uint16_t i = 0; i < messageCount; i++)
+        {
+            if (offset + m_messageHeaderSize > size)
+            {
+                return false;
+            }
+            uint16_t messageSize;
+            uint16_t id;
+            memcpy(&messageSize, data + offset, 2);
+            memcpy(&id, data + offset + 2, 2);
+            offset += m_messageHeaderSize;
+            if (offset + messageSize > size)
+            {
+                return false;
+            }
+
+            const uint8_t* messageData = data + offset;
+            offset += messageSize;
+            if (id != 0)
+            {
+                uint16_t& receivedId = m_receivedMessageIds[id % m_messageWindowSize];
+                if (receivedId == id)
+                {
+                    m_stats.m_duplicatesDropped++;
+                    continue;
+                }
+                receivedId = id;
+            }
+
+            pods::InputBuffer in((const char*)messageData, messageSize);
+            std::unique_ptr<GoodSerializable> message = GoodHelpers::DeserializeTyped(in);
+            if (message == nullptr)
+            {
+                return false;
+            }
+            m_stats.m_messagesReceived++;
+            func(*message);
+        }
+        return true;
+    }
+
+    kissnet::udp_socket m_receiveSocket;
+    kissnet::udp_socket m_sendSocket;
+
+    pods::ResizableOutputBuffer m_serializeBuffer;
+    vector<uint8_t> m_unreliableMessages;
+    vector<PendingMessage> m_pendingMessages;
+    vector<vector<uint8_t>> m_freeByteBuffers;
+    uint16_t m_nextMessageId = 0;
+
+    vector<uint8_t> m_sendBuffer;
+    uint16_t m_currentMessageCount = 0;
+    uint16_t m_nextSequence = 0;
+    std::array<SentDatagram, m_datagramWindowSize> m_sentDatagrams;
+    // the id of each redundant message acked, at id % m_messageWindowSize
+    std::array<uint16_t, m_messageWindowSize> m_ackedMessageIds = {};
+
+    kissnet::buffer<m_maxDatagramSize> m_receiveBuffer;
+    bool m_hasReceived = false;
+    bool m_hasReceivedSinceFlush = false;
+    uint16_t m_remoteSequence = 0;
+    uint32_t m_receivedBits = 0;
+    // the id of each redundant message received, at id % m_messageWindowSize
+    std::array<uint16_t, m_messageWindowSize> m_receivedMessageIds = {};
+
+    float m_simulatedLoss = 0.0f;
+    std::mt19937 m_lossRng{ 1234 };
+
+    Bof::SimpleClock m_clock;
+    NetTransportStats m_stats;
+};
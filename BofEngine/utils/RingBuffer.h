@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <cassert>
+#include <algorithm>
 
 using namespace std;
 
@@ -34,8 +36,8 @@ public:
     int64_t GetCurrentIndex() const { return m_currentIndex; }
 
 
-    inline T& GetCurrent() { return m_array[m_currentIndex]; }
-    inline const T& GetCurrent() const { return m_array[m_currentIndex]; }
+    inline T& GetCurrent() { return m_array[m_currentIndex % N]; }
+    inline const T& GetCurrent() const { return m_array[m_currentIndex % N]; }
 
     inline int64_t GetMinimumAvailableIndex() const { return std::max((int64_t)0, (int64_t)(m_currentIndex - N + 1)); }
     inline int64_t GetMaximumAvailableIndex() const { return m_currentIndex; }
@@ -53,7 +53,8 @@ class SimpleClock
 
 
 // stupid profiler
-inline int g_LogTimeOnDestructionIndentLevel = 0;
+// (the indent is per thread, systems time themselves on the JobSystem workers)
+inline thread_local int g_LogTimeOnDestructionIndentLevel = 0;
 
 class LogTimeOnDestruction final
 {
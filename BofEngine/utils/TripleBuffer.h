@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// Hands the latest T from one thread to another, without locks and without anybody waiting.
+// The writer fills GetWriteBuffer then Publish. The reader calls AcquireLatest then reads GetReadBuffer,
+// which stays untouched by the writer until the next AcquireLatest.
+//
+// There are 3 Ts: the one being written, the one being read, and the last published in the middle.
+// Publish swaps the written one with the middle, AcquireLatest swaps the middle with the read one if it is new.
+// The writer can publish as often as it wants: the reader skips the ones it didn't see.
+// One writer thread and one reader thread only.
+template <class T>
+class TripleBuffer
+{
+public:
+
+    // writer side
+    inline T& GetWriteBuffer() { return m_buffers[m_writeIndex]; }
+
+    inline void Publish()
+    {
+        const uint8_t previousMiddle = m_middle.exchange(m_writeIndex | m_newBit, std::memory_order_acq_rel);
+        m_writeIndex = previousMiddle & m_indexMask;
+    }
+
+    // reader side, true if something was published since the last call. Otherwise the read buffer stays the same.
+    inline bool AcquireLatest()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & m_newBit) == 0)
+        {
+            return false;
+        }
+        const uint8_t previousMiddle = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+        m_readIndex = previousMiddle & m_indexMask;
+        return true;
+    }
+
+    inline const T& GetReadBuffer() const { return m_buffers[m_readIndex]; }
+
+private:
+    static constexpr uint8_t m_indexMask = 3;
+    static constexpr uint8_t m_newBit = 4;
+
+    array<T, 3> m_buffers;
+
+    // on their own cache lines, the writer and the reader each touch theirs all the time
+    alignas(64) uint8_t m_writeIndex = 0;
+    alignas(64) std::atomic<uint8_t> m_middle{ 1 };
+    alignas(64) uint8_t m_readIndex = 2;
+};
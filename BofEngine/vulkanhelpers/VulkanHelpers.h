@@ -1578,6 +1578,12 @@ namespace bofgltf
         // root nodes
         Vector<int> m_sceneNodeIndices; 
 
+        // all the nodes, parents before their children (breadth first from the roots), so the global
+        // matrices are computed in one pass, see updateGlobalMatrices
+        Vector<int> m_depthSortedNodeIndices;
+        // by node index, parent global * node local
+        Vector<glm::mat4> m_globalMatrices;
+
         Texture m_emptyTexture;
 
         bool m_metallicRoughnessWorkflow = true;
@@ -1815,15 +1821,8 @@ namespace bofgltf
             
 
             // initial pose
-            for (int nodeIndex : m_sceneNodeIndices)
-            {
-                Node& node = m_linearNodes[nodeIndex];
-
-                if (!node.m_mesh.m_primitives.empty())
-                {
-                    updateNode(node.m_index);
-                }
-            }
+            sortNodesByDepth();
+            updateNodes();
 
             const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
             const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
@@ -2349,30 +2348,33 @@ namespace bofgltf
                 node.m_matrix;
         }
 
-        glm::mat4 getNodeGlobalMatrix(int nodeIndex) const
+        // as of the last updateGlobalMatrices
+        const glm::mat4& getNodeGlobalMatrix(int nodeIndex) const
         {
-            const Node& node = m_linearNodes[nodeIndex];
-
-            glm::mat4 mat = Model::getNodeLocalMatrix(node);
+            return m_globalMatrices[nodeIndex];
+        }
 
-            int parentIndex = node.m_parentIndex;
-            
-            while (parentIndex != -1)
+        void sortNodesByDepth()
+        {
+            m_depthSortedNodeIndices.clear();
+            m_depthSortedNodeIndices.insert(m_depthSortedNodeIndices.end(), m_sceneNodeIndices.begin(), m_sceneNodeIndices.end());
+            for (size_t i = 0; i < m_depthSortedNodeIndices.size(); i++)
             {
-                const Node& parentNode = m_linearNodes[parentIndex];
-
-                const glm::mat4 parentLocalMatrix = Model::getNodeLocalMatrix(parentNode);
-
-                mat = parentLocalMatrix * mat;
-
-                parentIndex = parentNode.m_parentIndex;
+                const Node& node = m_linearNodes[m_depthSortedNodeIndices[i]];
+                m_depthSortedNodeIndices.insert(m_depthSortedNodeIndices.end(), node.m_childrenNodeIndices.begin(), node.m_childrenNodeIndices.end());
             }
+            m_globalMatrices.resize(m_linearNodes.size(), glm::mat4(1.0f));
+        }
 
-            return
-                glm::translate(glm::mat4(1.0f), node.m_translation) *
-                glm::mat4(node.m_rotation) *
-                glm::scale(glm::mat4(1.0f), node.m_scale) *
-                node.m_matrix;
+        // one multiply per node, the parent is always done before
+        void updateGlobalMatrices()
+        {
+            for (int nodeIndex : m_depthSortedNodeIndices)
+            {
+                const Node& node = m_linearNodes[nodeIndex];
+                const glm::mat4 localMatrix = Model::getNodeLocalMatrix(node);
+                m_globalMatrices[nodeIndex] = node.m_parentIndex != -1 ? m_globalMatrices[node.m_parentIndex] * localMatrix : localMatrix;
+            }
         }
 
         void extendBoxWithNode(int nodeIndex, AABB& box) const 
@@ -2387,40 +2389,40 @@ namespace bofgltf
 
                 box.extend(locMin, locMax);
             }
-            for (int childIndex : node.m_childrenNodeIndices)
-            {
-                extendBoxWithNode(childIndex, box);
-            }
         }
 
         AABB computeSceneDimensions() const
         {
             AABB box;
-            for (int sceneNodes : m_sceneNodeIndices)
+            for (int nodeIndex : m_depthSortedNodeIndices)
             {
-                extendBoxWithNode(sceneNodes, box);
+                extendBoxWithNode(nodeIndex, box);
             }
             return box;
         }
 
-        void updateNode(int nodeIndex)
+        // global matrices, then the uniform buffers of the nodes that have a mesh
+        void updateNodes()
         {
-            Node& node = m_linearNodes[nodeIndex];
+            updateGlobalMatrices();
 
-            const glm::mat4 mat = getNodeGlobalMatrix(nodeIndex);
-
-            if (node.m_skin)
+            for (int nodeIndex : m_depthSortedNodeIndices)
             {
-                //...
-            }
-            else
-            {
-                memcpy(node.m_mesh.m_uniformBuffer.m_mappedMemory, &mat, sizeof(glm::mat4));
-            }
+                Node& node = m_linearNodes[nodeIndex];
 
-            for (int childIndex : node.m_childrenNodeIndices)
-            {
-                updateNode(childIndex);
+                if (!node.m_mesh.hasPrimitives())
+                {
+                    continue;
+                }
+
+                if (node.m_skin)
+                {
+                    //...
+                }
+                else
+                {
+                    memcpy(node.m_mesh.m_uniformBuffer.m_mappedMemory, &m_globalMatrices[nodeIndex], sizeof(glm::mat4));
+                }
             }
         }
 
@@ -12,6 +12,7 @@
 #include "core/BofEngine.h"
 
 #include "components/GoodComponents.h"
+#include "components/FixedTimestep.h"
 #include "utils/GoodSave.h"
 
 #include "external/pods/pods.h"
@@ -538,6 +539,27 @@ private:
             poolInfo.flags |= vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
             m_imguiCommandPool = checkVkResult(m_device->createCommandPool(poolInfo));
         }
+        {
+            PROFILE(initSimulation);
+
+            // the model turning is the simulation, at a fixed rate. The render interpolates it.
+            ComponentGrid& state = m_simulation.GetState().m_state;
+            state.AddCompVector<LocalTransformComp>();
+            m_modelEntityId = state.CreateEntity();
+            state.AddComp<LocalTransformComp>(m_modelEntityId);
+
+            const float tickSeconds = (float)m_fixedTimestep.GetTickSeconds();
+            m_simulation.SetTickFunction([tickSeconds](SimulationState& simulationState, const PlayerInputs& /*inputs*/, int /*frameIndex*/)
+            {
+                static constexpr float radsPerSecond = 0.5f;
+                ComponentVector<LocalTransformComp>* transforms = simulationState.m_state.GetComps<LocalTransformComp>();
+                for (size_t i = 0; i < transforms->Size(); i++)
+                {
+                    glm::quat& rotation = transforms->GetCompAtIndex(i).m_rotation;
+                    rotation = glm::angleAxis(radsPerSecond * tickSeconds, glm::vec3(0.0f, 0.0f, 1.0f)) * rotation;
+                }
+            });
+        }
 
         // this is also called on resize
         createSwapchainAndRelatedThings();
@@ -1607,14 +1629,16 @@ private:
 
     void updateUniformBuffer(uint32_t currentImage)
     {
-        const double time = m_clock.GetTimeSecs();
-
         UniformBufferObject ubo{};
-        static float radsPerSecond = 0.5f;
-        const double angle = time * radsPerSecond;
-        ubo.model = glm::rotate(
-            glm::mat4(1.0f), (float)angle,
-            glm::vec3(0.0f, 0.0f, 1.0f));
+        ubo.model = glm::mat4(1.0f);
+        m_fixedTimestep.ForEachInterpolated<LocalTransformComp>(
+            [&](GoodId entityId, const LocalTransformComp& previous, const LocalTransformComp& current, float alpha)
+        {
+            if (entityId == m_modelEntityId)
+            {
+                ubo.model = Interpolate(previous, current, alpha).GetMatrix();
+            }
+        });
 
         ubo.view = glm::lookAt(
             glm::vec3(1.5f, 1.5f, 0.8f),
@@ -1675,6 +1699,8 @@ private:
         while (!glfwWindowShouldClose(m_window))
         {
             glfwPollEvents();
+            // as many ticks as the time since the last frame needs (capped), then draw between the last two states
+            m_fixedTimestep.Advance();
             drawFrame();
 
             showFps();
@@ -1792,6 +1818,10 @@ private:
 
     Bof::SimpleClock m_clock;
 
+    Simulation m_simulation;
+    FixedTimestep m_fixedTimestep{ m_simulation, 60 };
+    GoodId m_modelEntityId = 0;
+
     bool m_showFps = false;
     RingBuffer<double, 100> m_frameTimes;
 
@@ -1872,16 +1902,14 @@ int main(int /*argc*/, char** /*argv*/)
     ComponentGrid grid;
     prepareMyGridWithComponentVectors(grid);
 
-    GoodId entityIdGenerator = 10000;
-
-    GoodId myEntity0 = entityIdGenerator++;
+    GoodId myEntity0 = grid.CreateEntity();
 
     //Allo* newAlloComp = grid.GetCompVector<Allo>()->AddEntityId(myEntity0);
     //Allo* newAlloComp = GET_COMPS(grid, Allo).AddEntityId(myEntity0);
     Allo* newAlloComp = grid.AddComp<Allo>(myEntity0);
     newAlloComp->someInt = 56;
 
-    GoodId myEntity1 = entityIdGenerator++;
+    GoodId myEntity1 = grid.CreateEntity();
 
     Allo* newAlloComp1 = grid.AddComp<Allo>(myEntity1);
     newAlloComp1->someInt = 588;
@@ -12,8 +12,12 @@
 #include "core/BofEngine.h"
 
 #include "components/GoodComponents.h"
+#include "components/SimulationThread.h"
 #include "utils/GoodSave.h"
 
+#include "benchmarks/ComponentBenchmarks.h"
+#include "benchmarks/NetBenchmarks.h"
+
 #include "external/pods/pods.h"
 #include "external/pods/buffers.h"
 
@@ -135,6 +139,12 @@ public:
         cleanup();
     }
 
+    // the grid shown in the memory panel
+    void setDebugGrid(const ComponentGrid* grid)
+    {
+        m_debugGrid = grid;
+    }
+
 private:
  
     void init()
@@ -625,6 +635,27 @@ private:
             poolInfo.flags |= vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
             m_imguiCommandPool = checkVkResult(m_device->createCommandPool(poolInfo));
         }
+        {
+            PROFILE(initSimulation);
+
+            // the model turning is the simulation, on its own thread. The render takes its latest snapshot.
+            ComponentGrid& state = m_simulation.GetState().m_state;
+            state.AddCompVector<LocalTransformComp>();
+            m_modelEntityId = state.CreateEntity();
+            state.AddComp<LocalTransformComp>(m_modelEntityId);
+
+            m_simulationThread = std::make_unique<SimulationThread>(m_simulation, 60);
+            m_simulation.SetTickFunction([](SimulationState& simulationState, const PlayerInputs& /*inputs*/, int /*frameIndex*/)
+            {
+                static constexpr float radsPerTick = 0.5f / 60.0f;
+                ComponentVector<LocalTransformComp>* transforms = simulationState.m_state.GetComps<LocalTransformComp>();
+                for (size_t i = 0; i < transforms->Size(); i++)
+                {
+                    glm::quat& rotation = transforms->GetCompAtIndex(i).m_rotation;
+                    rotation = glm::angleAxis(radsPerTick, glm::vec3(0.0f, 1.0f, 0.0f)) * rotation;
+                }
+            });
+        }
 
         // this is also called on resize
         createSwapchainAndRelatedThings();
@@ -1722,6 +1753,8 @@ private:
 
             ImGui::NewFrame();
             ImGui::ShowDemoWindow();
+            drawGridMemoryWindow();
+            drawFrameTimesWindow();
             ImGui::Render();
 
             ImDrawData* drawData = ImGui::GetDrawData();
@@ -1860,6 +1893,17 @@ private:
 
         m_uboVS.m_projection = m_camera.computePerspectiveMatrix();
         m_uboVS.m_modelView = m_camera.computeViewMatrix();
+
+        // never waits: the last state the simulation thread published, or the same as last frame
+        const RenderSnapshot& snapshot = m_simulationThread->AcquireLatestSnapshot();
+        if (snapshot.m_state)
+        {
+            const LocalTransformComp* modelTransform = snapshot.m_state->GetConstComps<LocalTransformComp>()->GetCompIfExists(m_modelEntityId);
+            if (modelTransform)
+            {
+                m_uboVS.m_modelView = m_uboVS.m_modelView * modelTransform->GetMatrix();
+            }
+        }
         memcpy(m_uniformBuffer.m_mappedMemory, &m_uboVS, sizeof(m_uboVS));
 
 
@@ -1873,6 +1917,7 @@ private:
 
         const double frameTime = thisTimeMS - m_frameStartTimeMS;
         m_frameTimes.Push(frameTime);
+        m_renderFrameTimes.Add(frameTime);
         if (m_showFps &&
             thisTimeMS - m_timeOfLastFpsDisplayMS > 1000.0f)
         {
@@ -1898,11 +1943,91 @@ private:
         m_frameStartTimeMS = m_clock.GetTimeMillis();
     }
 
+    void drawGridMemoryWindow()
+    {
+        if (m_debugGrid == nullptr)
+        {
+            return;
+        }
+        if (!ImGui::Begin("Grid memory"))
+        {
+            ImGui::End();
+            return;
+        }
+
+        const GridMemoryStats stats = m_debugGrid->GetMemoryStats();
+        constexpr double kb = 1024.0;
+
+        ImGui::Text("page pool: %.0f KB reserved, %.0f KB used, %.0f KB free, %i chunks, %i page sizes",
+            stats.m_pagePool.m_reservedBytes / kb, stats.m_pagePool.m_usedBytes / kb, stats.m_pagePool.m_freeBytes / kb,
+            (int)stats.m_pagePool.m_chunkCount, (int)stats.m_pagePool.m_sizeClassCount);
+        if (stats.m_pagePool.m_oversizedBytes > 0)
+        {
+            ImGui::Text("oversized pages: %.0f KB", stats.m_pagePool.m_oversizedBytes / kb);
+        }
+        ImGui::Text("tags: %.0f KB, entity ids: %.0f KB", stats.m_tagBytes / kb, stats.m_entityRegistryBytes / kb);
+
+        ImGui::Separator();
+        ImGui::Columns(7, "comps");
+        for (const char* header : { "comp", "count", "used KB", "reserved KB", "fragmentation", "index KB", "shared pages" })
+        {
+            ImGui::TextUnformatted(header);
+            ImGui::NextColumn();
+        }
+        ImGui::Separator();
+        for (const CompMemoryStats& comp : stats.m_comps)
+        {
+            ImGui::TextUnformatted(comp.m_compClassName);
+            ImGui::NextColumn();
+            ImGui::Text("%i", (int)comp.m_count);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f", comp.m_usedBytes / kb);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f", comp.m_reservedBytes / kb);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f%%", comp.GetFragmentation() * 100.0f);
+            ImGui::NextColumn();
+            ImGui::Text("%.1f", comp.m_indexBytes / kb);
+            ImGui::NextColumn();
+            ImGui::Text("%i / %i", (int)comp.m_sharedPageCount, (int)comp.m_pageCount);
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+        ImGui::End();
+    }
+
+    // the render and simulation threads side by side, to see if one waits on the other
+    void drawFrameTimesWindow()
+    {
+        if (!ImGui::Begin("Frame times"))
+        {
+            ImGui::End();
+            return;
+        }
+
+        auto drawHistogram = [](const char* label, const FrameTimeHistogram& histogram)
+        {
+            std::array<float, FrameTimeHistogram::m_bucketCount> counts;
+            histogram.GetCounts(counts);
+            ImGui::Text("%s: %llu frames, mean %.2f ms, p50 %.1f ms, p99 %.1f ms, max %.2f ms", label,
+                (unsigned long long)histogram.GetTotalCount(), histogram.GetMeanMS(),
+                histogram.GetPercentileMS(0.5), histogram.GetPercentileMS(0.99), histogram.GetMaxMS());
+            ImGui::PlotHistogram(label, counts.data(), (int)counts.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+        };
+        drawHistogram("render", m_renderFrameTimes);
+        drawHistogram("simulation", m_simulationThread->GetTickTimes());
+        drawHistogram("simulation jitter", m_simulationThread->GetTickJitter());
+        ImGui::Text("buckets of %.1f ms", FrameTimeHistogram::m_bucketMS);
+
+        ImGui::End();
+    }
+
     void mainLoop()
     {
         m_frameStartTimeMS = m_clock.GetTimeMillis();
         m_timeOfLastFpsDisplayMS = m_frameStartTimeMS;
 
+        m_simulationThread->Start();
         while (!glfwWindowShouldClose(m_window))
         {
             glfwPollEvents();
@@ -1912,6 +2037,7 @@ private:
 
             m_isFirstFrame = false;
         }
+        m_simulationThread->Stop();
         m_device->waitIdle();
     }
 
@@ -2027,6 +2153,11 @@ private:
 
     bool m_showFps = false;
     RingBuffer<double, 100> m_frameTimes;
+    FrameTimeHistogram m_renderFrameTimes;
+
+    Simulation m_simulation;
+    std::unique_ptr<SimulationThread> m_simulationThread;
+    GoodId m_modelEntityId = 0;
 
     double m_frameStartTimeMS = 0.0;
     double m_timeOfLastFpsDisplayMS = 0.0;
@@ -2066,6 +2197,8 @@ private:
     UBOVS m_uboVS;
 
     BF_Camera m_camera;
+
+    const ComponentGrid* m_debugGrid = nullptr;
 };
 
 struct Hoho final : public GoodSerializable
@@ -2161,7 +2294,7 @@ void prepareMyGridWithComponentVectors(ComponentGrid& grid)
 
 
 
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
     Vector<Allo> allos;
     allos.resize(3);
@@ -2211,6 +2344,13 @@ int main(int /*argc*/, char** /*argv*/)
 
     Bof::Log::Init();
 
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        ComponentBenchmarks::RunAll();
+        NetBenchmarks::RunAll();
+        return EXIT_SUCCESS;
+    }
+
     {
         std::shared_ptr<Allo> b;
 
@@ -2229,16 +2369,14 @@ int main(int /*argc*/, char** /*argv*/)
     ComponentGrid grid;
     prepareMyGridWithComponentVectors(grid);
 
-    GoodId entityIdGenerator = 10000;
-
-    GoodId myEntity0 = entityIdGenerator++;
+    GoodId myEntity0 = grid.CreateEntity();
 
     //Allo* newAlloComp = grid.GetCompVector<Allo>()->AddEntityId(myEntity0);
     //Allo* newAlloComp = GET_COMPS(grid, Allo).AddEntityId(myEntity0);
     Allo* newAlloComp = grid.AddComp<Allo>(myEntity0);
     newAlloComp->m_someInt = 56;
 
-    GoodId myEntity1 = entityIdGenerator++;
+    GoodId myEntity1 = grid.CreateEntity();
     {
         Allo* newAlloComp1 = grid.AddComp<Allo>(myEntity1);
         newAlloComp1->m_someInt = 588;
@@ -2268,6 +2406,7 @@ int main(int /*argc*/, char** /*argv*/)
 
     auto app = std::make_unique<BofGame>();
 
+    app->setDebugGrid(&grid);
     app->run();
 }
 
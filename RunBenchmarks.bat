@@ -0,0 +1,2 @@
+rem ... micro benchmarks, no asserts so that they do not get in the way
+.\bin\Release\BofGame2.exe --bench